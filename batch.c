@@ -0,0 +1,559 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+// clock_gettime and sysconf are not part of C99
+#define _DEFAULT_SOURCE
+
+#include "batch.h"
+
+/*!
+    \file batch.c
+    \brief Headless execution and batch runner
+    \author Hugues Bruant
+    
+    Job lines hold whitespace separated fields :
+    
+        elf [arch [stdin [stdout [limit]]]]
+    
+    "-" selects the default value of a field : the architecture given on the
+    command line, no console input, discarded console output and the
+    instruction limit given on the command line. Empty lines and lines
+    starting with # are ignored.
+    
+    Jobs are split in contiguous ranges, one per worker. A worker takes jobs
+    from the front of its own range and, once it runs dry, steals from the
+    back of the other ranges so that a few long jobs do not leave the other
+    workers idle.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__)
+#include <unistd.h>
+#endif
+
+#if defined(__unix__) && defined(__GNUC__)
+#define BATCH_THREADS
+#include <pthread.h>
+#endif
+
+#include "io.h"
+#include "mips.h"
+#include "mipself.h"
+
+#define BATCH_LINE_SIZE 4096
+
+enum {
+    JOB_FAILED = -1
+};
+
+typedef struct _Batch_Job {
+    char *elf, *in, *out;
+    int arch;
+    uint64_t limit;
+    
+    int status;
+    MIPS_Native exit_code;
+    uint64_t count;
+    double time;
+} Batch_Job;
+
+typedef struct _Batch Batch;
+
+typedef struct _Batch_Queue {
+    Batch *batch;
+    int id;
+    int head, tail;
+
+#ifdef BATCH_THREADS
+    pthread_mutex_t lock;
+    pthread_t thread;
+    int started;
+#endif
+} Batch_Queue;
+
+struct _Batch {
+    MIPSIM_Config *base;
+    
+    Batch_Job *jobs;
+    int njobs, jobs_alloc;
+    
+    Batch_Queue *queues;
+    int nqueues;
+};
+
+/*!
+    \internal
+    \brief Wall clock time, in seconds
+*/
+static double batch_clock()
+{
+#if defined(__unix__)
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/*!
+    \internal
+    \brief Extract the next whitespace separated field of a line
+    \return field, NULL at end of line
+*/
+static char* batch_field(char **s)
+{
+    char *p = *s;
+    
+    while ( *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' )
+        ++p;
+    
+    if ( !*p )
+        return NULL;
+    
+    char *f = p;
+    
+    while ( *p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' )
+        ++p;
+    
+    if ( *p )
+        *p++ = 0;
+    
+    *s = p;
+    
+    return f;
+}
+
+/*!
+    \internal
+    \brief Whether a field is missing or asks for the default value
+*/
+static int batch_default(const char *f)
+{
+    return f == NULL || !strcmp(f, "-");
+}
+
+/*!
+    \internal
+    \brief Read the job list of a batch
+    \return 0 on success
+*/
+static int batch_parse(Batch *b, const char *path)
+{
+    FILE *f = fopen(path, "rt");
+    
+    if ( f == NULL )
+    {
+        mipsim_printf(IO_WARNING, "Batch: unable to open %s\n", path);
+        return 1;
+    }
+    
+    char line[BATCH_LINE_SIZE];
+    int n = 0, ret = 0;
+    
+    while ( !ret && fgets(line, BATCH_LINE_SIZE, f) != NULL )
+    {
+        ++n;
+        
+        char *s = line;
+        char *elf = batch_field(&s);
+        
+        if ( elf == NULL || *elf == '#' )
+            continue;
+        
+        char *arch = batch_field(&s);
+        char *in = batch_field(&s);
+        char *out = batch_field(&s);
+        char *limit = batch_field(&s);
+        
+        if ( batch_field(&s) != NULL )
+        {
+            mipsim_printf(IO_WARNING, "Batch: %s:%d: too many fields\n", path, n);
+            ret = 1;
+            break;
+        }
+        
+        if ( b->njobs == b->jobs_alloc )
+        {
+            int alloc = b->jobs_alloc ? 2 * b->jobs_alloc : 64;
+            Batch_Job *jobs = (Batch_Job*)realloc(b->jobs, alloc * sizeof(Batch_Job));
+            
+            if ( jobs == NULL )
+            {
+                ret = 1;
+                break;
+            }
+            
+            b->jobs = jobs;
+            b->jobs_alloc = alloc;
+        }
+        
+        Batch_Job *j = &b->jobs[b->njobs];
+        
+        j->arch = batch_default(arch) ? b->base->arch : mips_isa_id(arch);
+        j->limit = b->base->max_insns;
+        j->status = JOB_FAILED;
+        j->exit_code = 0;
+        j->count = 0;
+        j->time = 0;
+        
+        if ( j->arch == MIPS_ARCH_NONE )
+        {
+            mipsim_printf(IO_WARNING, "Batch: %s:%d: unknown architecture %s\n", path, n, arch);
+            ret = 1;
+            break;
+        }
+        
+        if ( !batch_default(limit) )
+        {
+            char *end;
+            j->limit = strtoull(limit, &end, 0);
+            
+            if ( *end )
+            {
+                mipsim_printf(IO_WARNING, "Batch: %s:%d: invalid limit %s\n", path, n, limit);
+                ret = 1;
+                break;
+            }
+        }
+        
+        j->elf = strdup(elf);
+        j->in = batch_default(in) ? NULL : strdup(in);
+        j->out = batch_default(out) ? NULL : strdup(out);
+        
+        if ( j->elf == NULL
+            || (j->in == NULL && !batch_default(in))
+            || (j->out == NULL && !batch_default(out)) )
+        {
+            free(j->elf);
+            free(j->in);
+            free(j->out);
+            ret = 1;
+            break;
+        }
+        
+        ++b->njobs;
+    }
+    
+    fclose(f);
+    
+    return ret;
+}
+
+/*!
+    \internal
+    \brief Open a console file of a job
+    \param path file path, NULL for an empty input or a discarded output
+*/
+static FILE* batch_stream(const char *path, const char *mode)
+{
+    if ( path != NULL )
+        return fopen(path, mode);
+
+#if defined(__unix__)
+    return fopen("/dev/null", mode);
+#else
+    return tmpfile();
+#endif
+}
+
+/*!
+    \internal
+    \brief Load and run the program of a job on a machine of its own
+    \param cfg config of the machine, bound to the calling thread
+*/
+static void batch_exec(MIPSIM_Config *cfg, Batch_Job *j)
+{
+    MIPS *m = NULL;
+    ELF_File *f = NULL;
+    
+    if ( (m = mips_create(j->arch, cfg)) == NULL
+        || (f = elf_file_create()) == NULL
+        || elf_file_load(f, j->elf)
+        || mips_load_elf(m, f) )
+    {
+        mipsim_printf(IO_WARNING, "Unable to load %s\n", j->elf);
+    } else {
+        mips_set_engine(m, cfg->engine);
+        j->status = mips_run(m, j->limit, &j->count);
+        j->exit_code = m->exit_code;
+    }
+    
+    mips_destroy(m);
+    elf_file_destroy(f);
+}
+
+/*!
+    \internal
+    \brief Run a job on a machine of its own
+    
+    The job gets a copy of the base config, bound to the running thread for
+    the whole job so that warnings do not go through the base config.
+*/
+static void batch_run(Batch *b, Batch_Job *j)
+{
+    double start = batch_clock();
+    MIPSIM_Config *cfg = mipsim_config_create(b->base);
+    
+    if ( cfg == NULL )
+        return;
+    
+    MIPSIM_Config *prev = mipsim_config_bind(cfg);
+    
+    // logs of concurrent jobs would be interleaved and job output never
+    // goes to a terminal
+    cfg->io_mask &= ~(IO_TRACE | IO_DEBUG);
+    cfg->mon_flush &= ~FLUSH_NEWLINE;
+    
+    FILE *in = batch_stream(j->in, "rb");
+    FILE *out = batch_stream(j->out, "wb");
+    
+    if ( in != NULL )
+        cfg->mon_in = in;
+    
+    if ( out != NULL )
+        cfg->mon_out = out;
+    
+    if ( in == NULL || out == NULL )
+        mipsim_printf(IO_WARNING, "Batch: unable to open console files of %s\n", j->elf);
+    else
+        batch_exec(cfg, j);
+    
+    mipsim_config_bind(prev);
+    mipsim_config_destroy(cfg);
+    
+    j->time = batch_clock() - start;
+}
+
+/*!
+    \internal
+    \brief Take a job from the front of a queue, or from its back when stealing
+    \return job index, -1 if the queue is empty
+*/
+static int batch_take(Batch_Queue *q, int steal)
+{
+    int j = -1;
+
+#ifdef BATCH_THREADS
+    pthread_mutex_lock(&q->lock);
+#endif
+
+    if ( q->head < q->tail )
+        j = steal ? --q->tail : q->head++;
+
+#ifdef BATCH_THREADS
+    pthread_mutex_unlock(&q->lock);
+#endif
+
+    return j;
+}
+
+/*!
+    \internal
+    \brief Worker loop : run jobs until all queues are empty
+*/
+static void* batch_worker(void *p)
+{
+    Batch_Queue *q = (Batch_Queue*)p;
+    Batch *b = q->batch;
+    
+    for ( ; ; )
+    {
+        int j = batch_take(q, 0);
+        
+        // queues are never refilled : once every one is empty, we are done
+        for ( int i = 1; j < 0 && i < b->nqueues; ++i )
+            j = batch_take(&b->queues[(q->id + i) % b->nqueues], 1);
+        
+        if ( j < 0 )
+            break;
+        
+        batch_run(b, &b->jobs[j]);
+    }
+    
+    return NULL;
+}
+
+/*!
+    \internal
+    \brief Print the status, exit code, instruction count and wall time of each job
+    \return number of jobs that could not be run
+*/
+static int batch_summary(Batch *b, double time)
+{
+    int failed = 0;
+    
+    printf("%5s  %-26s %11s %20s %10s  %s\n", "job", "status", "exit", "insns", "time", "elf");
+    
+    for ( int i = 0; i < b->njobs; ++i )
+    {
+        Batch_Job *j = &b->jobs[i];
+        const char *status = j->status < 0 ? "Failed to run" : mips_stop_reason_name(j->status);
+        
+        if ( j->status < 0 )
+            ++failed;
+        
+        if ( j->status == MIPS_QUIT )
+            printf("%5d  %-26s %11d %20" PRIu64 " %10.3f  %s\n",
+                   i + 1, status, j->exit_code, j->count, j->time, j->elf);
+        else
+            printf("%5d  %-26s %11s %20" PRIu64 " %10.3f  %s\n",
+                   i + 1, status, "-", j->count, j->time, j->elf);
+    }
+    
+    printf("%d jobs, %d failed to run, %d threads, %.3f s\n", b->njobs, failed, b->nqueues, time);
+    
+    return failed;
+}
+
+/*!
+    \brief Run all jobs of a batch file and print a summary table
+    \param base config whose settings are used by every job
+    \param path batch file
+    \param threads number of worker threads, 0 for one per online CPU
+    \return 0 if every job could be run
+    
+    The calling thread takes part in the work.
+*/
+int mipsim_batch(MIPSIM_Config *base, const char *path, int threads)
+{
+    Batch b;
+    b.base = base;
+    b.jobs = NULL;
+    b.njobs = b.jobs_alloc = 0;
+    b.queues = NULL;
+    b.nqueues = 0;
+    
+    int ret = batch_parse(&b, path);
+
+#if defined(__unix__)
+    if ( threads <= 0 )
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+#ifndef BATCH_THREADS
+    threads = 1;
+#endif
+
+    if ( threads > b.njobs )
+        threads = b.njobs;
+    
+    if ( threads < 1 )
+        threads = 1;
+    
+    if ( !ret )
+    {
+        b.queues = (Batch_Queue*)malloc(threads * sizeof(Batch_Queue));
+        ret = b.queues == NULL;
+    }
+    
+    if ( !ret )
+    {
+        double start = batch_clock();
+        
+        b.nqueues = threads;
+        
+        for ( int i = 0; i < threads; ++i )
+        {
+            Batch_Queue *q = &b.queues[i];
+            q->batch = &b;
+            q->id = i;
+            q->head = (int)((int64_t)b.njobs * i / threads);
+            q->tail = (int)((int64_t)b.njobs * (i + 1) / threads);
+
+#ifdef BATCH_THREADS
+            pthread_mutex_init(&q->lock, NULL);
+            q->started = 0;
+#endif
+        }
+
+#ifdef BATCH_THREADS
+        // jobs of a worker that failed to start get stolen by the others
+        for ( int i = 1; i < threads; ++i )
+            b.queues[i].started = !pthread_create(&b.queues[i].thread, NULL, batch_worker, &b.queues[i]);
+#endif
+
+        batch_worker(&b.queues[0]);
+
+#ifdef BATCH_THREADS
+        for ( int i = 1; i < threads; ++i )
+            if ( b.queues[i].started )
+                pthread_join(b.queues[i].thread, NULL);
+        
+        for ( int i = 0; i < threads; ++i )
+            pthread_mutex_destroy(&b.queues[i].lock);
+#endif
+
+        ret = batch_summary(&b, batch_clock() - start) != 0;
+    }
+    
+    for ( int i = 0; i < b.njobs; ++i )
+    {
+        free(b.jobs[i].elf);
+        free(b.jobs[i].in);
+        free(b.jobs[i].out);
+    }
+    
+    free(b.jobs);
+    free(b.queues);
+    
+    return ret;
+}
+
+/*!
+    \brief Run a program without any interaction
+    \param cfg config of the program, console files and instruction limit included
+    \param path ELF file
+    \return exit status for the simulator process
+    
+    The exit status is the one given by the guest to _exit, 0 if the guest
+    stopped on a break, 124 if the instruction limit was reached, 125 if the
+    guest stopped for any other reason and 126 if it could not be loaded.
+*/
+int mipsim_headless(MIPSIM_Config *cfg, const char *path)
+{
+    Batch_Job j;
+    j.elf = (char*)path;
+    j.in = j.out = NULL;
+    j.arch = cfg->arch;
+    j.limit = cfg->max_insns;
+    j.status = JOB_FAILED;
+    j.exit_code = 0;
+    j.count = 0;
+    j.time = 0;
+    
+    MIPSIM_Config *prev = mipsim_config_bind(cfg);
+    batch_exec(cfg, &j);
+    mipsim_config_bind(prev);
+    
+    switch ( j.status )
+    {
+        case JOB_FAILED :
+            return 126;
+            
+        case MIPS_QUIT :
+            return j.exit_code & 0xFF;
+            
+        case MIPS_BREAK :
+            return 0;
+            
+        case MIPS_LIMIT :
+            mipsim_printf(IO_WARNING, "%s after %" PRIu64 " instructions\n",
+                          mips_stop_reason_name(j.status), j.count);
+            return 124;
+            
+        default:
+            mipsim_printf(IO_WARNING, "%s\n", mips_stop_reason_name(j.status));
+            return 125;
+    }
+}
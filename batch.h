@@ -0,0 +1,30 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+#ifndef _MIPSIM_BATCH_H_
+#define _MIPSIM_BATCH_H_
+
+/*!
+    \file batch.h
+    \brief Headless execution and batch runner
+    \author Hugues Bruant
+    
+    A batch is a text file describing one job per line : an ELF file to run
+    with its architecture, console input and output files and instruction
+    limit. Jobs run concurrently on a pool of threads, each one on its own
+    simulated machine.
+*/
+
+#include "config.h"
+
+int mipsim_headless(MIPSIM_Config *cfg, const char *path);
+int mipsim_batch(MIPSIM_Config *base, const char *path, int threads);
+
+#endif
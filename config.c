@@ -8,6 +8,9 @@
 **  Refer to the accompanying COPYING file for legalese.
 ****************************************************************************/
 
+// fileno, isatty and strdup are not part of C99
+#define _DEFAULT_SOURCE
+
 #include "config.h"
 
 /*!
@@ -16,47 +19,185 @@
     \author Hugues Bruant
 */
 
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(__unix__)
+#include <unistd.h>
+#endif
+
 #include "mips.h"
 #include "io.h"
 #include "util.h"
+#include "trace.h"
+
+#if defined(__GNUC__)
+#define MIPSIM_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define MIPSIM_THREAD_LOCAL __declspec(thread)
+#else
+#define MIPSIM_THREAD_LOCAL
+#endif
+
+static MIPSIM_Config default_cfg;
+static MIPSIM_THREAD_LOCAL MIPSIM_Config *current_cfg = NULL;
 
 /*!
-    \brief Accessor to the global configuration of the application
+    \brief Accessor to the configuration bound to the calling thread
+    
+    Threads which did not bind any config use the global configuration of
+    the application.
 */
 MIPSIM_Config* mipsim_config()
 {
-    static MIPSIM_Config cfg;
-    return &cfg;
+    return current_cfg != NULL ? current_cfg : &default_cfg;
 }
 
 /*!
-    \brief Initialize the global configuration based on CLI parameters
-    \param argc argument count
-    \param argv argument values
-    
-    \note Consumed argument are nullified (the first character of each
-    consumed value is set to 0 to make them empty strings).
+    \brief Bind a configuration to the calling thread
+    \param cfg config to bind, NULL to go back to the global configuration
+    \return previously bound config, to be restored by the caller
 */
-int mipsim_config_init(int argc, char **argv)
+MIPSIM_Config* mipsim_config_bind(MIPSIM_Config *cfg)
+{
+    MIPSIM_Config *prev = current_cfg;
+    current_cfg = cfg;
+    return prev;
+}
+
+/*!
+    \internal
+    \brief Default values of all config fields
+*/
+static void mipsim_config_defaults(MIPSIM_Config *cfg)
 {
-    MIPSIM_Config *cfg = mipsim_config();
-    
     cfg->io_mask = 0;
     cfg->mon_in = stdin;
     cfg->mon_out = stdout;
     cfg->trace_log = NULL;
+    cfg->trace_bin = NULL;
     cfg->debug_log = NULL;
     
+    cfg->trace_buffer = NULL;
+    cfg->trace_count = 0;
+    
+    cfg->mon_flush = -1;
+    cfg->mon_buffer = NULL;
+    cfg->mon_buffer_size = 0x10000;
+    cfg->mon_buffer_used = 0;
+    
+    cfg->sandbox_root = NULL;
+    
+    cfg->async_log_size = 0;
+    cfg->writer = NULL;
+    
+    cfg->batch_file = NULL;
+    cfg->batch_threads = 0;
+    
+    cfg->headless = 0;
+    cfg->max_insns = 0;
+    
     cfg->arch = MIPS_I;
+    cfg->engine = MIPS_ENGINE_UNIVERSAL;
     
     cfg->reloc_text  = 0x00400000;
     cfg->reloc_data  = 0xFFFFFFFF;
     
     cfg->zero_sp = 0;
+    cfg->flat_memory = 0;
     cfg->phys_memory_size  = 0x00100000;
     cfg->newlib_stack_size = 0x00800000;
+    cfg->lazy_fault_around = 16;
+}
+
+/*!
+    \internal
+    \brief Resolve defaults depending on other fields and start the writer
+*/
+static void mipsim_config_setup(MIPSIM_Config *cfg)
+{
+    if ( cfg->mon_flush < 0 )
+    {
+        // interactive sessions want to see output as soon as lines are complete
+        cfg->mon_flush = FLUSH_STOP | FLUSH_INPUT;
+        
+#if defined(__unix__)
+        if ( isatty(fileno(cfg->mon_out)) )
+            cfg->mon_flush |= FLUSH_NEWLINE;
+#endif
+    }
+    
+    if ( cfg->async_log_size )
+    {
+        cfg->writer = mipsim_writer_create(cfg->async_log_size);
+        
+        if ( cfg->writer == NULL )
+            mipsim_printf(IO_WARNING, "CLI: asynchronous output unavailable, ignoring --async-log\n");
+    }
+}
+
+/*!
+    \internal
+    \brief Flush pending output and release everything owned by a config
+    
+    Streams other than stdin and stdout are owned by the config.
+*/
+static void mipsim_config_release(MIPSIM_Config *cfg)
+{
+    MIPSIM_Config *prev = mipsim_config_bind(cfg);
+    
+    mipsim_flush(IO_MONITOR, 0);
+    mips_trace_close();
+    
+    // everything queued must be written before streams are closed
+    mipsim_writer_destroy(cfg->writer);
+    cfg->writer = NULL;
+    
+    mipsim_config_bind(prev);
+    
+    free(cfg->mon_buffer);
+    cfg->mon_buffer = NULL;
+    
+    free(cfg->sandbox_root);
+    cfg->sandbox_root = NULL;
+    
+    free(cfg->batch_file);
+    cfg->batch_file = NULL;
+    
+    if ( cfg->mon_in != stdin )
+    {
+        fclose(cfg->mon_in);
+    }
+    
+    if ( cfg->mon_out != stdout )
+    {
+        fclose(cfg->mon_out);
+    }
+    
+    if ( cfg->trace_log != NULL )
+    {
+        fclose(cfg->trace_log);
+    }
+    
+    if ( cfg->debug_log != NULL )
+    {
+        fclose(cfg->debug_log);
+    }
+}
+
+/*!
+    \brief Initialize the global configuration based on CLI parameters
+    \param argc argument count
+    \param argv argument values
+    
+    \note Consumed argument are nullified (the first character of each
+    consumed value is set to 0 to make them empty strings).
+*/
+int mipsim_config_init(int argc, char **argv)
+{
+    MIPSIM_Config *cfg = &default_cfg;
+    
+    mipsim_config_defaults(cfg);
     
     int error;
     
@@ -72,10 +213,17 @@ int mipsim_config_init(int argc, char **argv)
             cfg->io_mask |= IO_DEBUG;
         } else if ( !strcmp(arg, "--trace") ) {
             *argv[i] = 0;
+#ifdef MIPSIM_NO_TRACE
+            mipsim_printf(IO_WARNING, "CLI: tracing was compiled out, ignoring --trace\n");
+#else
             cfg->io_mask |= IO_TRACE;
+#endif
         } else if ( !strcmp(arg, "--zero-sp") ) {
             *argv[i] = 0;
             cfg->zero_sp = 1;
+        } else if ( !strcmp(arg, "--flat-memory") ) {
+            *argv[i] = 0;
+            cfg->flat_memory = 1;
         } else if ( !strcmp(arg, "--debug-log") ) {
             *argv[i] = 0;
             if ( i+1 < argc )
@@ -106,6 +254,178 @@ int mipsim_config_init(int argc, char **argv)
             } else {
                 mipsim_printf(IO_WARNING, "CLI: missing value for --trace-log switch\n");
             }
+        } else if ( !strcmp(arg, "--trace-bin") ) {
+            *argv[i] = 0;
+            if ( i+1 < argc )
+            {
+                if ( mips_trace_open(argv[++i]) )
+                {
+                    mipsim_printf(IO_WARNING, "CLI: unable to open %s for writing\n", argv[i]);
+                }
+                
+                *argv[i] = 0;
+            } else {
+                mipsim_printf(IO_WARNING, "CLI: missing value for --trace-bin switch\n");
+            }
+        } else if ( !strcmp(arg, "--engine") ) {
+            *argv[i] = 0;
+            if ( i+1 < argc )
+            {
+                int engine = mips_engine_id(argv[++i]);
+                
+                if ( engine < 0 )
+                {
+                    mipsim_printf(IO_WARNING, "CLI: unknown engine %s\n", argv[i]);
+                } else {
+                    cfg->engine = engine;
+                }
+                
+                *argv[i] = 0;
+            } else {
+                mipsim_printf(IO_WARNING, "CLI: missing value for --engine switch\n");
+            }
+        } else if ( !strcmp(arg, "--sandbox") ) {
+            *argv[i] = 0;
+            if ( i+1 < argc )
+            {
+                free(cfg->sandbox_root);
+                cfg->sandbox_root = strdup(argv[++i]);
+                *argv[i] = 0;
+            } else {
+                mipsim_printf(IO_WARNING, "CLI: missing value for --sandbox switch\n");
+            }
+        } else if ( !strcmp(arg, "--run") ) {
+            *argv[i] = 0;
+            cfg->headless = 1;
+        } else if ( !strcmp(arg, "--max-insns") ) {
+            *argv[i] = 0;
+            if ( i+1 < argc )
+            {
+                char *end;
+                cfg->max_insns = strtoull(argv[++i], &end, 0);
+                
+                if ( *end || !*argv[i] )
+                {
+                    mipsim_printf(IO_WARNING, "CLI: invalid value for --max-insns switch\n");
+                    cfg->max_insns = 0;
+                }
+                
+                *argv[i] = 0;
+            } else {
+                mipsim_printf(IO_WARNING, "CLI: missing value for --max-insns switch\n");
+            }
+        } else if ( !strcmp(arg, "--stdin") ) {
+            *argv[i] = 0;
+            if ( i+1 < argc )
+            {
+                FILE *f = fopen(argv[++i], "rb");
+                
+                if ( f == NULL )
+                {
+                    mipsim_printf(IO_WARNING, "CLI: unable to open %s for reading\n", argv[i]);
+                } else {
+                    if ( cfg->mon_in != stdin )
+                        fclose(cfg->mon_in);
+                    
+                    cfg->mon_in = f;
+                }
+                
+                *argv[i] = 0;
+            } else {
+                mipsim_printf(IO_WARNING, "CLI: missing value for --stdin switch\n");
+            }
+        } else if ( !strcmp(arg, "--stdout") ) {
+            *argv[i] = 0;
+            if ( i+1 < argc )
+            {
+                FILE *f = fopen(argv[++i], "wb");
+                
+                if ( f == NULL )
+                {
+                    mipsim_printf(IO_WARNING, "CLI: unable to open %s for writing\n", argv[i]);
+                } else {
+                    if ( cfg->mon_out != stdout )
+                        fclose(cfg->mon_out);
+                    
+                    cfg->mon_out = f;
+                }
+                
+                *argv[i] = 0;
+            } else {
+                mipsim_printf(IO_WARNING, "CLI: missing value for --stdout switch\n");
+            }
+        } else if ( !strcmp(arg, "--batch") ) {
+            *argv[i] = 0;
+            if ( i+1 < argc )
+            {
+                free(cfg->batch_file);
+                cfg->batch_file = strdup(argv[++i]);
+                *argv[i] = 0;
+            } else {
+                mipsim_printf(IO_WARNING, "CLI: missing value for --batch switch\n");
+            }
+        } else if ( !strcmp(arg, "--jobs") ) {
+            *argv[i] = 0;
+            if ( i+1 < argc )
+            {
+                cfg->batch_threads = str_to_num(argv[++i], NULL, &error);
+                *argv[i] = 0;
+                
+                if ( error )
+                {
+                    mipsim_printf(IO_WARNING, "CLI: invalid value for --jobs switch\n");
+                    cfg->batch_threads = 0;
+                }
+            } else {
+                mipsim_printf(IO_WARNING, "CLI: missing value for --jobs switch\n");
+            }
+        } else if ( !strcmp(arg, "--async-log") ) {
+            *argv[i] = 0;
+            if ( i+1 < argc )
+            {
+                cfg->async_log_size = str_to_num(argv[++i], NULL, &error);
+                *argv[i] = 0;
+                
+                if ( error )
+                {
+                    mipsim_printf(IO_WARNING, "CLI: invalid value for --async-log switch\n");
+                    cfg->async_log_size = 0;
+                }
+            } else {
+                mipsim_printf(IO_WARNING, "CLI: missing value for --async-log switch\n");
+            }
+        } else if ( !strcmp(arg, "--flush") ) {
+            *argv[i] = 0;
+            if ( i+1 < argc )
+            {
+                int policy = mipsim_flush_policy(argv[++i]);
+                
+                if ( policy < 0 )
+                {
+                    mipsim_printf(IO_WARNING, "CLI: invalid value for --flush switch\n");
+                } else {
+                    cfg->mon_flush = policy;
+                }
+                
+                *argv[i] = 0;
+            } else {
+                mipsim_printf(IO_WARNING, "CLI: missing value for --flush switch\n");
+            }
+        } else if ( !strcmp(arg, "-ob") ) {
+            *argv[i] = 0;
+            if ( i+1 < argc )
+            {
+                cfg->mon_buffer_size = str_to_num(argv[++i], NULL, &error);
+                *argv[i] = 0;
+                
+                if ( error )
+                {
+                    mipsim_printf(IO_WARNING, "CLI: invalid value for -ob switch\n");
+                    cfg->mon_buffer_size = 0x10000;
+                }
+            } else {
+                mipsim_printf(IO_WARNING, "CLI: missing value for -ob switch\n");
+            }
         } else if ( !strcmp(arg, "-t") ) {
             *argv[i] = 0;
             if ( i+1 < argc )
@@ -162,9 +482,26 @@ int mipsim_config_init(int argc, char **argv)
             } else {
                 mipsim_printf(IO_WARNING, "CLI: missing value for -nss switch\n");
             }
+        } else if ( !strcmp(arg, "-fa") ) {
+            *argv[i] = 0;
+            if ( i+1 < argc )
+            {
+                cfg->lazy_fault_around = str_to_num(argv[++i], NULL, &error);
+                *argv[i] = 0;
+                
+                if ( error || !cfg->lazy_fault_around )
+                {
+                    mipsim_printf(IO_WARNING, "CLI: invalid value for -fa switch\n");
+                    cfg->lazy_fault_around = 16;
+                }
+            } else {
+                mipsim_printf(IO_WARNING, "CLI: missing value for -fa switch\n");
+            }
         }
     }
     
+    mipsim_config_setup(cfg);
+    
     return 0;
 }
 
@@ -173,27 +510,61 @@ int mipsim_config_init(int argc, char **argv)
 */
 int mipsim_config_fini()
 {
-    MIPSIM_Config *cfg = mipsim_config();
+    mipsim_config_release(&default_cfg);
     
-    if ( cfg->mon_in != stdin )
-    {
-        fclose(cfg->mon_in);
-    }
+    return 0;
+}
+
+/*!
+    \brief Create a configuration for an additional simulated machine
+    \param base config whose settings are copied, NULL for default settings
+    \return new config, to be released with \ref mipsim_config_destroy
     
-    if ( cfg->mon_out != stdout )
-    {
-        fclose(cfg->mon_out);
-    }
+    Only settings are copied : the new config uses stdin and stdout for
+    guest I/O, has no log or trace file and gets its own output buffer and
+    asynchronous writer.
+*/
+MIPSIM_Config* mipsim_config_create(const MIPSIM_Config *base)
+{
+    MIPSIM_Config *cfg = (MIPSIM_Config*)malloc(sizeof(MIPSIM_Config));
     
-    if ( cfg->trace_log != NULL )
-    {
-        fclose(cfg->trace_log);
-    }
+    if ( cfg == NULL )
+        return NULL;
     
-    if ( cfg->debug_log != NULL )
+    mipsim_config_defaults(cfg);
+    
+    if ( base != NULL )
     {
-        fclose(cfg->debug_log);
+        cfg->io_mask = base->io_mask;
+        cfg->mon_flush = base->mon_flush;
+        cfg->mon_buffer_size = base->mon_buffer_size;
+        cfg->sandbox_root = base->sandbox_root != NULL ? strdup(base->sandbox_root) : NULL;
+        cfg->async_log_size = base->async_log_size;
+        cfg->max_insns = base->max_insns;
+        cfg->arch = base->arch;
+        cfg->engine = base->engine;
+        cfg->reloc_text = base->reloc_text;
+        cfg->reloc_data = base->reloc_data;
+        cfg->zero_sp = base->zero_sp;
+        cfg->flat_memory = base->flat_memory;
+        cfg->phys_memory_size = base->phys_memory_size;
+        cfg->newlib_stack_size = base->newlib_stack_size;
+        cfg->lazy_fault_around = base->lazy_fault_around;
     }
     
-    return 0;
+    mipsim_config_setup(cfg);
+    
+    return cfg;
+}
+
+/*!
+    \brief Release a configuration created by \ref mipsim_config_create
+*/
+void mipsim_config_destroy(MIPSIM_Config *cfg)
+{
+    if ( cfg == NULL )
+        return;
+    
+    mipsim_config_release(cfg);
+    free(cfg);
 }
@@ -15,29 +15,65 @@
     \file config.h
     \brief Simulator config and CLI parsing
     \author Hugues Bruant
+    
+    Every simulated machine holds a config. The config returned by
+    \ref mipsim_config is the one bound to the calling thread, which is the
+    config built from the command line unless another one was bound with
+    \ref mipsim_config_bind.
 */
 
 #include <stdio.h>
 #include <inttypes.h>
 
+#include "writer.h"
+
+struct _MIPS_Trace_Record;
+
 typedef struct _MIPSIM_Config {
     int io_mask;
     FILE *mon_in;
     FILE *mon_out;
     FILE *trace_log;
+    FILE *trace_bin;
     FILE *debug_log;
     
+    struct _MIPS_Trace_Record *trace_buffer;
+    unsigned int trace_count;
+    
+    int mon_flush;
+    char *mon_buffer;
+    uint32_t mon_buffer_size, mon_buffer_used;
+    
+    char *sandbox_root;
+    
+    uint32_t async_log_size;
+    MIPSIM_Writer *writer;
+    
+    char *batch_file;
+    int batch_threads;
+    
+    int headless;
+    uint64_t max_insns;
+    
     int arch;
+    int engine;
     
     uint32_t reloc_text, reloc_data;
     
     int zero_sp;
+    int flat_memory;
     uint32_t phys_memory_size;
     uint32_t newlib_stack_size;
+    uint32_t lazy_fault_around;
 } MIPSIM_Config;
 
 MIPSIM_Config* mipsim_config();
+MIPSIM_Config* mipsim_config_bind(MIPSIM_Config *cfg);
+
 int mipsim_config_init(int argc, char **argv);
 int mipsim_config_fini();
 
+MIPSIM_Config* mipsim_config_create(const MIPSIM_Config *base);
+void mipsim_config_destroy(MIPSIM_Config *cfg);
+
 #endif
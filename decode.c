@@ -18,7 +18,86 @@
 
 #include "io.h"
 #include "util.h"
+#include "config.h"
 #include "monitor.h"
+#include "mips_p.h"
+#include "trace.h"
+
+/*
+    Instruction handlers access the processor state directly, the
+    MIPS_Processor accessors remain the API of the shell and tools.
+*/
+
+static inline MIPS_Processor_Private* cpu(MIPS *m)
+{
+    return (MIPS_Processor_Private*)m->hw.d;
+}
+
+static inline MIPS_Native get_gpr(MIPS *m, int n)
+{
+    return cpu(m)->r[n];
+}
+
+static inline void set_gpr(MIPS *m, int n, MIPS_Native v)
+{
+    MIPS_Native *r = cpu(m)->r;
+    
+    if ( n )
+    {
+        mipsim_trace("\t%s = 0x%08x\n", mips_reg_name(n), v);
+        
+        if ( mips_trace_on() )
+            mips_trace_reg(n, v);
+    }
+    
+    r[n] = v;
+    
+    // $zero is hardwired
+    r[0] = 0;
+}
+
+int mips_breakpoint_test(MIPS *m, MIPS_Addr val, int type);
+
+static inline int mem_access(MIPS *m, MIPS_Addr a, int type)
+{
+    if ( mips_trace_on() )
+        mips_trace_mem(a, type == BKPT_MEM_W ? TRACE_MEM_W : TRACE_MEM_R);
+    
+    return mips_breakpoint_test(m, a, type);
+}
+
+static inline MIPS_Native get_pc(MIPS *m)
+{
+    return cpu(m)->pc;
+}
+
+static inline void set_pc(MIPS *m, MIPS_Native v)
+{
+    if ( v & 3 )
+        m->hw.signal_exception(&m->hw, MIPS_E_ADDRESS_ERROR);
+    else
+        cpu(m)->pc = v;
+}
+
+static inline MIPS_Native get_hi(MIPS *m)
+{
+    return cpu(m)->hi;
+}
+
+static inline void set_hi(MIPS *m, MIPS_Native v)
+{
+    cpu(m)->hi = v;
+}
+
+static inline MIPS_Native get_lo(MIPS *m)
+{
+    return cpu(m)->lo;
+}
+
+static inline void set_lo(MIPS *m, MIPS_Native v)
+{
+    cpu(m)->lo = v;
+}
 
 int decode_unknown(MIPS *m, uint32_t ir);
 
@@ -467,10 +546,11 @@ int print_reg(char *s, int i, int maxsz, int reg)
 /*!
     \internal
     \brief Simple disassembly for trace mode
+    \param disasm_buffer caller-provided buffer of DISASM_BUFFER_SIZE bytes
+    \return \a disasm_buffer
 */
-const char* mips_disasm(const char *args, MIPS_Addr pc, uint32_t ir)
+const char* mips_disasm(char *disasm_buffer, const char *args, MIPS_Addr pc, uint32_t ir)
 {
-    static char disasm_buffer[DISASM_BUFFER_SIZE];
     memset(disasm_buffer, 0, DISASM_BUFFER_SIZE);
     
     if ( !args )
@@ -546,6 +626,82 @@ const char* mips_disasm(const char *args, MIPS_Addr pc, uint32_t ir)
     return disasm_buffer;
 }
 
+/*!
+    \internal
+    \brief Trace the mnemonic and operands of an instruction
+*/
+static void mips_trace_disasm(const char *mnemonic, const char *args, MIPS_Addr pc, uint32_t ir)
+{
+    char disasm_buffer[DISASM_BUFFER_SIZE];
+    
+    mipsim_printf(IO_TRACE, "%s %s", mnemonic, mips_disasm(disasm_buffer, args, pc, ir));
+}
+
+/*!
+    \brief Trace an instruction
+    \param arch simulated architecture
+    \param pc address of the instruction
+    \param ir instruction word
+    
+    Used by the universal engine before executing an instruction and by
+    mipstrace to render binary traces, so that both give the same text.
+*/
+void mips_trace_instr(int arch, MIPS_Addr pc, uint32_t ir)
+{
+    mipsim_printf(IO_TRACE, "%08x:\t%08x\t", (uint32_t)pc, ir);
+    
+    // operands are relative to the address of the next instruction
+    pc += 4;
+    
+    MIPS_Instr i = opcodes[(ir & OPCODE_MASK) >> OPCODE_SHIFT];
+    const char *unknown = "???\n";
+    
+    if ( i.decode == NULL )
+    {
+        mipsim_printf(IO_TRACE, "%s", unknown);
+        return;
+    }
+    
+    if ( i.mnemonic == NULL && (i.isa & (1 << arch)) )
+    {
+        if ( i.decode == decode_special ) {
+            i = Rinstr[ir & FN_MASK];
+        } else if ( i.decode == decode_special2 ) {
+            i = Rinstr2[ir & FN_MASK];
+        } else if ( i.decode == decode_regimm ) {
+            i = Iinstr[(ir & RT_MASK) >> RT_SHIFT];
+        } else if ( i.decode == decode_cp0 ) {
+            i = cp0[(ir & FMT_MASK) >> FMT_SHIFT];
+            unknown = "cp0 ???\n";
+        } else if ( i.decode == decode_cp1 ) {
+            i = cp1[(ir & FMT_MASK) >> FMT_SHIFT];
+            unknown = "cp1 ???\n";
+        } else if ( i.decode == decode_cp2 ) {
+            mipsim_printf(IO_TRACE, "cop 2\n");
+            return;
+        } else if ( i.decode == decode_cp3 ) {
+            mipsim_printf(IO_TRACE, "cop 3\n");
+            return;
+        }
+        
+        if ( i.decode == NULL )
+        {
+            mipsim_printf(IO_TRACE, "%s", unknown);
+            return;
+        }
+    }
+    
+    if ( !ir )
+        mipsim_printf(IO_TRACE, "nop");
+    else if ( i.mnemonic != NULL )
+        mips_trace_disasm(i.mnemonic, i.args, pc, ir);
+    
+    if ( !(i.isa & (1 << arch)) )
+        mipsim_printf(IO_TRACE, "\t\t[Unsupported in %s]\n", mips_isa_name(arch));
+    else if ( i.mnemonic != NULL )
+        mipsim_printf(IO_TRACE, "\n");
+}
+
 /*!
     \brief Disassemble four bytes of memory
     \param m simulated machine
@@ -566,12 +722,9 @@ char* mips_disassemble(MIPS *m, MIPS_Addr a, symbol_name sym_name, void *sym_dat
     if ( stat == MEM_UNMAPPED )
         return NULL;
     
-    char *s = NULL;
-    int cp = 0;
-    
     if ( stat & MEM_NOEXEC )
     {
-        s = malloc(17 * sizeof(char));
+        char *s = malloc(17 * sizeof(char));
         s[0] = '.';
         s[1] = 'w';
         s[2] = 'o';
@@ -584,121 +737,143 @@ char* mips_disassemble(MIPS *m, MIPS_Addr a, symbol_name sym_name, void *sym_dat
         cat_num(w, 16, s + 8, 8);
         
         s[16] = '\0';
-    } else {
-        MIPS_Instr i = opcodes[(w & OPCODE_MASK) >> OPCODE_SHIFT];
         
-        if ( i.mnemonic == NULL && i.decode != NULL )
-        {
-            if ( i.decode == decode_special )
-                i = Rinstr[w & FN_MASK];
-            else if ( i.decode == decode_special2 )
-                i = Rinstr2[w & FN_MASK];
-            else if ( i.decode == decode_regimm )
-                i = Iinstr[(w & RT_MASK) >> RT_SHIFT];
-            else if ( i.decode == decode_cp0 ) {
-                cp = CP0;
-                i = cp0[(w & FMT_MASK) >> FMT_SHIFT];
-            } else if ( i.decode == decode_cp1 ) {
-                cp = CP1;
-                i = cp1[(w & FMT_MASK) >> FMT_SHIFT];
-                // TODO : extra step for actual functions...
-            } else if ( i.decode == decode_cp2 ) {
-                cp = CP2;
-                i = cp2[(w & FMT_MASK) >> FMT_SHIFT];
-            }
+        return s;
+    }
+    
+    return mips_disassemble_word(a, w, sym_name, sym_data);
+}
+
+/*!
+    \brief Disassemble an instruction word
+    \param a address of the instruction
+    \param w instruction word
+    \param sym_name symbol naming callback
+    \param sym_data symbol naming data (to be fed to callback)
+    \return Mnemonic
+    
+    The caller is responsible for freeing the returned string (if non-NULL)
+*/
+char* mips_disassemble_word(MIPS_Addr a, uint32_t w, symbol_name sym_name, void *sym_data)
+{
+    char *s = NULL;
+    int cp = 0;
+    
+    MIPS_Instr i = opcodes[(w & OPCODE_MASK) >> OPCODE_SHIFT];
+    
+    if ( i.mnemonic == NULL && i.decode != NULL )
+    {
+        if ( i.decode == decode_special )
+            i = Rinstr[w & FN_MASK];
+        else if ( i.decode == decode_special2 )
+            i = Rinstr2[w & FN_MASK];
+        else if ( i.decode == decode_regimm )
+            i = Iinstr[(w & RT_MASK) >> RT_SHIFT];
+        else if ( i.decode == decode_cp0 ) {
+            cp = CP0;
+            i = cp0[(w & FMT_MASK) >> FMT_SHIFT];
+        } else if ( i.decode == decode_cp1 ) {
+            cp = CP1;
+            i = cp1[(w & FMT_MASK) >> FMT_SHIFT];
+            // TODO : extra step for actual functions...
+        } else if ( i.decode == decode_cp2 ) {
+            cp = CP2;
+            i = cp2[(w & FMT_MASK) >> FMT_SHIFT];
         }
+    }
+    
+    if ( i.mnemonic != NULL && i.args != NULL )
+    {
+        const uint8_t sh = (w & SH_MASK) >> SH_SHIFT;
+        const uint8_t rd = (w & RD_MASK) >> RD_SHIFT;
+        const uint8_t rt = (w & RT_MASK) >> RT_SHIFT;
+        const uint8_t rs = (w & RS_MASK) >> RS_SHIFT;
+        const uint16_t imm = (w & IMM_MASK);
+        const uint32_t addr = (w & ADDR_MASK);
+        const uint8_t fd = (w & FD_MASK) >> FD_SHIFT;
+        const uint8_t fs = (w & FS_MASK) >> FS_SHIFT;
+
+        //i.mnemonic, mips_disasm(i.args, pc, ir)
+        int sz = strlen(i.mnemonic), alloc = sz + 2 + 8 * strlen(i.args);
+        s = malloc(alloc * sizeof(char));
         
-        if ( i.mnemonic != NULL && i.args != NULL )
+        strcpy(s, i.mnemonic);
+        s[sz] = '\t';
+        s[++sz] = '\0';
+        
+        const char *args = i.args;
+        
+        while ( *args )
         {
-            const uint8_t sh = (w & SH_MASK) >> SH_SHIFT;
-            const uint8_t rd = (w & RD_MASK) >> RD_SHIFT;
-            const uint8_t rt = (w & RT_MASK) >> RT_SHIFT;
-            const uint8_t rs = (w & RS_MASK) >> RS_SHIFT;
-            const uint16_t imm = (w & IMM_MASK);
-            const uint32_t addr = (w & ADDR_MASK);
-            const uint8_t fd = (w & FD_MASK) >> FD_SHIFT;
-            const uint8_t fs = (w & FS_MASK) >> FS_SHIFT;
-    
-            //i.mnemonic, mips_disasm(i.args, pc, ir)
-            int sz = strlen(i.mnemonic), alloc = sz + 8 * strlen(i.args);
-            s = malloc(alloc * sizeof(char));
-            
-            strcpy(s, i.mnemonic);
-            s[sz] = '\t';
-            s[++sz] = '\0';
+            const char *cn = NULL;
+            char *dn = NULL;
             
-            const char *args = i.args;
-            
-            while ( *args )
+            if ( *args == 's' )
             {
-                const char *cn = NULL;
-                char *dn = NULL;
+                cn = mips_reg_name(rs);
+            } else if ( *args == 't' ) {
+                cn = mips_reg_name(rt);
+            } else if ( *args == 'd' ) {
+                cn = mips_reg_name(rd);
+            } else if ( *args == 'S' ) {
+                cn = mips_reg_name(fs | cp);
+            } else if ( *args == 'T' ) {
+                cn = mips_reg_name(rt | cp);
+            } else if ( *args == 'D' ) {
+                cn = mips_reg_name(fd | cp);
+            } else if ( *args == '<' ) {
+                dn = num_to_str(sh, 10);
+            } else if ( *args == 'i' ) {
+                dn = num_to_str(imm, 16 | C_PREFIX);
+            } else if ( *args == 'p' ) {
+                MIPS_Addr tg = ((int16_t)imm << 2) + (uint32_t)(a + 4);
+                
+                if ( sym_name != NULL )
+                    cn = sym_name(a, tg, sym_data);
+                
+                if ( cn == NULL )
+                    dn = num_to_str(tg, 16 | C_PREFIX);
+            } else if ( *args == 'a' ) {
+                MIPS_Addr tg = ((a + 4) & (-1 << 28)) | (addr << 2);
                 
-                if ( *args == 's' )
+                if ( sym_name != NULL )
+                    cn = sym_name(a, tg, sym_data);
+                
+                if ( cn == NULL )
+                    dn = num_to_str(tg, 16 | C_PREFIX);
+            } else {
+                if ( sz + 1 == alloc )
                 {
-                    cn = mips_reg_name(rs);
-                } else if ( *args == 't' ) {
-                    cn = mips_reg_name(rt);
-                } else if ( *args == 'd' ) {
-                    cn = mips_reg_name(rd);
-                } else if ( *args == 'S' ) {
-                    cn = mips_reg_name(fs | cp);
-                } else if ( *args == 'T' ) {
-                    cn = mips_reg_name(rt | cp);
-                } else if ( *args == 'D' ) {
-                    cn = mips_reg_name(fd | cp);
-                } else if ( *args == '<' ) {
-                    dn = num_to_str(sh, 10);
-                } else if ( *args == 'i' ) {
-                    dn = num_to_str(imm, 16 | C_PREFIX);
-                } else if ( *args == 'p' ) {
-                    MIPS_Addr tg = ((int16_t)imm << 2) + (uint32_t)(a + 4);
-                    
-                    if ( sym_name != NULL )
-                        cn = sym_name(a, tg, sym_data);
-                    
-                    if ( cn == NULL )
-                        dn = num_to_str(tg, 16 | C_PREFIX);
-                } else if ( *args == 'a' ) {
-                    MIPS_Addr tg = ((a + 4) & (-1 << 28)) | (addr << 2);
-                    
-                    if ( sym_name != NULL )
-                        cn = sym_name(a, tg, sym_data);
-                    
-                    if ( cn == NULL )
-                        dn = num_to_str(tg, 16 | C_PREFIX);
-                } else {
-                    if ( sz + 1 == alloc )
-                    {
-                        alloc *= 2;
-                        s = realloc(s, alloc);
-                    }
-                    s[sz++] = *args;
-                    s[sz] = '\0';
+                    alloc *= 2;
+                    s = realloc(s, alloc);
                 }
-                
-                if ( dn != NULL )
+                s[sz++] = *args;
+                s[sz] = '\0';
+            }
+            
+            if ( dn != NULL )
+            {
+                sz += strlen(dn);
+                if ( sz >= alloc )
                 {
-                    sz += strlen(dn);
-                    if ( sz >= alloc )
-                    {
+                    while ( sz >= alloc )
                         alloc *= 2;
-                        s = realloc(s, alloc);
-                    }
-                    strcat(s, dn);
-                    free(dn);
-                } else if ( cn != NULL ) {
-                    sz += strlen(cn);
-                    if ( sz >= alloc )
-                    {
+                    s = realloc(s, alloc);
+                }
+                strcat(s, dn);
+                free(dn);
+            } else if ( cn != NULL ) {
+                sz += strlen(cn);
+                if ( sz >= alloc )
+                {
+                    while ( sz >= alloc )
                         alloc *= 2;
-                        s = realloc(s, alloc);
-                    }
-                    strcat(s, cn);
+                    s = realloc(s, alloc);
                 }
-                
-                ++args;
+                strcat(s, cn);
             }
+            
+            ++args;
         }
     }
     
@@ -712,23 +887,285 @@ char* mips_disassemble(MIPS *m, MIPS_Addr a, symbol_name sym_name, void *sym_dat
 */
 int mips_breakpoint_test(MIPS *m, MIPS_Addr val, int type)
 {
-    BreakpointList *l = m->breakpoints;
+    if ( !(m->breakpoint_types & type) )
+        return MIPS_OK;
+    
+    int id = mips_breakpoint_find(m, val, type);
+    
+    if ( id < 0 )
+        return MIPS_OK;
+    
+    m->breakpoint_hit = id;
+    mips_stop(m, MIPS_BKPT);
+    return MIPS_BKPT;
+}
+
+/*!
+    \brief Predecoded instruction cache
+    
+    Two-level page table of predecoded instruction slots. Pages are only
+    allocated for addresses that were actually executed.
+*/
+struct _MIPS_ICache {
+    int architecture;
+    uint32_t generation;
+    
+    MIPS_Decoded **dir[ICACHE_DIR_SIZE];
+};
+
+/*!
+    \internal
+    \brief Create an empty predecode cache
+*/
+MIPS_ICache* mips_icache_create()
+{
+    return calloc(1, sizeof(MIPS_ICache));
+}
+
+/*!
+    \internal
+    \brief Drop all predecoded instructions
+*/
+void mips_icache_flush(MIPS_ICache *c)
+{
+    if ( c == NULL )
+        return;
+    
+    ++c->generation;
+    
+    for ( int i = 0; i < ICACHE_DIR_SIZE; ++i )
+    {
+        MIPS_Decoded **t = c->dir[i];
+        
+        if ( t == NULL )
+            continue;
+        
+        for ( int j = 0; j < ICACHE_TABLE_SIZE; ++j )
+            free(t[j]);
+        
+        free(t);
+        c->dir[i] = NULL;
+    }
+}
+
+/*!
+    \internal
+    \brief Release all memory used by a predecode cache
+*/
+void mips_icache_destroy(MIPS_ICache *c)
+{
+    mips_icache_flush(c);
+    free(c);
+}
+
+/*!
+    \internal
+    \brief Locate the predecode slot of a (word-aligned) address
+    \param c predecode cache
+    \param a address
+    \param alloc whether to allocate missing pages
+    \return slot, or NULL if the page is not cached and alloc is zero or
+    the page could not be allocated
+*/
+static MIPS_Decoded* mips_icache_slot(MIPS_ICache *c, MIPS_Addr a, int alloc)
+{
+    MIPS_Decoded **t = c->dir[a >> ICACHE_TABLE_SHIFT];
+    
+    if ( t == NULL )
+    {
+        if ( !alloc )
+            return NULL;
+        
+        t = calloc(ICACHE_TABLE_SIZE, sizeof(MIPS_Decoded*));
+        
+        if ( t == NULL )
+            return NULL;
+        
+        c->dir[a >> ICACHE_TABLE_SHIFT] = t;
+    }
+    
+    MIPS_Decoded *p = t[(a >> ICACHE_PAGE_SHIFT) & (ICACHE_TABLE_SIZE - 1)];
+    
+    if ( p == NULL )
+    {
+        if ( !alloc )
+            return NULL;
+        
+        p = calloc(ICACHE_PAGE_WORDS, sizeof(MIPS_Decoded));
+        
+        if ( p == NULL )
+            return NULL;
+        
+        t[(a >> ICACHE_PAGE_SHIFT) & (ICACHE_TABLE_SIZE - 1)] = p;
+    }
+    
+    return p + ((a >> 2) & (ICACHE_PAGE_WORDS - 1));
+}
+
+/*!
+    \internal
+    \brief Drop predecoded instructions if the simulated ISA changed
+*/
+static void mips_icache_check(MIPS *m)
+{
+    if ( m->icache->architecture != m->architecture )
+    {
+        // ISA verdicts depend on the simulated architecture
+        mips_icache_flush(m->icache);
+        m->icache->architecture = m->architecture;
+    }
+}
+
+/*!
+    \internal
+    \brief Access the generation counter of the predecode cache
+    
+    The counter is increased whenever a predecoded instruction is dropped,
+    which lets translation caches built on top of it detect stale code.
+*/
+const uint32_t* mips_icache_generation(MIPS *m)
+{
+    return &m->icache->generation;
+}
+
+/*!
+    \internal
+    \brief Access the predecoded page containing a given address
+    \return first slot of the page, NULL if no instruction of that page was predecoded
+*/
+MIPS_Decoded* mips_icache_page(MIPS *m, MIPS_Addr a)
+{
+    mips_icache_check(m);
+    
+    MIPS_Decoded **t = m->icache->dir[a >> ICACHE_TABLE_SHIFT];
+    
+    return t != NULL ? t[(a >> ICACHE_PAGE_SHIFT) & (ICACHE_TABLE_SIZE - 1)] : NULL;
+}
+
+/*!
+    \internal
+    \brief Invalidate predecoded instructions overlapping a memory store
+    \param c predecode cache
+    \param a address of the store
+    \param n size of the store, in bytes
+*/
+void mips_icache_invalidate(MIPS_ICache *c, MIPS_Addr a, uint32_t n)
+{
+    if ( c == NULL )
+        return;
+    
+    uint32_t words = ((a & 3) + n + 3) >> 2;
     
-    while ( l != NULL )
+    a &= ~3;
+    
+    while ( words )
     {
-        if ( !(l->d.type & BKPT_DISABLED)
-            && ((l->d.type & BKPT_TYPE_MASK) & type)
-            && (l->d.start <= (val & l->d.mask))
-            && (l->d.end   >= (val & l->d.mask))
-            )
+        MIPS_Decoded *d = mips_icache_slot(c, a, 0);
+        
+        if ( d == NULL )
         {
-            m->breakpoint_hit = l->d.id;
-            mips_stop(m, MIPS_BKPT);
-            return MIPS_BKPT;
+            // nothing predecoded in that page : skip to the next one
+            uint32_t left = (ICACHE_PAGE_SIZE - (a & (ICACHE_PAGE_SIZE - 1))) >> 2;
+            
+            if ( left >= words )
+                break;
+            
+            words -= left;
+            a += left << 2;
+            continue;
         }
         
-        l = l->next;
+        /*
+            a translated branch embeds its delay slot : it must be translated
+            again. Any other slot is left alone, a branch before it relying
+            on its translation.
+        */
+        if ( (a & (ICACHE_PAGE_SIZE - 1)) && mips_decoded_op(d - 1, 0) >= OP_BRANCH )
+            d[-1].op = NULL;
+        
+        if ( d->verdict != DECODED_EMPTY )
+            ++c->generation;
+        
+        d->verdict = DECODED_EMPTY;
+        d->op = NULL;
+        
+        a += 4;
+        --words;
     }
+}
+
+/*!
+    \internal
+    \brief Predecode an instruction word
+    
+    Resolves the handler through the opcode tables, skipping the second
+    level dispatchers when they lead to a supported instruction. Encodings
+    the second level cannot resolve keep the dispatcher as handler so that
+    its behavior is preserved.
+*/
+static void mips_predecode(MIPS *m, uint32_t ir, MIPS_Decoded *d)
+{
+    const MIPS_Instr *i = &opcodes[(ir & OPCODE_MASK) >> OPCODE_SHIFT];
+    const MIPS_Instr *n = NULL;
+    
+    d->ir  = ir;
+    d->imm = (int16_t)(ir & IMM_MASK);
+    d->rs  = (ir & RS_MASK) >> RS_SHIFT;
+    d->rt  = (ir & RT_MASK) >> RT_SHIFT;
+    d->rd  = (ir & RD_MASK) >> RD_SHIFT;
+    d->sh  = (ir & SH_MASK) >> SH_SHIFT;
+    
+    d->decode = i->decode;
+    
+    if ( i->decode == NULL )
+    {
+        d->verdict = DECODED_UNKNOWN;
+        return;
+    } else if ( !(i->isa & (1 << m->architecture)) ) {
+        d->verdict = DECODED_UNSUPPORTED;
+        return;
+    }
+    
+    d->verdict = DECODED_OK;
+    
+    if ( i->decode == decode_special )
+        n = &Rinstr[ir & FN_MASK];
+    else if ( i->decode == decode_special2 )
+        n = &Rinstr2[ir & FN_MASK];
+    else if ( i->decode == decode_regimm )
+        n = &Iinstr[d->rt];
+    else if ( i->decode == decode_cp0 )
+        n = &cp0[(ir & FMT_MASK) >> FMT_SHIFT];
+    else if ( i->decode == decode_cp1 )
+        n = &cp1[(ir & FMT_MASK) >> FMT_SHIFT];
+    
+    if ( n != NULL && n->decode != NULL && (n->isa & (1 << m->architecture)) )
+        d->decode = n->decode;
+}
+
+/*!
+    \internal
+    \brief Breakpoint tests performed after each instruction
+    \param pc address following the instruction
+    \param ir instruction word
+*/
+static int mips_decode_breakpoints(MIPS *m, MIPS_Addr pc, uint32_t ir)
+{
+    // pages and primary opcodes not covered by any breakpoint are filtered
+    // out here, the prefilters are NULL / full until the index is rebuilt
+    const uint32_t *pages = m->breakpoint_pages;
+    
+    // "standard" breakpoints : mem execute
+    // simulation interrupted BEFORE instruction executed
+    if ( (pages == NULL || ((pages[pc >> (BKPT_PAGE_SHIFT + 5)] >> ((pc >> BKPT_PAGE_SHIFT) & 31)) & 1))
+        && mips_breakpoint_test(m, pc, BKPT_MEM_X) )
+        return MIPS_BKPT;
+    
+    // exotic breakpoints : opcode
+    // simulation interrupted AFTER instruction executed
+    if ( ((m->breakpoint_opcodes >> (ir >> 26)) & 1)
+        && mips_breakpoint_test(m, ir, BKPT_OPCODE) )
+        return MIPS_BKPT;
     
     return MIPS_OK;
 }
@@ -737,13 +1174,20 @@ int mips_breakpoint_test(MIPS *m, MIPS_Addr val, int type)
     \internal
     \brief core of instr decode/execution
     \param m simulated machine
+    \param ir_out if not NULL, receives the instruction word
     \return stop reason
     
     Fetch the instruction at PC, increase PC and execute the instruction
+    
+    Instructions are predecoded the first time they are fetched. Later
+    executions skip fetch and table lookups unless tracing is enabled.
+    
+    Breakpoint tests of branches are deferred until their delay slot has
+    been executed (see mips_universal_decode).
 */
-int mips_universal_decode(MIPS *m)
+static int mips_decode_instr(MIPS *m, uint32_t *ir_out)
 {
-    MIPS_Native pc = m->hw.get_pc(&m->hw);
+    MIPS_Native pc = get_pc(m);
     
     if ( pc & 3 )
     {
@@ -752,68 +1196,125 @@ int mips_universal_decode(MIPS *m)
         return MIPS_EXCEPTION;
     }
     
-    int stat;
-    uint32_t ir = m->hw.fetch(&m->hw, &stat);
+    mips_icache_check(m);
     
-    if ( stat == MEM_FWMON )
-        return MIPS_OK;
+    uint32_t ir;
+    int ret = MIPS_OK;
+    MIPS_Decoded *d = mips_icache_slot(m->icache, pc, 0);
     
-    if ( stat & MEM_UNMAPPED )
+    if ( d != NULL && d->verdict != DECODED_EMPTY && !mipsim_tracing() )
     {
-        mipsim_printf(IO_TRACE, "Segfault : PC out of mapped memory\n");
-        mips_stop(m, MIPS_ERROR);
-        return MIPS_ERROR;
-    } else  if ( stat & MEM_NOEXEC ) {
-        mipsim_printf(IO_TRACE, "Segfault : PC out of executable memory\n");
-        mips_stop(m, MIPS_ERROR);
-        return MIPS_ERROR;
+        ir = d->ir;
+        
+        if ( mips_trace_on() )
+            mips_trace_insn(pc, ir);
+        
+        pc += 4;
+        set_pc(m, pc);
+        
+        if ( d->verdict == DECODED_OK )
+            ret = d->decode(m, ir);
+        
+    } else {
+        int stat;
+        ir = m->hw.fetch(&m->hw, &stat);
+        
+        if ( stat == MEM_FWMON )
+            return MIPS_OK;
+        
+        if ( stat & MEM_UNMAPPED )
+        {
+            mips_trace_note("Segfault : PC out of mapped memory\n");
+            mips_stop(m, MIPS_ERROR);
+            return MIPS_ERROR;
+        } else  if ( stat & MEM_NOEXEC ) {
+            mips_trace_note("Segfault : PC out of executable memory\n");
+            mips_stop(m, MIPS_ERROR);
+            return MIPS_ERROR;
+        }
+        
+        // out of memory : the instruction is simply decoded again next time
+        MIPS_Decoded *slot = mips_icache_slot(m->icache, pc, 1);
+        
+        if ( slot != NULL )
+            mips_predecode(m, ir, slot);
+        
+        // TODO check for OPCODE breakpoints here
+        
+        if ( mips_trace_on() )
+            mips_trace_insn(pc, ir);
+        
+        if ( mipsim_tracing() )
+            mips_trace_instr(m->architecture, pc, ir);
+        
+        pc += 4;
+        set_pc(m, pc);
+        
+        const uint32_t op = (ir & OPCODE_MASK) >> OPCODE_SHIFT;
+        
+        MIPS_Instr i = opcodes[op];
+        
+        // TODO error handling for unknown and unsupported instructions...
+        if ( i.decode != NULL && (i.isa & (1 << m->architecture)) )
+            ret = i.decode(m, ir);
     }
     
-    // TODO check for OPCODE breakpoints here
+    if ( ir_out != NULL )
+        *ir_out = ir;
     
-    mipsim_printf(IO_TRACE, "%08x:\t%08x\t", (uint32_t)pc, ir);
+    // breakpoint hit test at the end, mostly to avoid complications related to delay slots
+    if ( ret == MIPS_OK && !((MIPS_Processor_Private*)m->hw.d)->branch_pending )
+        return mips_decode_breakpoints(m, pc, ir);
     
-    pc += 4;
-    m->hw.set_pc(&m->hw, pc);
+    return ret;
+}
+
+/*!
+    \internal
+    \brief Execution engine executing one instruction per call
+    \param m simulated machine
+    \return stop reason
     
-    int ret = MIPS_OK;
-    const uint32_t op = (ir & OPCODE_MASK) >> OPCODE_SHIFT;
+    A branch and its delay slot are executed as a single instruction :
+    branch handlers only record their target, which is applied once the
+    delay slot has been executed.
+*/
+int mips_universal_decode(MIPS *m)
+{
+    MIPS_Processor_Private *p = (MIPS_Processor_Private*)m->hw.d;
     
-    MIPS_Instr i = opcodes[op];
+    const MIPS_Addr pc = p->pc;
     
-    if ( i.decode != NULL )
+    uint32_t ir = 0;
+    int ret = mips_decode_instr(m, &ir);
+    
+    if ( p->branch_pending )
     {
-        if ( i.mnemonic != NULL )
-            mipsim_printf(IO_TRACE, "%s %s", i.mnemonic, mips_disasm(i.args, pc, ir));
+        const MIPS_Addr target = p->branch_target;
+        
+        p->branch_pending = 0;
+        
+        // execute delay slot
+        ret = mips_decode_instr(m, NULL);
         
-        if ( i.isa & (1 << m->architecture) )
+        if ( p->branch_pending || p->pc != pc + 8 )
         {
-            if ( i.mnemonic != NULL ) mipsim_printf(IO_TRACE, "\n");
+            p->branch_pending = 0;
             
-            ret = i.decode(m, ir);
-        } else {
-            mipsim_printf(IO_TRACE, "\t\t[Unsupported in %s]\n", mips_isa_name(m->architecture));
+            mipsim_printf(IO_WARNING, "Warning : delay slot must not alter the PC [0x%08x]\n", pc + 4);
+            
+            mips_stop(m, MIPS_UNPREDICTABLE);
+            ret = -1;
+        } else if ( ret == MIPS_OK || ret == MIPS_BKPT ) {
+            p->pc = target;
             
-            // error handling...
+            if ( ret == MIPS_OK )
+                ret = mips_decode_breakpoints(m, pc + 4, ir);
         }
-    } else {
-        // error handling...
-        mipsim_printf(IO_TRACE, "???\n");
     }
     
-    // breakpoint hit test at the end, mostly to avoid complications related to delay slots
-    if ( ret == MIPS_OK )
-    {
-        // "standard" breakpoints : mem execute
-        // simulation interrupted BEFORE instruction executed
-        if ( mips_breakpoint_test(m, pc, BKPT_MEM_X) )
-            return MIPS_BKPT;
-        
-        // exotic breakpoints : opcode
-        // simulation interrupted AFTER instruction executed
-        if ( mips_breakpoint_test(m, ir, BKPT_OPCODE) )
-            return MIPS_BKPT;
-    }
+    if ( m->budget )
+        --m->budget;
     
     return ret;
 }
@@ -826,209 +1327,137 @@ int decode_unknown(MIPS *m, uint32_t ir)
     return MIPS_UNSUPPORTED;
 }
 
-int delay_slot(MIPS *m)
+/*!
+    \internal
+    \brief Record the target of a branch, taken after its delay slot
+*/
+static int mips_branch(MIPS *m, MIPS_Addr target)
 {
-    const MIPS_Native pc = m->hw.get_pc(&m->hw) + 4;
-    
-    // execute delay slot
-    int ret = mips_universal_decode(m);
+    MIPS_Processor_Private *p = (MIPS_Processor_Private*)m->hw.d;
     
-    if ( m->hw.get_pc(&m->hw) != pc )
-    {
-        mipsim_printf(IO_WARNING, "Warning : delay slot must not alter the PC [0x%08lx]\n", pc - 4);
-        
-        mips_stop(m, MIPS_UNPREDICTABLE);
-        return -1;
-    }
+    p->branch_target = target;
+    p->branch_pending = 1;
     
-    return ret;
+    return MIPS_OK;
 }
 
 int decode_special (MIPS *m, uint32_t ir)
 {
     MIPS_Instr i = Rinstr[(ir & FN_MASK)];
     
-    if ( i.decode )
-    {
-        if ( !ir )
-            mipsim_printf(IO_TRACE, "nop");
-        else if ( i.mnemonic != NULL )
-            mipsim_printf(IO_TRACE, "%s %s", i.mnemonic, mips_disasm(i.args, m->hw.get_pc(&m->hw), ir));
-        
-        if ( i.isa & (1 << m->architecture) )
-        {
-            if ( i.mnemonic != NULL ) mipsim_printf(IO_TRACE, "\n");
-            return i.decode(m, ir);
-        } else {
-            mipsim_printf(IO_TRACE, "\t\t[Unsupported in %s]\n", mips_isa_name(m->architecture));
-            return 1;
-        }
-    } else {
-        mipsim_printf(IO_TRACE, "???\n");
-    }
+    if ( i.decode == NULL )
+        return MIPS_OK;
     
-    return MIPS_OK;
+    if ( !(i.isa & (1 << m->architecture)) )
+        return 1;
+    
+    return i.decode(m, ir);
 }
 
 int decode_special2(MIPS *m, uint32_t ir)
 {
     MIPS_Instr i = Rinstr2[(ir & FN_MASK)];
     
-    if ( i.decode )
-    {
-        if ( i.mnemonic != NULL )
-            mipsim_printf(IO_TRACE, "%s %s", i.mnemonic, mips_disasm(i.args, m->hw.get_pc(&m->hw), ir));
-        
-        if ( i.isa & (1 << m->architecture) )
-        {
-            if ( i.mnemonic != NULL ) mipsim_printf(IO_TRACE, "\n");
-            return i.decode(m, ir);
-        } else {
-            mipsim_printf(IO_TRACE, "\t\t[Unsupported in %s]\n", mips_isa_name(m->architecture));
-            return 1;
-        }
-    } else {
-        mipsim_printf(IO_TRACE, "???\n");
-    }
+    if ( i.decode == NULL )
+        return MIPS_OK;
     
-    return MIPS_OK;
+    if ( !(i.isa & (1 << m->architecture)) )
+        return 1;
+    
+    return i.decode(m, ir);
 }
 
 int decode_j       (MIPS *m, uint32_t ir)
 {
-    // delay slot
-    int ret = delay_slot(m);
-    MIPS_Native pc = m->hw.get_pc(&m->hw);
+    MIPS_Native pc = get_pc(m) + 4;
     
-    if ( ret == MIPS_OK || ret == MIPS_BKPT )
-    {
-        // link
-        if ( ir & 0x04000000 )
-            m->hw.set_reg(&m->hw, 31, pc);
-        
-        // jump
-        m->hw.set_pc(&m->hw, (pc & (-1 << 28)) | ((ir & ADDR_MASK) << 2));
-    }
+    // link
+    if ( ir & 0x04000000 )
+        set_gpr(m, 31, pc);
     
-    return ret;
+    // jump
+    return mips_branch(m, (pc & (-1 << 28)) | ((ir & ADDR_MASK) << 2));
 }
 
 int decode_regimm  (MIPS *m, uint32_t ir)
 {
     MIPS_Instr i = Iinstr[(ir & RT_MASK) >> RT_SHIFT];
     
-    if ( i.decode )
-    {
-        if ( i.mnemonic != NULL )
-            mipsim_printf(IO_TRACE, "%s %s", i.mnemonic, mips_disasm(i.args, m->hw.get_pc(&m->hw), ir));
-        
-        if ( i.isa & (1 << m->architecture) )
-        {
-            if ( i.mnemonic != NULL ) mipsim_printf(IO_TRACE, "\n");
-            return i.decode(m, ir);
-        } else {
-            mipsim_printf(IO_TRACE, "\t\t[Unsupported in %s]\n", mips_isa_name(m->architecture));
-            return 1;
-        }
-    } else {
-        mipsim_printf(IO_TRACE, "???\n");
-    }
+    if ( i.decode == NULL )
+        return MIPS_OK;
     
-    return MIPS_OK;
+    if ( !(i.isa & (1 << m->architecture)) )
+        return 1;
+    
+    return i.decode(m, ir);
 }
 
 int decode_beq     (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    MIPS_Native rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    MIPS_Native rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    MIPS_Native rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
-    int ret = MIPS_OK;
+    MIPS_Native pc = get_pc(m);
     int cond = (rs == rt ? 0x04000000 : 0) ^ (ir & 0x04000000);
     
-    // delay slot
-    if ( !(ir & 0x40000000) || cond )
+    // likely branches nullify the delay slot when not taken
+    if ( (ir & 0x40000000) && !cond )
     {
-        ret = delay_slot(m);
-        
-        if ( !(ret == MIPS_OK || ret == MIPS_BKPT) )
-            return ret;
-        
-    } else {
-         m->hw.set_pc(&m->hw, m->hw.get_pc(&m->hw) + 4);
+        set_pc(m, pc + 4);
+        return MIPS_OK;
     }
     
-    // jump if condition verified
-    if ( cond )
-        m->hw.set_pc(&m->hw, m->hw.get_pc(&m->hw) + (((int16_t)(ir & IMM_MASK)) << 2) - 4);
-    
-    return ret;
+    // jump if condition verified, after delay slot
+    return mips_branch(m, cond ? pc + (((int16_t)(ir & IMM_MASK)) << 2) : pc + 4);
 }
 
 int decode_blez     (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
+    MIPS_Native rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
     
-    int ret = MIPS_OK;
+    MIPS_Native pc = get_pc(m);
     int cond = (rs <= 0 ? 0x04000000 : 0) ^ (ir & 0x04000000);
     
-    // delay slot
-    if ( !(ir & 0x40000000) || cond )
+    // likely branches nullify the delay slot when not taken
+    if ( (ir & 0x40000000) && !cond )
     {
-        ret = delay_slot(m);
-        
-        if ( !(ret == MIPS_OK || ret == MIPS_BKPT) )
-            return ret;
-        
-    } else {
-         m->hw.set_pc(&m->hw, m->hw.get_pc(&m->hw) + 4);
+        set_pc(m, pc + 4);
+        return MIPS_OK;
     }
     
-    // jump if condition verified
-    if ( cond )
-        m->hw.set_pc(&m->hw, m->hw.get_pc(&m->hw) + (((int16_t)(ir & IMM_MASK)) << 2) - 4);
-    
-    return ret;
+    // jump if condition verified, after delay slot
+    return mips_branch(m, cond ? pc + (((int16_t)(ir & IMM_MASK)) << 2) : pc + 4);
 }
 
 int decode_bltz     (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
+    MIPS_Native rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
     
-    int ret = MIPS_OK;
+    MIPS_Native pc = get_pc(m);
     int cond = (rs < 0 ? 0x00010000 : 0) ^ (ir & 0x00010000);
     
-    // delay slot
-    if ( !(ir & 0x00020000) || cond )
+    // likely branches nullify the delay slot when not taken
+    if ( (ir & 0x00020000) && !cond )
     {
-        ret = delay_slot(m);
-        
-        if ( !(ret == MIPS_OK || ret == MIPS_BKPT) )
-            return ret;
-        
-    } else {
-         m->hw.set_pc(&m->hw, m->hw.get_pc(&m->hw) + 4);
+        set_pc(m, pc + 4);
+        return MIPS_OK;
     }
     
-    // jump if condition verified
-    if ( cond )
-    {
-        MIPS_Native pc = m->hw.get_pc(&m->hw);
-        
-        // link
-        if ( ir & 0x00100000 )
-            m->hw.set_reg(&m->hw, 31, pc);
-        
-        // jump
-        m->hw.set_pc(&m->hw, pc + (((int16_t)(ir & IMM_MASK)) << 2) - 4);
-    }
+    if ( !cond )
+        return mips_branch(m, pc + 4);
     
-    return ret;
+    // link
+    if ( ir & 0x00100000 )
+        set_gpr(m, 31, pc + 4);
+    
+    // jump after delay slot
+    return mips_branch(m, pc + (((int16_t)(ir & IMM_MASK)) << 2));
 }
 
 int decode_shift   (MIPS *m, uint32_t ir)
 {
-    int32_t rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
-    int sa = ir & 4 ? (m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT) & 0x1F) : (ir & SH_MASK) >> SH_SHIFT;
+    int32_t rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
+    int sa = ir & 4 ? (get_gpr(m, (ir & RS_MASK) >> RS_SHIFT) & 0x1F) : (ir & SH_MASK) >> SH_SHIFT;
     
     if ( ir & 2 )
         if ( ir & 1 )
@@ -1038,42 +1467,36 @@ int decode_shift   (MIPS *m, uint32_t ir)
     else
         rt <<= sa;
     
-    m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, rt);
+    set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, rt);
     
     return MIPS_OK;
 }
 
 int decode_jr      (MIPS *m, uint32_t ir)
 {
-    // delay slot
-    int ret = delay_slot(m);
+    MIPS_Native target = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT) & (-1 << 2);
     
-    if ( ret == MIPS_OK || ret == MIPS_BKPT )
-    {
-        // link
-        if ( ir & 0x00000001 )
-            m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, m->hw.get_pc(&m->hw));
-        
-        // jump
-        m->hw.set_pc(&m->hw, m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT) & (-1 << 2));
-    }
+    // link
+    if ( ir & 0x00000001 )
+        set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, get_pc(m) + 4);
     
-    return ret;
+    // jump after delay slot
+    return mips_branch(m, target);
 }
 
 int decode_movhilo (MIPS *m, uint32_t ir)
 {
     if ( ir & 0x00000001 )
     {
-        MIPS_Native v = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
+        MIPS_Native v = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
         
         if ( ir & 2 )
-            m->hw.set_lo(&m->hw, v);
+            set_lo(m, v);
         else
-            m->hw.set_hi(&m->hw, v);
+            set_hi(m, v);
         
     } else {
-        m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, ir & 0x00000002 ? m->hw.get_lo(&m->hw) : m->hw.get_hi(&m->hw));
+        set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, ir & 0x00000002 ? get_lo(m) : get_hi(m));
     }
     
     return MIPS_OK;
@@ -1081,8 +1504,8 @@ int decode_movhilo (MIPS *m, uint32_t ir)
 
 int decode_add     (MIPS *m, uint32_t ir)
 {
-    int32_t rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    int32_t rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    int32_t rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    int32_t rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     int32_t sum = rs + rt;
     
     int overflow = (((rs >> 31) & 1) + ((rt >> 31) & 1) + (((rs >> 31) ^ (rt >> 31) ^ (sum >> 31)) & 1)) >> 1;
@@ -1095,15 +1518,15 @@ int decode_add     (MIPS *m, uint32_t ir)
         return MIPS_EXCEPTION;
     }
     
-    m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, sum);
+    set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, sum);
     
     return MIPS_OK;
 }
 
 int decode_sub     (MIPS *m, uint32_t ir)
 {
-    int32_t rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    int32_t rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    int32_t rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    int32_t rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     int32_t diff = rs - rt;
     
     int overflow = (((rs >> 31) & 1) - ((rt >> 31) & 1) - (((rs >> 31) ^ (rt >> 31) ^ (diff >> 31)) & 1)) >> 31;
@@ -1116,41 +1539,41 @@ int decode_sub     (MIPS *m, uint32_t ir)
         return MIPS_EXCEPTION;
     }
     
-    m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, diff);
+    set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, diff);
     
     return MIPS_OK;
 }
 
 int decode_mult    (MIPS *m, uint32_t ir)
 {
-    int32_t rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    int32_t rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    int32_t rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    int32_t rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
     int64_t res = rs * rt;
     
-    m->hw.set_hi(&m->hw, res >> 32);
-    m->hw.set_lo(&m->hw, res & 0x00000000FFFFFFFFL);
+    set_hi(m, res >> 32);
+    set_lo(m, res & 0x00000000FFFFFFFFL);
     
     return MIPS_OK;
 }
 
 int decode_multu   (MIPS *m, uint32_t ir)
 {
-    int32_t rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    int32_t rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    int32_t rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    int32_t rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
     uint64_t res = s32_to_u32(rs) * s32_to_u32(rt);
     
-    m->hw.set_hi(&m->hw, res >> 32);
-    m->hw.set_lo(&m->hw, res & 0x00000000FFFFFFFFL);
+    set_hi(m, res >> 32);
+    set_lo(m, res & 0x00000000FFFFFFFFL);
     
     return MIPS_OK;
 }
 
 int decode_div     (MIPS *m, uint32_t ir)
 {
-    int32_t rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    int32_t rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    int32_t rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    int32_t rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
     if ( rt == 0 )
     {
@@ -1158,8 +1581,8 @@ int decode_div     (MIPS *m, uint32_t ir)
         mips_stop(m, MIPS_EXCEPTION);
         return MIPS_EXCEPTION;
     } else {
-        m->hw.set_lo(&m->hw, rs / rt);
-        m->hw.set_hi(&m->hw, rs % rt);
+        set_lo(m, rs / rt);
+        set_hi(m, rs % rt);
     }
     
     return MIPS_OK;
@@ -1167,8 +1590,8 @@ int decode_div     (MIPS *m, uint32_t ir)
 
 int decode_divu    (MIPS *m, uint32_t ir)
 {
-    int32_t rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    int32_t rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    int32_t rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    int32_t rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
     if ( rt == 0 )
     {
@@ -1176,8 +1599,8 @@ int decode_divu    (MIPS *m, uint32_t ir)
         mips_stop(m, MIPS_EXCEPTION);
         return MIPS_EXCEPTION;
     } else {
-        m->hw.set_lo(&m->hw, s32_to_u32(rs) / s32_to_u32(rt));
-        m->hw.set_hi(&m->hw, s32_to_u32(rs) % s32_to_u32(rt));
+        set_lo(m, s32_to_u32(rs) / s32_to_u32(rt));
+        set_hi(m, s32_to_u32(rs) % s32_to_u32(rt));
     }
     
     return MIPS_OK;
@@ -1185,77 +1608,77 @@ int decode_divu    (MIPS *m, uint32_t ir)
 
 int decode_and     (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    MIPS_Native rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    MIPS_Native rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    MIPS_Native rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
-    m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, rs & rt);
+    set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, rs & rt);
     
     return MIPS_OK;
 }
 
 int decode_or      (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    MIPS_Native rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    MIPS_Native rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    MIPS_Native rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
-    m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, rs | rt);
+    set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, rs | rt);
     
     return MIPS_OK;
 }
 
 int decode_xor     (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    MIPS_Native rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    MIPS_Native rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    MIPS_Native rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
-    m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, rs ^ rt);
+    set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, rs ^ rt);
     
     return MIPS_OK;
 }
 
 int decode_nor     (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    MIPS_Native rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    MIPS_Native rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    MIPS_Native rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
-    m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, ~(rs | rt));
+    set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, ~(rs | rt));
 
     return MIPS_OK;
 }
 
 int decode_slt     (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    MIPS_Native rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    MIPS_Native rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    MIPS_Native rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
-    m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, (rs < rt) ? 1 : 0);
+    set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, (rs < rt) ? 1 : 0);
     
     return MIPS_OK;
 }
 
 int decode_sltu    (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    MIPS_Native rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    MIPS_Native rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    MIPS_Native rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
-    m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, (s32_to_u32(rs) < s32_to_u32(rt)) ? 1 : 0);
+    set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, (s32_to_u32(rs) < s32_to_u32(rt)) ? 1 : 0);
     
     return MIPS_OK;
 }
 
 int decode_movcond (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    MIPS_Native rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
     if ( (rt && !(ir & 1)) || (!rt && (ir & 1)) )
-        m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT));
+        set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, get_gpr(m, (ir & RS_MASK) >> RS_SHIFT));
     
     return MIPS_OK;
 }
 
 int decode_addi    (MIPS *m, uint32_t ir)
 {
-    int32_t rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
+    int32_t rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
     int32_t rt = (int16_t)(ir & IMM_MASK);
     int32_t sum = rs + rt;
     
@@ -1268,74 +1691,74 @@ int decode_addi    (MIPS *m, uint32_t ir)
         return MIPS_EXCEPTION;
     }
     
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, sum);
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, sum);
     
     return MIPS_OK;
 }
 
 int decode_slti    (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
+    MIPS_Native rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
     MIPS_Native rt = (int16_t)(ir & IMM_MASK);
     
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, (rs < rt) ? 1 : 0);
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, (rs < rt) ? 1 : 0);
     
     return MIPS_OK;
 }
 
 int decode_sltiu   (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
+    MIPS_Native rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
     MIPS_Native rt = (int16_t)(ir & IMM_MASK);
     
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, (s32_to_u32(rs) < s32_to_u32(rt)) ? 1 : 0);
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, (s32_to_u32(rs) < s32_to_u32(rt)) ? 1 : 0);
     
     return MIPS_OK;
 }
 
 int decode_andi    (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
+    MIPS_Native rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
     MIPS_Native rt = (ir & IMM_MASK);
     
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, rs & rt);
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, rs & rt);
     
     return MIPS_OK;
 }
 
 int decode_ori     (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
+    MIPS_Native rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
     MIPS_Native rt = (ir & IMM_MASK);
     
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, rs | rt);
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, rs | rt);
     
     return MIPS_OK;
 }
 
 int decode_xori    (MIPS *m, uint32_t ir)
 {
-    MIPS_Native rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
+    MIPS_Native rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
     MIPS_Native rt = (ir & IMM_MASK);
     
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, rs ^ rt);
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, rs ^ rt);
     
     return MIPS_OK;
 }
 
 int decode_lui     (MIPS *m, uint32_t ir)
 {
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, ((int16_t)(ir & IMM_MASK)) << 16);
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, ((int16_t)(ir & IMM_MASK)) << 16);
     return MIPS_OK;
 }
 
 int decode_lb      (MIPS *m, uint32_t ir)
 {
-    MIPS_Addr a = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
+    MIPS_Addr a = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
     
     int stat;
     
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, (int8_t)mips_read_b(m, a, &stat));
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, (int8_t)mips_read_b(m, a, &stat));
     
     if ( stat == MEM_UNMAPPED )
     {
@@ -1344,7 +1767,7 @@ int decode_lb      (MIPS *m, uint32_t ir)
         return MIPS_ERROR;
     }
     
-    if ( mips_breakpoint_test(m, a, BKPT_MEM_R) )
+    if ( mem_access(m, a, BKPT_MEM_R) )
         return MIPS_BKPT;
     
     return MIPS_OK;
@@ -1352,11 +1775,11 @@ int decode_lb      (MIPS *m, uint32_t ir)
 
 int decode_lbu     (MIPS *m, uint32_t ir)
 {
-    MIPS_Addr a = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
+    MIPS_Addr a = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
     
     int stat;
     
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, mips_read_b(m, a, &stat));
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, mips_read_b(m, a, &stat));
     
     if ( stat == MEM_UNMAPPED )
     {
@@ -1365,7 +1788,7 @@ int decode_lbu     (MIPS *m, uint32_t ir)
         return MIPS_ERROR;
     }
     
-    if ( mips_breakpoint_test(m, a, BKPT_MEM_R) )
+    if ( mem_access(m, a, BKPT_MEM_R) )
         return MIPS_BKPT;
     
     return MIPS_OK;
@@ -1373,7 +1796,7 @@ int decode_lbu     (MIPS *m, uint32_t ir)
 
 int decode_lh      (MIPS *m, uint32_t ir)
 {
-    MIPS_Addr a = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
+    MIPS_Addr a = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
     
     if ( a & 1 )
     {
@@ -1383,7 +1806,7 @@ int decode_lh      (MIPS *m, uint32_t ir)
     
     int stat;
     
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, (int16_t)mips_read_h(m, a, &stat));
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, (int16_t)mips_read_h(m, a, &stat));
     
     if ( stat == MEM_UNMAPPED )
     {
@@ -1392,7 +1815,7 @@ int decode_lh      (MIPS *m, uint32_t ir)
         return MIPS_ERROR;
     }
     
-    if ( mips_breakpoint_test(m, a, BKPT_MEM_R) )
+    if ( mem_access(m, a, BKPT_MEM_R) )
         return MIPS_BKPT;
     
     return MIPS_OK;
@@ -1400,7 +1823,7 @@ int decode_lh      (MIPS *m, uint32_t ir)
 
 int decode_lhu     (MIPS *m, uint32_t ir)
 {
-    MIPS_Addr a = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
+    MIPS_Addr a = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
     
     if ( a & 1 )
     {
@@ -1410,7 +1833,7 @@ int decode_lhu     (MIPS *m, uint32_t ir)
     
     int stat;
     
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, mips_read_h(m, a, &stat));
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, mips_read_h(m, a, &stat));
     
     if ( stat == MEM_UNMAPPED )
     {
@@ -1419,7 +1842,7 @@ int decode_lhu     (MIPS *m, uint32_t ir)
         return MIPS_ERROR;
     }
     
-    if ( mips_breakpoint_test(m, a, BKPT_MEM_R) )
+    if ( mem_access(m, a, BKPT_MEM_R) )
         return MIPS_BKPT;
     
     return MIPS_OK;
@@ -1427,7 +1850,7 @@ int decode_lhu     (MIPS *m, uint32_t ir)
 
 int decode_lw      (MIPS *m, uint32_t ir)
 {
-    MIPS_Addr a = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
+    MIPS_Addr a = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
     
     if ( a & 3 )
     {
@@ -1437,7 +1860,7 @@ int decode_lw      (MIPS *m, uint32_t ir)
     
     int stat;
     
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, (int32_t)mips_read_w(m, a, &stat));
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, (int32_t)mips_read_w(m, a, &stat));
     
     if ( stat == MEM_UNMAPPED )
     {
@@ -1446,7 +1869,7 @@ int decode_lw      (MIPS *m, uint32_t ir)
         return MIPS_ERROR;
     }
     
-    if ( mips_breakpoint_test(m, a, BKPT_MEM_R) )
+    if ( mem_access(m, a, BKPT_MEM_R) )
         return MIPS_BKPT;
     
     return MIPS_OK;
@@ -1454,7 +1877,7 @@ int decode_lw      (MIPS *m, uint32_t ir)
 
 int decode_lwu     (MIPS *m, uint32_t ir)
 {
-    MIPS_Addr a = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
+    MIPS_Addr a = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
     
     if ( a & 3 )
     {
@@ -1464,7 +1887,7 @@ int decode_lwu     (MIPS *m, uint32_t ir)
     
     int stat;
     
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, mips_read_w(m, a, &stat));
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, mips_read_w(m, a, &stat));
     
     if ( stat == MEM_UNMAPPED )
     {
@@ -1473,7 +1896,7 @@ int decode_lwu     (MIPS *m, uint32_t ir)
         return MIPS_ERROR;
     }
     
-    if ( mips_breakpoint_test(m, a, BKPT_MEM_R) )
+    if ( mem_access(m, a, BKPT_MEM_R) )
         return MIPS_BKPT;
     
     return MIPS_OK;
@@ -1519,10 +1942,10 @@ int decode_ldr     (MIPS *m, uint32_t ir)
 
 int decode_sb      (MIPS *m, uint32_t ir)
 {
-    MIPS_Addr a = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
+    MIPS_Addr a = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
     
     int stat;
-    mips_write_b(m, a, m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT) & 0xFF, &stat);
+    mips_write_b(m, a, get_gpr(m, (ir & RT_MASK) >> RT_SHIFT) & 0xFF, &stat);
     
     if ( stat == MEM_UNMAPPED )
     {
@@ -1538,7 +1961,7 @@ int decode_sb      (MIPS *m, uint32_t ir)
         return MIPS_EXCEPTION;
     }
     
-    if ( mips_breakpoint_test(m, a, BKPT_MEM_W) )
+    if ( mem_access(m, a, BKPT_MEM_W) )
         return MIPS_BKPT;
     
     return MIPS_OK;
@@ -1546,7 +1969,7 @@ int decode_sb      (MIPS *m, uint32_t ir)
 
 int decode_sh      (MIPS *m, uint32_t ir)
 {
-    MIPS_Addr a = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
+    MIPS_Addr a = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
     
     if ( a & 1 )
     {
@@ -1555,7 +1978,7 @@ int decode_sh      (MIPS *m, uint32_t ir)
     }
     
     int stat;
-    mips_write_h(m, a, m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT) & 0xFFFF, &stat);
+    mips_write_h(m, a, get_gpr(m, (ir & RT_MASK) >> RT_SHIFT) & 0xFFFF, &stat);
     
     if ( stat == MEM_UNMAPPED )
     {
@@ -1571,7 +1994,7 @@ int decode_sh      (MIPS *m, uint32_t ir)
         return MIPS_EXCEPTION;
     }
     
-    if ( mips_breakpoint_test(m, a, BKPT_MEM_W) )
+    if ( mem_access(m, a, BKPT_MEM_W) )
         return MIPS_BKPT;
     
     return MIPS_OK;
@@ -1579,7 +2002,7 @@ int decode_sh      (MIPS *m, uint32_t ir)
 
 int decode_sw      (MIPS *m, uint32_t ir)
 {
-    MIPS_Addr a = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
+    MIPS_Addr a = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
     
     if ( a & 3 )
     {
@@ -1588,7 +2011,7 @@ int decode_sw      (MIPS *m, uint32_t ir)
     }
     
     int stat;
-    mips_write_w(m, a, m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT) & 0xFFFFFFFF, &stat);
+    mips_write_w(m, a, get_gpr(m, (ir & RT_MASK) >> RT_SHIFT) & 0xFFFFFFFF, &stat);
     
     if ( stat == MEM_UNMAPPED )
     {
@@ -1604,7 +2027,7 @@ int decode_sw      (MIPS *m, uint32_t ir)
         return MIPS_EXCEPTION;
     }
     
-    if ( mips_breakpoint_test(m, a, BKPT_MEM_W) )
+    if ( mem_access(m, a, BKPT_MEM_W) )
         return MIPS_BKPT;
     
     return MIPS_OK;
@@ -1651,7 +2074,7 @@ int decode_sdr     (MIPS *m, uint32_t ir)
 int decode_syscall (MIPS *m, uint32_t ir)
 {
     (void)ir;
-    return mips_syscall(m, m->hw.get_reg(&m->hw, V0));
+    return mips_syscall(m, get_gpr(m, V0));
 }
 
 int decode_break   (MIPS *m, uint32_t ir)
@@ -1670,12 +2093,12 @@ int decode_trap    (MIPS *m, uint32_t ir)
 
 int decode_mul     (MIPS *m, uint32_t ir)
 {
-    int32_t rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    int32_t rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    int32_t rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    int32_t rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
     int64_t prod = rs * rt;
     
-    m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, (int32_t)(prod & 0x00000000FFFFFFFFL));
+    set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, (int32_t)(prod & 0x00000000FFFFFFFFL));
     
     // TODO : mark HI/LO as unpredictable
     
@@ -1684,59 +2107,59 @@ int decode_mul     (MIPS *m, uint32_t ir)
 
 int decode_madd    (MIPS *m, uint32_t ir)
 {
-    int32_t rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    int32_t rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    int32_t rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    int32_t rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
     int64_t prod = rs * rt;
     
-    m->hw.set_lo(&m->hw, (int32_t)(prod & 0x00000000FFFFFFFFL) + m->hw.get_lo(&m->hw));
-    m->hw.set_hi(&m->hw, (prod >> 32) + m->hw.get_hi(&m->hw));
+    set_lo(m, (int32_t)(prod & 0x00000000FFFFFFFFL) + get_lo(m));
+    set_hi(m, (prod >> 32) + get_hi(m));
     
     return MIPS_OK;
 }
 
 int decode_maddu    (MIPS *m, uint32_t ir)
 {
-    int32_t rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    int32_t rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    int32_t rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    int32_t rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
     uint64_t prod = s32_to_u32(rs) * s32_to_u32(rt);
     
-    m->hw.set_lo(&m->hw, (prod & 0x00000000FFFFFFFFL) + s32_to_u32(m->hw.get_lo(&m->hw)));
-    m->hw.set_hi(&m->hw, (prod >> 32) + s32_to_u32(m->hw.get_hi(&m->hw)));
+    set_lo(m, (prod & 0x00000000FFFFFFFFL) + s32_to_u32(get_lo(m)));
+    set_hi(m, (prod >> 32) + s32_to_u32(get_hi(m)));
     
     return MIPS_OK;
 }
 
 int decode_msub    (MIPS *m, uint32_t ir)
 {
-    int32_t rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    int32_t rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    int32_t rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    int32_t rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
     int64_t prod = rs * rt;
     
-    m->hw.set_lo(&m->hw, (int32_t)(prod & 0x00000000FFFFFFFFL) - m->hw.get_lo(&m->hw));
-    m->hw.set_hi(&m->hw, (prod >> 32) - m->hw.get_hi(&m->hw));
+    set_lo(m, (int32_t)(prod & 0x00000000FFFFFFFFL) - get_lo(m));
+    set_hi(m, (prod >> 32) - get_hi(m));
     
     return MIPS_OK;
 }
 
 int decode_msubu   (MIPS *m, uint32_t ir)
 {
-    int32_t rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
-    int32_t rt = m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT);
+    int32_t rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
+    int32_t rt = get_gpr(m, (ir & RT_MASK) >> RT_SHIFT);
     
     uint64_t prod = s32_to_u32(rs) * s32_to_u32(rt);
     
-    m->hw.set_lo(&m->hw, (prod & 0x00000000FFFFFFFFL) - s32_to_u32(m->hw.get_lo(&m->hw)));
-    m->hw.set_hi(&m->hw, (prod >> 32) - s32_to_u32(m->hw.get_hi(&m->hw)));
+    set_lo(m, (prod & 0x00000000FFFFFFFFL) - s32_to_u32(get_lo(m)));
+    set_hi(m, (prod >> 32) - s32_to_u32(get_hi(m)));
     
     return MIPS_OK;
 }
 
 int decode_clz     (MIPS *m, uint32_t ir)
 {
-    int32_t rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
+    int32_t rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
     
     int n = 0;
     
@@ -1749,13 +2172,13 @@ int decode_clz     (MIPS *m, uint32_t ir)
         ++n;
     }
     
-    m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, n);
+    set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, n);
     return MIPS_OK;
 }
 
 int decode_clo     (MIPS *m, uint32_t ir)
 {
-    int32_t rs = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT);
+    int32_t rs = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT);
     
     int n = 0;
     
@@ -1768,7 +2191,7 @@ int decode_clo     (MIPS *m, uint32_t ir)
         ++n;
     }
     
-    m->hw.set_reg(&m->hw, (ir & RD_MASK) >> RD_SHIFT, n);
+    set_gpr(m, (ir & RD_MASK) >> RD_SHIFT, n);
     return MIPS_OK;
 }
 
@@ -1776,68 +2199,44 @@ int decode_cp0     (MIPS *m, uint32_t ir)
 {
     MIPS_Instr i = cp0[(ir & FMT_MASK) >> FMT_SHIFT];
     
-    if ( i.decode )
-    {
-        if ( i.mnemonic != NULL )
-            mipsim_printf(IO_TRACE, "%s %s", i.mnemonic, mips_disasm(i.args, m->hw.get_pc(&m->hw), ir));
-        
-        if ( i.isa & (1 << m->architecture) )
-        {
-            if ( i.mnemonic != NULL ) mipsim_printf(IO_TRACE, "\n");
-            return i.decode(m, ir);
-        } else {
-            mipsim_printf(IO_TRACE, "\t\t[Unsupported in %s]\n", mips_isa_name(m->architecture));
-            return 1;
-        }
-    } else {
-        mipsim_printf(IO_TRACE, "cp0 ???\n");
-    }
+    if ( i.decode == NULL )
+        return MIPS_OK;
     
-    return MIPS_OK;
+    if ( !(i.isa & (1 << m->architecture)) )
+        return 1;
+    
+    return i.decode(m, ir);
 }
 
 int decode_cp1     (MIPS *m, uint32_t ir)
 {
     MIPS_Instr i = cp1[(ir & FMT_MASK) >> FMT_SHIFT];
     
-    if ( i.decode )
-    {
-        if ( i.mnemonic != NULL )
-            mipsim_printf(IO_TRACE, "%s %s", i.mnemonic, mips_disasm(i.args, m->hw.get_pc(&m->hw), ir));
-        
-        if ( i.isa & (1 << m->architecture) )
-        {
-            if ( i.mnemonic != NULL ) mipsim_printf(IO_TRACE, "\n");
-            return i.decode(m, ir);
-        } else {
-            mipsim_printf(IO_TRACE, "\t\t[Unsupported in %s]\n", mips_isa_name(m->architecture));
-            return 1;
-        }
-    } else {
-        mipsim_printf(IO_TRACE, "cp1 ???\n");
-    }
+    if ( i.decode == NULL )
+        return MIPS_OK;
     
-    return MIPS_OK;
+    if ( !(i.isa & (1 << m->architecture)) )
+        return 1;
+    
+    return i.decode(m, ir);
 }
 
 int decode_cp2     (MIPS *m, uint32_t ir)
 {
     (void)m; (void)ir;
-    mipsim_printf(IO_TRACE, "cop 2\n");
     return MIPS_UNSUPPORTED;
 }
 
 int decode_cp3     (MIPS *m, uint32_t ir)
 {
     (void)m; (void)ir;
-    mipsim_printf(IO_TRACE, "cop 3\n");
     return MIPS_UNSUPPORTED;
 }
 
 int decode_lwc      (MIPS *m, uint32_t ir)
 {
     MIPS_Coprocessor *cp = &m->cp[(ir >> OPCODE_SHIFT) & 3];
-    MIPS_Addr a = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
+    MIPS_Addr a = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
     
     int stat;
     cp->set_reg(cp, (ir & RT_MASK) >> RT_SHIFT, mips_read_w(m, a, &stat));
@@ -1848,7 +2247,7 @@ int decode_lwc      (MIPS *m, uint32_t ir)
 int decode_swc      (MIPS *m, uint32_t ir)
 {
     MIPS_Coprocessor *cp = &m->cp[(ir >> OPCODE_SHIFT) & 3];
-    MIPS_Addr a = m->hw.get_reg(&m->hw, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
+    MIPS_Addr a = get_gpr(m, (ir & RS_MASK) >> RS_SHIFT) + (int16_t)(ir & IMM_MASK);
     
     int stat;
     mips_write_w(m, a, cp->get_reg(cp, (ir & RT_MASK) >> RT_SHIFT) & 0xFFFFFFFF, &stat);
@@ -1860,7 +2259,7 @@ int decode_mfc     (MIPS *m, uint32_t ir)
 {
     MIPS_Coprocessor *cp = &m->cp[(ir >> OPCODE_SHIFT) & 3];
     
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, cp->get_reg(cp, (ir & FS_MASK) >> FS_SHIFT));
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, cp->get_reg(cp, (ir & FS_MASK) >> FS_SHIFT));
     return MIPS_OK;
 }
 
@@ -1868,7 +2267,7 @@ int decode_mtc     (MIPS *m, uint32_t ir)
 {
     MIPS_Coprocessor *cp = &m->cp[(ir >> OPCODE_SHIFT) & 3];
     
-    cp->set_reg(cp, (ir & FS_MASK) >> FS_SHIFT, m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT));
+    cp->set_reg(cp, (ir & FS_MASK) >> FS_SHIFT, get_gpr(m, (ir & RT_MASK) >> RT_SHIFT));
     return MIPS_OK;
 }
 
@@ -1876,7 +2275,7 @@ int decode_cfc     (MIPS *m, uint32_t ir)
 {
     MIPS_Coprocessor *cp = &m->cp[(ir >> OPCODE_SHIFT) & 3];
     
-    m->hw.set_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT, cp->get_ctrl(cp, (ir & FS_MASK) >> FS_SHIFT));
+    set_gpr(m, (ir & RT_MASK) >> RT_SHIFT, cp->get_ctrl(cp, (ir & FS_MASK) >> FS_SHIFT));
     return MIPS_OK;
 }
 
@@ -1884,7 +2283,7 @@ int decode_ctc     (MIPS *m, uint32_t ir)
 {
     MIPS_Coprocessor *cp = &m->cp[(ir >> OPCODE_SHIFT) & 3];
     
-    cp->set_ctrl(cp, (ir & FS_MASK) >> FS_SHIFT, m->hw.get_reg(&m->hw, (ir & RT_MASK) >> RT_SHIFT));
+    cp->set_ctrl(cp, (ir & FS_MASK) >> FS_SHIFT, get_gpr(m, (ir & RT_MASK) >> RT_SHIFT));
     return MIPS_OK;
 }
 
@@ -77,4 +77,89 @@ typedef struct _MIPS_Instr {
     int isa;
 } MIPS_Instr;
 
+enum {
+    ICACHE_PAGE_SHIFT  = 12,
+    ICACHE_PAGE_SIZE   = 1 << ICACHE_PAGE_SHIFT,
+    ICACHE_PAGE_WORDS  = ICACHE_PAGE_SIZE >> 2,
+    
+    ICACHE_TABLE_SHIFT = 22,
+    ICACHE_TABLE_SIZE  = 1 << (ICACHE_TABLE_SHIFT - ICACHE_PAGE_SHIFT),
+    ICACHE_DIR_SIZE    = 1 << (32 - ICACHE_TABLE_SHIFT)
+};
+
+enum {
+    DECODED_EMPTY,
+    DECODED_OK,
+    DECODED_UNSUPPORTED,
+    DECODED_UNKNOWN
+};
+
+/*!
+    \brief Predecoded instruction
+    
+    Entries of the predecode cache (see MIPS_ICache) hold the leaf handler
+    resolved from the opcode tables, the fields extracted from the
+    instruction word and the ISA check verdict.
+    
+    The op field is reserved to the threaded engine. It is reset whenever
+    the slot or the one following it (i.e. a delay slot) is invalidated.
+*/
+typedef struct _MIPS_Decoded {
+    instr_decode decode;
+    const void *op;
+    uint32_t ir;
+    int32_t imm;
+    uint8_t rs, rt, rd, sh;
+    uint8_t verdict;
+} MIPS_Decoded;
+
+/*
+    Operations of the fast execution engines (see mips_decoded_op)
+*/
+enum {
+    OP_SLOW,
+    OP_CALL,
+    
+    OP_SLL,
+    OP_SRL,
+    OP_SRA,
+    OP_SLLV,
+    OP_SRLV,
+    OP_SRAV,
+    OP_ADDU,
+    OP_SUBU,
+    OP_AND,
+    OP_OR,
+    OP_XOR,
+    OP_NOR,
+    OP_SLT,
+    OP_SLTU,
+    OP_MFHI,
+    OP_MFLO,
+    OP_ADDIU,
+    OP_SLTI,
+    OP_SLTIU,
+    OP_ANDI,
+    OP_ORI,
+    OP_XORI,
+    OP_LUI,
+    
+    OP_J,
+    OP_JR,
+    OP_BEQ,
+    OP_BLEZ,
+    OP_BLTZ,
+    
+    OP_COUNT,
+    OP_BRANCH = OP_J
+};
+
+int mips_decoded_op(const MIPS_Decoded *d, int last);
+
+int mips_universal_decode(MIPS *m);
+int mips_threaded_decode(MIPS *m);
+
+MIPS_Decoded* mips_icache_page(MIPS *m, MIPS_Addr a);
+const uint32_t* mips_icache_generation(MIPS *m);
+
 #endif
@@ -8,6 +8,9 @@
 **  Refer to the accompanying COPYING file for legalese.
 ****************************************************************************/
 
+// mmap and fstat are not part of C99
+#define _DEFAULT_SOURCE
+
 #include "elffile.h"
 
 /*!
@@ -19,6 +22,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__unix__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #include "io.h"
 
 #define intersect(a, b, c, d) (((c) < (b)) && ((d) > (a)))
@@ -58,46 +68,6 @@
     \brief Entry of a SHT_RELA relocation table
 */
 
-/*!
-    \internal
-    \brief Load a halfword from an ELF file
-    \param f file being loaded
-    \param endian endianness of file
-    \return the halfword at the current position
-    
-    The current position in the input file is incremented twice
-*/
-ELF32_Half elf_fget_half(FILE *f, ELF32_Char endian)
-{
-    int c0 = fgetc(f) & 0x00FF;
-    int c1 = fgetc(f) & 0x00FF;
-    
-    return endian == ELFDATA2MSB ?
-            (c0 << 8) | c1 :
-            (c1 << 8) | c0;
-}
-
-/*!
-    \internal
-    \brief Load a word from an ELF file
-    \param f file being loaded
-    \param endian endianness of file
-    \return the word at the current position
-    
-    The current position in the input file is incremented four times
-*/
-ELF32_Word elf_fget_word(FILE *f, ELF32_Char endian)
-{
-    int c0 = fgetc(f) & 0x00FF;
-    int c1 = fgetc(f) & 0x00FF;
-    int c2 = fgetc(f) & 0x00FF;
-    int c3 = fgetc(f) & 0x00FF;
-    
-    return endian == ELFDATA2MSB ?
-            (c0 << 24) | (c1 << 16) | (c2 << 8) | c3 :
-            (c3 << 24) | (c2 << 16) | (c1 << 8) | c0;
-}
-
 /*!
     \internal
     \brief Load a halfword from a chunk of data
@@ -192,6 +162,9 @@ ELF_File* elf_file_create()
         f->sections = NULL;
         f->segments = NULL;
         f->shstrtab = NULL;
+        f->image = NULL;
+        f->image_size = 0;
+        f->image_mapped = 0;
     }
     
     return f;
@@ -199,12 +172,16 @@ ELF_File* elf_file_create()
 
 /*!
     \internal
-    \brief Load a segment from an ELF file
-    \param s structure in which to store data
-    \param handle file being loaded
-    \param endian endianness of file
-    \param filename path of file being loaded
-    \return 0 on succes
+    \brief Whether some data points into the file image (and must not be freed)
+*/
+static int elf_in_image(ELF_File *f, const ELF32_Char *d)
+{
+    return d != NULL && f->image != NULL && d >= f->image && d < f->image + f->image_size;
+}
+
+/*!
+    \internal
+    \brief Release all data of an ELF file
 */
 void elf_file_cleanup(ELF_File *f)
 {
@@ -216,7 +193,8 @@ void elf_file_cleanup(ELF_File *f)
     {
         if ( f->sections[i] )
         {
-            free(f->sections[i]->s_data);
+            if ( !elf_in_image(f, f->sections[i]->s_data) )
+                free(f->sections[i]->s_data);
             free(f->sections[i]);
         }
     }
@@ -226,7 +204,8 @@ void elf_file_cleanup(ELF_File *f)
     {
         if ( f->segments[i] )
         {
-            free(f->segments[i]->p_data);
+            if ( !elf_in_image(f, f->segments[i]->p_data) )
+                free(f->segments[i]->p_data);
             free(f->segments[i]);
         }
     }
@@ -236,6 +215,14 @@ void elf_file_cleanup(ELF_File *f)
     free(f->sections);
     free(f->header);
     
+    /* release file image */
+#if defined(__unix__)
+    if ( f->image_mapped )
+        munmap(f->image, f->image_size);
+    else
+#endif
+        free(f->image);
+    
     /* NULL-ify */
     f->header = NULL;
     f->nsection = 0;
@@ -243,6 +230,9 @@ void elf_file_cleanup(ELF_File *f)
     f->sections = NULL;
     f->segments = NULL;
     f->shstrtab = NULL;
+    f->image = NULL;
+    f->image_size = 0;
+    f->image_mapped = 0;
 }
 
 /*!
@@ -314,22 +304,25 @@ const char* elf_section_name(ELF_File *elf, ELF32_Word n, ELF32_Word *size)
 
 /*!
     \internal
-    \brief Load a segment from an ELF file
-    \param s structure in which to store data
-    \param handle file being loaded
-    \param endian endianness of file
+    \brief Load the header of an ELF file
+    \param hdr structure in which to store data
+    \param elf file being loaded
     \param filename path of file being loaded
     \return 0 on succes
 */
-int elf_file_load_header(ELF_Header *hdr, FILE *handle, const char *filename)
+int elf_file_load_header(ELF_Header *hdr, ELF_File *elf, const char *filename)
 {
+    ELF32_Char *d = elf->image;
+    
     // identifier (only part which can be read without being endian-aware)
-    if ( fread(hdr->e_ident, sizeof(ELF32_Char), EI_NIDENT, handle) != (sizeof(ELF32_Char) * EI_NIDENT) )
+    if ( elf->image_size < EI_NIDENT )
     {
         mipsim_printf(IO_WARNING, "ELF:%s: Invalid header : failed to read identifier\n", filename);
         return 1;
     }
     
+    memcpy(hdr->e_ident, d, EI_NIDENT);
+    
     /*
         Some macros for error checking
     */
@@ -382,22 +375,29 @@ int elf_file_load_header(ELF_Header *hdr, FILE *handle, const char *filename)
     
     ELF_CHECK_EQU("format", endian, ELFDATA2MSB)
     
+    if ( elf->image_size < EI_NIDENT + 36 )
+    {
+        mipsim_printf(IO_WARNING, "ELF:%s: Invalid header : truncated file\n", filename);
+        return 1;
+    }
+    
     /*
         read rest of header data, endian-aware
     */
-    hdr->e_type      = elf_fget_half(handle, endian);
-    hdr->e_machine   = elf_fget_half(handle, endian);
-    hdr->e_version   = elf_fget_word(handle, endian);
-    hdr->e_entry     = elf_fget_word(handle, endian);
-    hdr->e_phoff     = elf_fget_word(handle, endian);
-    hdr->e_shoff     = elf_fget_word(handle, endian);
-    hdr->e_flags     = elf_fget_word(handle, endian);
-    hdr->e_ehsize    = elf_fget_half(handle, endian);
-    hdr->e_phentsize = elf_fget_half(handle, endian);
-    hdr->e_phnum     = elf_fget_half(handle, endian);
-    hdr->e_shentsize = elf_fget_half(handle, endian);
-    hdr->e_shnum     = elf_fget_half(handle, endian);
-    hdr->e_shstrndx  = elf_fget_half(handle, endian);
+    d += EI_NIDENT;
+    hdr->e_type      = elf_read_half(d + 0, endian);
+    hdr->e_machine   = elf_read_half(d + 2, endian);
+    hdr->e_version   = elf_read_word(d + 4, endian);
+    hdr->e_entry     = elf_read_word(d + 8, endian);
+    hdr->e_phoff     = elf_read_word(d + 12, endian);
+    hdr->e_shoff     = elf_read_word(d + 16, endian);
+    hdr->e_flags     = elf_read_word(d + 20, endian);
+    hdr->e_ehsize    = elf_read_half(d + 24, endian);
+    hdr->e_phentsize = elf_read_half(d + 26, endian);
+    hdr->e_phnum     = elf_read_half(d + 28, endian);
+    hdr->e_shentsize = elf_read_half(d + 30, endian);
+    hdr->e_shnum     = elf_read_half(d + 32, endian);
+    hdr->e_shstrndx  = elf_read_half(d + 34, endian);
     
     ELF_CHECK_EQU("version", hdr->e_version, EV_CURRENT)
     ELF_CHECK_EITHER("type", hdr->e_type, ET_EXEC, ET_REL)
@@ -424,21 +424,26 @@ int elf_file_load_header(ELF_Header *hdr, FILE *handle, const char *filename)
     \internal
     \brief Load a segment from an ELF file
     \param s structure in which to store data
-    \param handle file being loaded
-    \param endian endianness of file
+    \param elf file being loaded
+    \param d program header in the file image
     \param filename path of file being loaded
     \return 0 on succes
+    
+    Segments without uninitialized data are copy-on-write views of the file
+    image rather than copies.
 */
-int elf_file_load_segment(ELF_Segment *s, FILE *handle, int endian, const char *filename)
+int elf_file_load_segment(ELF_Segment *s, ELF_File *elf, ELF32_Char *d, const char *filename)
 {
-    s->p_type   = elf_fget_word(handle, endian);
-    s->p_offset = elf_fget_word(handle, endian);
-    s->p_vaddr  = elf_fget_word(handle, endian);
-    s->p_paddr  = elf_fget_word(handle, endian);
-    s->p_filesz = elf_fget_word(handle, endian);
-    s->p_memsz  = elf_fget_word(handle, endian);
-    s->p_flags  = elf_fget_word(handle, endian);
-    s->p_align  = elf_fget_word(handle, endian);
+    const ELF32_Char endian = elf->header->e_ident[EI_DATA];
+    
+    s->p_type   = elf_read_word(d + 0, endian);
+    s->p_offset = elf_read_word(d + 4, endian);
+    s->p_vaddr  = elf_read_word(d + 8, endian);
+    s->p_paddr  = elf_read_word(d + 12, endian);
+    s->p_filesz = elf_read_word(d + 16, endian);
+    s->p_memsz  = elf_read_word(d + 20, endian);
+    s->p_flags  = elf_read_word(d + 24, endian);
+    s->p_align  = elf_read_word(d + 28, endian);
     
     s->p_data   = NULL;
     
@@ -450,23 +455,35 @@ int elf_file_load_segment(ELF_Segment *s, FILE *handle, int endian, const char *
             return 1;
         }
         
-        if ( fseek(handle, s->p_offset, SEEK_SET) )
+        if ( s->p_offset > elf->image_size )
         {
             mipsim_printf(IO_WARNING, "ELF:%s: Invalid file : unable to reach segment\n", filename);
             return 1;
         }
         
-        s->p_data = (ELF32_Char*)calloc(s->p_memsz, sizeof(ELF32_Char));
-        size_t sz = fread(s->p_data, sizeof(ELF32_Char), s->p_filesz, handle);
+        size_t sz = elf->image_size - s->p_offset;
         
-        if ( sz != s->p_filesz * sizeof(ELF32_Char) )
+        if ( sz < s->p_filesz )
         {
-            mipsim_printf(IO_WARNING, "ELF:%s: Invalid file : unable to read data of segment [%d vs %u]\n", filename, sz, s->p_filesz);
-            free(s->p_data);
-            s->p_data = NULL;
+            mipsim_printf(IO_WARNING, "ELF:%s: Invalid file : unable to read data of segment [%zu vs %u]\n", filename, sz, s->p_filesz);
             return 1;
         }
         
+        if ( s->p_memsz == s->p_filesz && s->p_filesz )
+        {
+            s->p_data = elf->image + s->p_offset;
+        } else {
+            s->p_data = (ELF32_Char*)calloc(s->p_memsz, sizeof(ELF32_Char));
+            
+            if ( s->p_data == NULL )
+            {
+                mipsim_printf(IO_WARNING, "ELF:%s: Failed to allocate memory for segment data\n", filename);
+                return 1;
+            }
+            
+            memcpy(s->p_data, elf->image + s->p_offset, s->p_filesz);
+        }
+        
         mipsim_printf(IO_DEBUG, "ELF:%s: Succesfully loaded segment (%d bytes)\n", filename, s->p_filesz);
     } else {
         mipsim_printf(IO_DEBUG, "ELF:%s: Skipped segment (type %8x)\n", filename, s->p_type);
@@ -481,14 +498,12 @@ int elf_file_load_segment(ELF_Segment *s, FILE *handle, int endian, const char *
     \internal
     \brief Load all segments from an ELF file
     \param elf structure in which to store data
-    \param handle file being loaded
-    \param endian endianness of file
     \param filename path of file being loaded
     \return 0 on succes
 */
-int elf_file_load_segments(ELF_File *elf, FILE *handle, const char *filename)
+int elf_file_load_segments(ELF_File *elf, const char *filename)
 {
-    if ( fseek(handle, elf->header->e_phoff, SEEK_SET) )
+    if ( elf->header->e_phoff > elf->image_size )
     {
         mipsim_printf(IO_WARNING, "ELF:%s: Invalid file : unable to locate program header table\n", filename);
         return 1;
@@ -497,7 +512,6 @@ int elf_file_load_segments(ELF_File *elf, FILE *handle, const char *filename)
     if ( elf->header->e_phnum )
         elf->segments = (ELF_Segment**)malloc(elf->header->e_phnum * sizeof(ELF_Segment*));
     
-    const ELF32_Char endian = elf->header->e_ident[EI_DATA];
 //     const ELF32_Off min_offset = elf->header->e_phoff + elf->header->e_phentsize * (elf->header->e_phnum + 1);
     
     ELF32_Addr first_addr = -1, last_addr = 0;
@@ -518,7 +532,7 @@ int elf_file_load_segments(ELF_File *elf, FILE *handle, const char *filename)
                 return 1;
             }
             
-            if ( fseek(handle, soff, SEEK_SET) )
+            if ( soff > elf->image_size || elf->image_size - soff < 8 * sizeof(ELF32_Word) )
             {
                 mipsim_printf(IO_WARNING,
                               "ELF:%s: Invalid file : broken program table\n",
@@ -527,7 +541,7 @@ int elf_file_load_segments(ELF_File *elf, FILE *handle, const char *filename)
             } else {
                 ELF_Segment *s = (ELF_Segment*)malloc(sizeof(ELF_Segment));
                 
-                if ( elf_file_load_segment(s, handle, endian, filename) )
+                if ( elf_file_load_segment(s, elf, elf->image + soff, filename) )
                 {
                     free(s);
                 } else {
@@ -573,45 +587,29 @@ int elf_file_load_segments(ELF_File *elf, FILE *handle, const char *filename)
 
 /*!
     \internal
-    \brief Load section data from an ELF file
-    \param d where to store data
-    \param handle file being loaded
+    \brief Locate section data in the file image
+    \param d where to store a pointer to the data
+    \param elf file being loaded
     \param off offset of data in file
-    \param sz size of data to read
+    \param sz size of data
     \param filename path of file being loaded
     \return 0 on succes
     
-    Caller is responsible for freeing the allocated data
+    The data is not copied and lives as long as the file image.
 */
-int elf_fread(ELF32_Char **d, FILE *handle, ELF32_Off off, ELF32_Word sz, const char *filename)
+int elf_view(ELF32_Char **d, ELF_File *elf, ELF32_Off off, ELF32_Word sz, const char *filename)
 {
     if ( sz <= 0 )
         return 1;
     
-    if ( fseek(handle, off, SEEK_SET) )
+    if ( off > elf->image_size || elf->image_size - off < sz )
     {
-        mipsim_printf(IO_WARNING, "ELF:%s: Invalid file : unable to reach section data\n", filename);
+        mipsim_printf(IO_WARNING, "ELF:%s: Invalid file : unable to read data of section\n", filename);
         *d = NULL;
         return 1;
     }
     
-    *d = (ELF32_Char*)malloc(sz * sizeof(ELF32_Char));
-    
-    if ( *d == NULL )
-    {
-        mipsim_printf(IO_WARNING, "ELF:%s: Failed to allocate memory for section data\n", filename);
-        return 1;
-    }
-    
-    size_t rsz = fread(*d, sizeof(ELF32_Char), sz, handle);
-    
-    if ( rsz != sz * sizeof(ELF32_Char) )
-    {
-        mipsim_printf(IO_WARNING, "ELF:%s: Invalid file : unable to read data of section [%d vs %u]\n", filename, rsz, sz);
-        free(*d);
-        *d = NULL;
-        return 1;
-    }
+    *d = elf->image + off;
     
     return 0;
 }
@@ -620,23 +618,29 @@ int elf_fread(ELF32_Char **d, FILE *handle, ELF32_Off off, ELF32_Word sz, const
     \internal
     \brief Load a section from an ELF file
     \param s structure in which to store data
-    \param handle file being loaded
-    \param endian endianness of file
+    \param elf file being loaded
+    \param d section header in the file image
     \param filename path of file being loaded
     \return 0 on succes
+    
+    Symbol and relocation tables are converted to host structures. The data of
+    other sections is left in the file image, so that sections nobody asks for
+    (e.g. debug info) are never even read.
 */
-int elf_file_load_section(ELF_Section *s, FILE *handle, int endian, const char *filename)
+int elf_file_load_section(ELF_Section *s, ELF_File *elf, ELF32_Char *d, const char *filename)
 {
-    s->s_name      = elf_fget_word(handle, endian);
-    s->s_type      = elf_fget_word(handle, endian);
-    s->s_flags     = elf_fget_word(handle, endian);
-    s->s_addr      = elf_fget_word(handle, endian);
-    s->s_offset    = elf_fget_word(handle, endian);
-    s->s_size      = elf_fget_word(handle, endian);
-    s->s_link      = elf_fget_word(handle, endian);
-    s->s_info      = elf_fget_word(handle, endian);
-    s->s_addralign = elf_fget_word(handle, endian);
-    s->s_entsize   = elf_fget_word(handle, endian);
+    const ELF32_Char endian = elf->header->e_ident[EI_DATA];
+    
+    s->s_name      = elf_read_word(d + 0, endian);
+    s->s_type      = elf_read_word(d + 4, endian);
+    s->s_flags     = elf_read_word(d + 8, endian);
+    s->s_addr      = elf_read_word(d + 12, endian);
+    s->s_offset    = elf_read_word(d + 16, endian);
+    s->s_size      = elf_read_word(d + 20, endian);
+    s->s_link      = elf_read_word(d + 24, endian);
+    s->s_info      = elf_read_word(d + 28, endian);
+    s->s_addralign = elf_read_word(d + 32, endian);
+    s->s_entsize   = elf_read_word(d + 36, endian);
     
     s->s_data      = NULL;
     s->s_reloc     = 0;
@@ -655,7 +659,7 @@ int elf_file_load_section(ELF_Section *s, FILE *handle, int endian, const char *
     
     if ( s->s_type == SHT_STRTAB )
     {
-        ret = elf_fread(&s->s_data, handle, s->s_offset, s->s_size, filename);
+        ret = elf_view(&s->s_data, elf, s->s_offset, s->s_size, filename);
         
         /*
         mipsim_printf(IO_DEBUG, "strtab : \n");
@@ -681,7 +685,7 @@ int elf_file_load_section(ELF_Section *s, FILE *handle, int endian, const char *
         
         while ( off + s->s_entsize <= end )
         {
-            if ( (off & mask) || fseek(handle, off, SEEK_SET) )
+            if ( (off & mask) || off > elf->image_size || elf->image_size - off < s->s_entsize )
             {
                 mipsim_printf(IO_WARNING,
                               "ELF:%s: Improper alignement of symbol table entries\n",
@@ -692,12 +696,14 @@ int elf_file_load_section(ELF_Section *s, FILE *handle, int endian, const char *
                 return 1;
             }
             
-            sym->s_name  = elf_fget_word(handle, endian);
-            sym->s_value = elf_fget_word(handle, endian);
-            sym->s_size  = elf_fget_word(handle, endian);
-            sym->s_info  = fgetc(handle);
-            sym->s_other = fgetc(handle);
-            sym->s_shndx = elf_fget_half(handle, endian);
+            ELF32_Char *e = elf->image + off;
+            
+            sym->s_name  = elf_read_word(e + 0, endian);
+            sym->s_value = elf_read_word(e + 4, endian);
+            sym->s_size  = elf_read_word(e + 8, endian);
+            sym->s_info  = e[12];
+            sym->s_other = e[13];
+            sym->s_shndx = elf_read_half(e + 14, endian);
             ++sym;
             
             off += s->s_entsize;
@@ -721,7 +727,7 @@ int elf_file_load_section(ELF_Section *s, FILE *handle, int endian, const char *
         
         while ( off + s->s_entsize <= end )
         {
-            if ( (off & mask) || fseek(handle, off, SEEK_SET) )
+            if ( (off & mask) || off > elf->image_size || elf->image_size - off < s->s_entsize )
             {
                 mipsim_printf(IO_WARNING,
                               "ELF:%s: Improper alignement of relocation table entries\n",
@@ -732,8 +738,10 @@ int elf_file_load_section(ELF_Section *s, FILE *handle, int endian, const char *
                 return 1;
             }
             
-            rel->r_offset = elf_fget_word(handle, endian);
-            rel->r_info   = elf_fget_word(handle, endian);
+            ELF32_Char *e = elf->image + off;
+            
+            rel->r_offset = elf_read_word(e + 0, endian);
+            rel->r_info   = elf_read_word(e + 4, endian);
             ++rel;
             
             off += s->s_entsize;
@@ -757,7 +765,7 @@ int elf_file_load_section(ELF_Section *s, FILE *handle, int endian, const char *
         
         while ( off + s->s_entsize <= end )
         {
-            if ( (off & mask) || fseek(handle, off, SEEK_SET) )
+            if ( (off & mask) || off > elf->image_size || elf->image_size - off < s->s_entsize )
             {
                 mipsim_printf(IO_WARNING,
                               "ELF:%s: Improper alignement of relocation table entries\n",
@@ -768,17 +776,25 @@ int elf_file_load_section(ELF_Section *s, FILE *handle, int endian, const char *
                 return 1;
             }
             
-            rela->r_offset = elf_fget_word(handle, endian);
-            rela->r_info   = elf_fget_word(handle, endian);
-            rela->r_addend = elf_fget_word(handle, endian);
+            ELF32_Char *e = elf->image + off;
+            
+            rela->r_offset = elf_read_word(e + 0, endian);
+            rela->r_info   = elf_read_word(e + 4, endian);
+            rela->r_addend = elf_read_word(e + 8, endian);
             ++rela;
             
             off += s->s_entsize;
         }
     } else if ( s->s_type == SHT_PROGBITS ) {
-        ret = elf_fread(&s->s_data, handle, s->s_offset, s->s_size, filename);
+        ret = elf_view(&s->s_data, elf, s->s_offset, s->s_size, filename);
+    } else if ( s->s_type == SHT_NOBITS && (s->s_flags & SHF_ALLOC) ) {
+        // not backed by the file : must not alias whatever data follows
+        if ( s->s_size )
+            s->s_data = (ELF32_Char*)calloc(s->s_size, sizeof(ELF32_Char));
+        
+        ret = s->s_data == NULL;
     } else if ( s->s_flags & SHF_ALLOC ) {
-        ret = elf_fread(&s->s_data, handle, s->s_offset, s->s_size, filename);
+        ret = elf_view(&s->s_data, elf, s->s_offset, s->s_size, filename);
     }
     
     return ret;
@@ -788,13 +804,12 @@ int elf_file_load_section(ELF_Section *s, FILE *handle, int endian, const char *
     \internal
     \brief Load all sections from an ELF file
     \param elf structure in which to store data
-    \param handle file being loaded
     \param filename path of file being loaded
     \return 0 on succes
 */
-int elf_file_load_sections(ELF_File *elf, FILE *handle, const char *filename)
+int elf_file_load_sections(ELF_File *elf, const char *filename)
 {
-    if ( fseek(handle, elf->header->e_shoff, SEEK_SET) )
+    if ( elf->header->e_shoff > elf->image_size )
     {
         mipsim_printf(IO_WARNING, "ELF:%s: Invalid file : unable to locate section header table\n", filename);
         return 1;
@@ -805,7 +820,6 @@ int elf_file_load_sections(ELF_File *elf, FILE *handle, const char *filename)
     
     mipsim_printf(IO_DEBUG, "ELF:%s:Loading %d sections\n", filename, elf->header->e_shnum);
     
-    const ELF32_Char endian = elf->header->e_ident[EI_DATA];
 //     const ELF32_Off min_offset = elf->header->e_shoff + elf->header->e_shentsize * (elf->header->e_shnum + 1);
     
     elf->sections = (ELF_Section**)malloc(elf->header->e_shnum * sizeof(ELF_Section*));
@@ -822,13 +836,13 @@ int elf_file_load_sections(ELF_File *elf, FILE *handle, const char *filename)
     {
         elf->sections[i] = NULL;
         
-        if ( fseek(handle, soff, SEEK_SET) )
+        if ( soff > elf->image_size || elf->image_size - soff < 10 * sizeof(ELF32_Word) )
         {
             mipsim_printf(IO_WARNING, "ELF:%s: Invalid file : broken section table\n", filename);
         } else {
             ELF_Section *s = (ELF_Section*)malloc(sizeof(ELF_Section));
             
-            if ( elf_file_load_section(s, handle, endian, filename) )
+            if ( elf_file_load_section(s, elf, elf->image + soff, filename) )
             {
                 free(s);
             } else {
@@ -908,6 +922,63 @@ int elf_file_load_sections(ELF_File *elf, FILE *handle, const char *filename)
     return 0;
 }
 
+/*!
+    \internal
+    \brief Make the whole content of a file available in memory
+    \param elf structure in which to store the file image
+    \param filename path of file to map
+    \return 0 on success
+    
+    The file is mapped privately when possible : pages are only read when
+    touched and modifications (e.g. relocations) are copy-on-write.
+*/
+int elf_file_map(ELF_File *elf, const char *filename)
+{
+#if defined(__unix__)
+    int fd = open(filename, O_RDONLY);
+    
+    if ( fd < 0 )
+        return 1;
+    
+    struct stat st;
+    
+    if ( !fstat(fd, &st) && st.st_size > 0 )
+    {
+        void *d = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        
+        if ( d != MAP_FAILED )
+        {
+            close(fd);
+            elf->image = (ELF32_Char*)d;
+            elf->image_size = st.st_size;
+            elf->image_mapped = 1;
+            return 0;
+        }
+    }
+    
+    close(fd);
+#endif
+    
+    // fall back to reading the whole file
+    FILE *handle = fopen(filename, "rb");
+    
+    if ( !handle )
+        return 1;
+    
+    long sz = fseek(handle, 0, SEEK_END) ? -1 : ftell(handle);
+    
+    if ( sz >= 0 && !fseek(handle, 0, SEEK_SET) )
+    {
+        elf->image = (ELF32_Char*)malloc(sz ? sz : 1);
+        elf->image_size = elf->image != NULL ? fread(elf->image, 1, sz, handle) : 0;
+        elf->image_mapped = 0;
+    }
+    
+    fclose(handle);
+    
+    return elf->image == NULL;
+}
+
 /*!
     \brief Load the contents of an ELF file into memory
     \param elf Structure in which data will be stored
@@ -926,9 +997,7 @@ int elf_file_load(ELF_File *elf, const char *filename)
         elf_file_cleanup(elf);
     }
     
-    FILE *handle = fopen(filename, "rb");
-    
-    if ( !handle )
+    if ( elf_file_map(elf, filename) )
     {
         mipsim_printf(IO_WARNING, "ELF:%s: Unable to open file\n", filename);
         return -1;
@@ -942,19 +1011,18 @@ int elf_file_load(ELF_File *elf, const char *filename)
         return -1;
     }
     
-    int exit_code = elf_file_load_header(elf->header, handle, filename);
+    int exit_code = elf_file_load_header(elf->header, elf, filename);
     
     if ( !exit_code )
-       exit_code = elf_file_load_sections(elf, handle, filename);
+       exit_code = elf_file_load_sections(elf, filename);
     else {
         free(elf->header);
         elf->header = NULL;
     }
     
     if ( !exit_code )
-        exit_code = elf_file_load_segments(elf, handle, filename);
+        exit_code = elf_file_load_segments(elf, filename);
     
-    fclose(handle);
     return exit_code;
 }
 
@@ -267,6 +267,11 @@ typedef struct {
     ELF_Segment **segments;
     
     ELF_Section *shstrtab;
+    
+    /* file image (sections and segments may point into it) */
+    ELF32_Char *image;
+    size_t image_size;
+    int image_mapped;
 } ELF_File;
 
 ELF_File* elf_file_create();
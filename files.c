@@ -0,0 +1,516 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+// pread, pwrite and realpath are not part of C99
+#define _DEFAULT_SOURCE
+
+#include "files.h"
+
+/*!
+    \file files.c
+    \brief Guest file descriptors backed by host files
+    \author Hugues Bruant
+*/
+
+#include "io.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__)
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+typedef struct _MIPS_File {
+    int host;
+    int seekable;
+    int append;
+    int64_t offset;
+} MIPS_File;
+
+struct _MIPS_Files {
+    char *root;
+    MIPS_File files[MIPS_FILES_MAX];
+};
+
+/*!
+    \internal
+    \brief Store an error code, return -1 for convenience
+*/
+static int mips_files_error(int *err, int code)
+{
+    if ( err != NULL )
+        *err = code;
+    
+    return -1;
+}
+
+/*!
+    \internal
+    \brief Host file backing a guest file descriptor
+    \return NULL if fd is not an open non-console descriptor
+*/
+static MIPS_File* mips_files_get(MIPS_Files *f, int fd)
+{
+    if ( f == NULL || fd < MIPS_FILES_CONSOLE || fd >= MIPS_FILES_MAX || f->files[fd].host < 0 )
+        return NULL;
+    
+    return &f->files[fd];
+}
+
+/*!
+    \brief Create a file descriptor table
+    \param root sandbox directory, NULL to deny any access to host files
+*/
+MIPS_Files* mips_files_create(const char *root)
+{
+    MIPS_Files *f = (MIPS_Files*)malloc(sizeof(MIPS_Files));
+    
+    if ( f == NULL )
+        return NULL;
+    
+    f->root = NULL;
+    
+    for ( int i = 0; i < MIPS_FILES_MAX; ++i )
+        f->files[i].host = -1;
+
+#if defined(__unix__)
+    if ( root != NULL )
+    {
+        f->root = realpath(root, NULL);
+        
+        if ( f->root == NULL )
+            mipsim_printf(IO_WARNING, "Files: invalid sandbox %s\n", root);
+        else if ( !strcmp(f->root, "/") )
+            *f->root = 0;
+    }
+#else
+    (void)root;
+#endif
+
+    return f;
+}
+
+/*!
+    \brief Close all guest files
+*/
+void mips_files_close_all(MIPS_Files *f)
+{
+    if ( f == NULL )
+        return;
+    
+    for ( int i = MIPS_FILES_CONSOLE; i < MIPS_FILES_MAX; ++i )
+        mips_files_close(f, i, NULL);
+}
+
+/*!
+    \brief Close all guest files and release the table
+*/
+void mips_files_destroy(MIPS_Files *f)
+{
+    if ( f == NULL )
+        return;
+    
+    mips_files_close_all(f);
+    
+    free(f->root);
+    free(f);
+}
+
+/*!
+    \brief Whether the guest may open host files
+    
+    False when the table was created without a sandbox or when the sandbox
+    directory could not be resolved.
+*/
+int mips_files_sandboxed(MIPS_Files *f)
+{
+    return f != NULL && f->root != NULL;
+}
+
+/*!
+    \brief Whether a guest file descriptor is open
+    
+    Console descriptors are always open.
+*/
+int mips_files_valid(MIPS_Files *f, int fd)
+{
+    return (fd >= 0 && fd < MIPS_FILES_CONSOLE) || mips_files_get(f, fd) != NULL;
+}
+
+#if defined(__unix__)
+
+/*!
+    \internal
+    \brief Convert a host errno value to its newlib counterpart
+*/
+static int mips_files_errno(int e)
+{
+    switch ( e )
+    {
+        case ENOTEMPTY :
+            return MIPS_ENOTEMPTY;
+            
+        case ENAMETOOLONG :
+            return MIPS_ENAMETOOLONG;
+            
+        case ELOOP :
+            return MIPS_ELOOP;
+            
+        case EOVERFLOW :
+            return MIPS_EOVERFLOW;
+            
+        default:
+            // historical values shared by newlib and all supported hosts
+            return e > 0 && e <= 34 ? e : MIPS_EIO;
+    }
+}
+
+/*!
+    \internal
+    \brief Map a guest path to a host path inside the sandbox
+    \return host path (to be free'd by caller), NULL on error
+    
+    The guest sees the sandbox as its root directory : absolute and relative
+    guest paths are both resolved from it and ".." cannot climb above it.
+    The directory containing the file must resolve inside the sandbox once
+    host symlinks are followed.
+*/
+static char* mips_files_resolve(MIPS_Files *f, const char *path, int *err)
+{
+    size_t rlen = strlen(f->root);
+    char *host = (char*)malloc(rlen + strlen(path) + 2);
+    
+    if ( host == NULL )
+    {
+        mips_files_error(err, MIPS_EIO);
+        return NULL;
+    }
+    
+    memcpy(host, f->root, rlen);
+    
+    size_t len = rlen;
+    
+    while ( *path )
+    {
+        size_t n = strcspn(path, "/");
+        
+        if ( n == 2 && path[0] == '.' && path[1] == '.' )
+        {
+            if ( len == rlen )
+            {
+                free(host);
+                mips_files_error(err, MIPS_EACCES);
+                return NULL;
+            }
+            
+            while ( host[--len] != '/' )
+                ;
+        } else if ( n && !(n == 1 && path[0] == '.') ) {
+            host[len++] = '/';
+            memcpy(host + len, path, n);
+            len += n;
+        }
+        
+        path += n;
+        
+        if ( *path == '/' )
+            ++path;
+    }
+    
+    host[len] = 0;
+    
+    if ( len == rlen )
+    {
+        if ( !len )
+            strcpy(host, "/");
+        
+        return host;
+    }
+    
+    // check the parent directory against symlinks escaping the sandbox
+    char *sep = strrchr(host, '/');
+    *sep = 0;
+    char *dir = realpath(sep != host ? host : "/", NULL);
+    *sep = '/';
+    
+    if ( dir == NULL )
+    {
+        free(host);
+        mips_files_error(err, mips_files_errno(errno));
+        return NULL;
+    }
+    
+    int inside = !strncmp(dir, f->root, rlen) && (dir[rlen] == '/' || !dir[rlen]);
+    
+    free(dir);
+    
+    if ( !inside )
+    {
+        free(host);
+        mips_files_error(err, MIPS_EACCES);
+        return NULL;
+    }
+    
+    return host;
+}
+
+/*!
+    \brief Open a host file on behalf of the guest
+    \param path guest path, resolved inside the sandbox
+    \param flags newlib open flags
+    \param err receives a newlib errno value on failure
+    \return guest file descriptor, -1 on failure
+    
+    Created files get mode 0666, filtered by the umask of the simulator.
+    The last path component is not allowed to be a symlink.
+*/
+int mips_files_open(MIPS_Files *f, const char *path, int flags, int *err)
+{
+    if ( f == NULL || f->root == NULL )
+        return mips_files_error(err, MIPS_EACCES);
+    
+    int fd = MIPS_FILES_CONSOLE;
+    
+    while ( fd < MIPS_FILES_MAX && f->files[fd].host >= 0 )
+        ++fd;
+    
+    if ( fd == MIPS_FILES_MAX )
+        return mips_files_error(err, MIPS_EMFILE);
+    
+    int hflags = O_NOFOLLOW;
+    
+    switch ( flags & MIPS_O_ACCMODE )
+    {
+        case MIPS_O_RDONLY :
+            hflags |= O_RDONLY;
+            break;
+            
+        case MIPS_O_WRONLY :
+            hflags |= O_WRONLY;
+            break;
+            
+        case MIPS_O_RDWR :
+            hflags |= O_RDWR;
+            break;
+            
+        default:
+            return mips_files_error(err, MIPS_EINVAL);
+    }
+    
+    if ( flags & MIPS_O_APPEND )
+        hflags |= O_APPEND;
+    if ( flags & MIPS_O_CREAT )
+        hflags |= O_CREAT;
+    if ( flags & MIPS_O_TRUNC )
+        hflags |= O_TRUNC;
+    if ( flags & MIPS_O_EXCL )
+        hflags |= O_EXCL;
+    if ( flags & MIPS_O_SYNC )
+        hflags |= O_SYNC;
+    if ( flags & MIPS_O_NONBLOCK )
+        hflags |= O_NONBLOCK;
+    
+    char *host = mips_files_resolve(f, path, err);
+    
+    if ( host == NULL )
+        return -1;
+    
+    int h = open(host, hflags, 0666);
+    int e = errno;
+    
+    free(host);
+    
+    if ( h < 0 )
+        return mips_files_error(err, mips_files_errno(e));
+    
+    off_t pos = lseek(h, 0, SEEK_CUR);
+    
+    f->files[fd].host = h;
+    f->files[fd].seekable = pos >= 0;
+    f->files[fd].append = (flags & MIPS_O_APPEND) != 0;
+    f->files[fd].offset = pos >= 0 ? pos : 0;
+    
+    return fd;
+}
+
+/*!
+    \brief Read from a guest file
+    \return number of bytes read, -1 on failure
+    
+    Seekable files are read at the offset tracked by the table, so that
+    seeking costs no host system call.
+*/
+int mips_files_read(MIPS_Files *f, int fd, void *d, uint32_t n, int *err)
+{
+    MIPS_File *file = mips_files_get(f, fd);
+    
+    if ( file == NULL )
+        return mips_files_error(err, MIPS_EBADF);
+    
+    if ( n > 0x7FFFFFFF )
+        n = 0x7FFFFFFF;
+    
+    ssize_t ret;
+    
+    do
+    {
+        ret = file->seekable ? pread(file->host, d, n, file->offset) : read(file->host, d, n);
+    } while ( ret < 0 && errno == EINTR );
+    
+    if ( ret < 0 )
+        return mips_files_error(err, mips_files_errno(errno));
+    
+    file->offset += ret;
+    
+    return ret;
+}
+
+/*!
+    \brief Write to a guest file
+    \return number of bytes written, -1 on failure
+*/
+int mips_files_write(MIPS_Files *f, int fd, const void *d, uint32_t n, int *err)
+{
+    MIPS_File *file = mips_files_get(f, fd);
+    
+    if ( file == NULL )
+        return mips_files_error(err, MIPS_EBADF);
+    
+    if ( n > 0x7FFFFFFF )
+        n = 0x7FFFFFFF;
+    
+    ssize_t ret;
+    
+    do
+    {
+        // appends go through the host offset which always ends up at EOF
+        if ( file->seekable && !file->append )
+            ret = pwrite(file->host, d, n, file->offset);
+        else
+            ret = write(file->host, d, n);
+    } while ( ret < 0 && errno == EINTR );
+    
+    if ( ret < 0 )
+        return mips_files_error(err, mips_files_errno(errno));
+    
+    if ( file->append && file->seekable )
+        file->offset = lseek(file->host, 0, SEEK_CUR);
+    else
+        file->offset += ret;
+    
+    return ret;
+}
+
+/*!
+    \brief Move the offset of a guest file
+    \param whence SEEK_SET, SEEK_CUR or SEEK_END (same values in newlib)
+    \return new offset, -1 on failure
+*/
+int32_t mips_files_lseek(MIPS_Files *f, int fd, int32_t offset, int whence, int *err)
+{
+    MIPS_File *file = mips_files_get(f, fd);
+    
+    if ( file == NULL )
+        return mips_files_error(err, MIPS_EBADF);
+    
+    if ( !file->seekable )
+        return mips_files_error(err, MIPS_ESPIPE);
+    
+    int64_t base;
+    
+    if ( whence == 0 )
+    {
+        base = 0;
+    } else if ( whence == 1 ) {
+        base = file->offset;
+    } else if ( whence == 2 ) {
+        struct stat st;
+        
+        if ( fstat(file->host, &st) )
+            return mips_files_error(err, mips_files_errno(errno));
+        
+        base = st.st_size;
+    } else {
+        return mips_files_error(err, MIPS_EINVAL);
+    }
+    
+    int64_t pos = base + offset;
+    
+    if ( pos < 0 )
+        return mips_files_error(err, MIPS_EINVAL);
+    
+    if ( pos > 0x7FFFFFFF )
+        return mips_files_error(err, MIPS_EOVERFLOW);
+    
+    file->offset = pos;
+    
+    return (int32_t)pos;
+}
+
+/*!
+    \brief Close a guest file
+    \return 0 on success, -1 on failure
+*/
+int mips_files_close(MIPS_Files *f, int fd, int *err)
+{
+    MIPS_File *file = mips_files_get(f, fd);
+    
+    if ( file == NULL )
+        return mips_files_error(err, MIPS_EBADF);
+    
+    int ret = close(file->host);
+    
+    file->host = -1;
+    
+    return ret ? mips_files_error(err, mips_files_errno(errno)) : 0;
+}
+
+#else
+
+int mips_files_open(MIPS_Files *f, const char *path, int flags, int *err)
+{
+    (void)f; (void)path; (void)flags;
+    
+    return mips_files_error(err, MIPS_ENOSYS);
+}
+
+int mips_files_read(MIPS_Files *f, int fd, void *d, uint32_t n, int *err)
+{
+    (void)f; (void)fd; (void)d; (void)n;
+    
+    return mips_files_error(err, MIPS_EBADF);
+}
+
+int mips_files_write(MIPS_Files *f, int fd, const void *d, uint32_t n, int *err)
+{
+    (void)f; (void)fd; (void)d; (void)n;
+    
+    return mips_files_error(err, MIPS_EBADF);
+}
+
+int32_t mips_files_lseek(MIPS_Files *f, int fd, int32_t offset, int whence, int *err)
+{
+    (void)f; (void)fd; (void)offset; (void)whence;
+    
+    return mips_files_error(err, MIPS_EBADF);
+}
+
+int mips_files_close(MIPS_Files *f, int fd, int *err)
+{
+    (void)f; (void)fd;
+    
+    return mips_files_error(err, MIPS_EBADF);
+}
+
+#endif
@@ -0,0 +1,85 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+#ifndef _MIPSIM_FILES_H_
+#define _MIPSIM_FILES_H_
+
+/*!
+    \file files.h
+    \brief Guest file descriptors backed by host files
+    \author Hugues Bruant
+    
+    Each simulated machine owns a table mapping guest file descriptors to
+    host files. Guest paths are resolved inside a sandbox directory and
+    flags, offsets and error codes follow newlib conventions.
+*/
+
+#include "mips.h"
+
+/*!
+    \brief Number of guest file descriptors, including the console ones
+*/
+#define MIPS_FILES_MAX      64
+
+/*!
+    \brief Guest file descriptors below this one are bound to the console
+*/
+#define MIPS_FILES_CONSOLE  3
+
+/*!
+    \brief open flags, as defined by newlib
+*/
+enum MIPS_File_Flags {
+    MIPS_O_RDONLY   = 0x0000,
+    MIPS_O_WRONLY   = 0x0001,
+    MIPS_O_RDWR     = 0x0002,
+    MIPS_O_ACCMODE  = 0x0003,
+    MIPS_O_APPEND   = 0x0008,
+    MIPS_O_CREAT    = 0x0200,
+    MIPS_O_TRUNC    = 0x0400,
+    MIPS_O_EXCL     = 0x0800,
+    MIPS_O_SYNC     = 0x2000,
+    MIPS_O_NONBLOCK = 0x4000
+};
+
+/*!
+    \brief errno values, as defined by newlib
+*/
+enum MIPS_File_Errors {
+    MIPS_EPERM          = 1,
+    MIPS_ENOENT         = 2,
+    MIPS_EIO            = 5,
+    MIPS_EBADF          = 9,
+    MIPS_EACCES         = 13,
+    MIPS_EFAULT         = 14,
+    MIPS_EINVAL         = 22,
+    MIPS_EMFILE         = 24,
+    MIPS_ESPIPE         = 29,
+    MIPS_ENOSYS         = 88,
+    MIPS_ENOTEMPTY      = 90,
+    MIPS_ENAMETOOLONG   = 91,
+    MIPS_ELOOP          = 92,
+    MIPS_EOVERFLOW      = 139
+};
+
+MIPS_Files* mips_files_create(const char *root);
+void mips_files_close_all(MIPS_Files *f);
+void mips_files_destroy(MIPS_Files *f);
+
+int mips_files_sandboxed(MIPS_Files *f);
+int mips_files_valid(MIPS_Files *f, int fd);
+
+int mips_files_open(MIPS_Files *f, const char *path, int flags, int *err);
+int mips_files_read(MIPS_Files *f, int fd, void *d, uint32_t n, int *err);
+int mips_files_write(MIPS_Files *f, int fd, const void *d, uint32_t n, int *err);
+int32_t mips_files_lseek(MIPS_Files *f, int fd, int32_t offset, int whence, int *err);
+int mips_files_close(MIPS_Files *f, int fd, int *err);
+
+#endif
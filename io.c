@@ -23,19 +23,187 @@
 #include <string.h>
 #include <stdarg.h>
 
+/*
+    Monitor output is accumulated in a buffer owned by the configuration and
+    written out according to the flush policy (see MIPSIM_Flush_Policy).
+    
+    When an asynchronous writer is configured, output to streams is queued
+    for the writer thread instead of being written by the caller.
+*/
+
+/*!
+    \internal
+    \brief Write to a stream, through the asynchronous writer if any
+*/
+static void mipsim_io_write(MIPSIM_Config *cfg, FILE *f, const char *d, uint32_t len)
+{
+    if ( cfg->writer != NULL )
+        mipsim_writer_put(cfg->writer, f, d, len);
+    else
+        fwrite(d, 1, len, f);
+}
+
+/*!
+    \internal
+    \brief Flush a stream, unless the asynchronous writer takes care of it
+*/
+static void mipsim_io_flush(MIPSIM_Config *cfg, FILE *f)
+{
+    if ( cfg->writer == NULL )
+        fflush(f);
+}
+
 /*!
-    \brief File I/O gateway
+    \internal
+    \brief Hand buffered monitor output over to the monitor stream
+    \param flush whether to also flush the stream
 */
-int mipsim_open (int cxt, const char *path, int flags)
+static void mipsim_mon_sync(MIPSIM_Config *cfg, int flush)
 {
-    (void)cxt; (void)path; (void)flags;
+    if ( cfg->mon_buffer_used )
+    {
+        mipsim_io_write(cfg, cfg->mon_out, cfg->mon_buffer, cfg->mon_buffer_used);
+        cfg->mon_buffer_used = 0;
+    }
     
-    printf("Unexpected gateway open\n");
-    return 0; //open(path, flags);
+    if ( flush )
+        mipsim_io_flush(cfg, cfg->mon_out);
 }
 
 /*!
-    \brief File I/O gateway
+    \internal
+    \brief Append to buffered monitor output
+*/
+static void mipsim_mon_put(MIPSIM_Config *cfg, const char *d, uint32_t len)
+{
+    if ( cfg->mon_buffer == NULL && cfg->mon_buffer_size )
+        cfg->mon_buffer = (char*)malloc(cfg->mon_buffer_size);
+    
+    if ( cfg->mon_buffer == NULL || len > cfg->mon_buffer_size - cfg->mon_buffer_used )
+    {
+        mipsim_mon_sync(cfg, 0);
+        
+        if ( cfg->mon_buffer == NULL || len >= cfg->mon_buffer_size )
+        {
+            // too large to be worth buffering
+            mipsim_io_write(cfg, cfg->mon_out, d, len);
+            mipsim_io_flush(cfg, cfg->mon_out);
+            return;
+        }
+        
+        mipsim_io_flush(cfg, cfg->mon_out);
+    }
+    
+    memcpy(cfg->mon_buffer + cfg->mon_buffer_used, d, len);
+    cfg->mon_buffer_used += len;
+    
+    if ( (cfg->mon_flush & FLUSH_NEWLINE) && memchr(d, '\n', len) != NULL )
+        mipsim_mon_sync(cfg, 1);
+}
+
+/*!
+    \internal
+    \brief Format output for a stream, or for the monitor buffer if f is NULL
+*/
+static int mipsim_io_vprintf(MIPSIM_Config *cfg, FILE *f, const char *fmt, va_list args)
+{
+    char buffer[256];
+    va_list copy;
+    va_copy(copy, args);
+    
+    int ret = vsnprintf(buffer, sizeof(buffer), fmt, args);
+    char *s = buffer;
+    
+    if ( ret >= (int)sizeof(buffer) )
+    {
+        s = (char*)malloc(ret + 1);
+        
+        if ( s != NULL )
+            vsnprintf(s, ret + 1, fmt, copy);
+    }
+    
+    va_end(copy);
+    
+    if ( s != NULL && ret > 0 )
+    {
+        if ( f != NULL )
+            mipsim_io_write(cfg, f, s, ret);
+        else
+            mipsim_mon_put(cfg, s, ret);
+    }
+    
+    if ( s != buffer )
+        free(s);
+    
+    return ret;
+}
+
+/*!
+    \brief Write out buffered output
+    \param cxt I/O context
+    \param event flush event (see MIPSIM_Flush_Policy), 0 to flush unconditionally
+    
+    Asynchronous output is waited for when the machine stops, whatever the
+    flush policy, so that logs are complete whenever the machine is stopped.
+*/
+void mipsim_flush(int cxt, int event)
+{
+    MIPSIM_Config *cfg = mipsim_config();
+    
+    if ( cxt == IO_MONITOR && (!event || (cfg->mon_flush & event)) )
+        mipsim_mon_sync(cfg, 1);
+    
+    if ( cfg->writer != NULL && (!event || event == FLUSH_STOP || (event & cfg->mon_flush & FLUSH_INPUT)) )
+        mipsim_writer_sync(cfg->writer);
+}
+
+/*!
+    \brief Parse a flush policy
+    \param s comma-separated list of events among newline, full, stop and input
+    \return flush policy, -1 on error
+*/
+int mipsim_flush_policy(const char *s)
+{
+    static const struct {
+        const char *name;
+        int event;
+    } events[] = {
+        { "full",    FLUSH_FULL    },
+        { "newline", FLUSH_NEWLINE },
+        { "stop",    FLUSH_STOP    },
+        { "input",   FLUSH_INPUT   }
+    };
+    
+    int policy = 0;
+    
+    while ( *s )
+    {
+        size_t len = strcspn(s, ",");
+        size_t i = 0;
+        
+        while ( i < sizeof(events) / sizeof(events[0])
+            && (strlen(events[i].name) != len || strncmp(events[i].name, s, len)) )
+            ++i;
+        
+        if ( i == sizeof(events) / sizeof(events[0]) )
+            return -1;
+        
+        policy |= events[i].event;
+        s += len;
+        
+        if ( *s == ',' )
+            ++s;
+    }
+    
+    return policy;
+}
+
+/*!
+    \brief Console input gateway
+    \return number of bytes read
+    
+    Like a terminal, reads stop at the end of a line so that the guest and
+    the shell can share the same input stream.
 */
 int mipsim_read (int cxt, int file, char *d, int len)
 {
@@ -43,12 +211,20 @@ int mipsim_read (int cxt, int file, char *d, int len)
     {
         if ( file == 0 )
         {
-            char *ret = fgets(d, len, mipsim_config()->mon_in);
+            mipsim_flush(IO_MONITOR, FLUSH_INPUT);
             
-            // remove extra LF
-            // d[strlen(d) < (unsigned int)len ? strlen(d) : (unsigned int)len - 1] = 0;
+            FILE *in = mipsim_config()->mon_in;
+            int n = 0, c;
             
-            return ret != NULL;
+            while ( n < len && (c = fgetc(in)) != EOF )
+            {
+                d[n++] = c;
+                
+                if ( c == '\n' )
+                    break;
+            }
+            
+            return n;
         } else {
             printf("Unexpected monitor read on fd %d\n", file);
         }
@@ -60,38 +236,44 @@ int mipsim_read (int cxt, int file, char *d, int len)
 }
 
 /*!
-    \brief File I/O gateway
+    \brief Console input gateway
+    \return whether a string was read
+    
+    Reads a line with fgets semantics : at most len - 1 bytes and a terminator.
 */
-int mipsim_write(int cxt, int file, char *d, int len)
+int mipsim_gets(int cxt, char *d, int len)
 {
     if ( cxt == IO_MONITOR )
     {
-        (void)file;
+        mipsim_flush(IO_MONITOR, FLUSH_INPUT);
         
-        int ret = fwrite(d, sizeof(char), len, mipsim_config()->mon_out);
-        fflush(mipsim_config()->mon_out);
-        return ret;
+        return fgets(d, len, mipsim_config()->mon_in) != NULL;
     } else {
-        printf("Unexpected gateway write\n");
+        printf("Unexpected gateway gets\n");
     }
     
     return 0;
 }
 
 /*!
-    \brief File I/O gateway
+    \brief Console output gateway
 */
-int mipsim_close(int cxt, int file)
+int mipsim_write(int cxt, int file, char *d, int len)
 {
     if ( cxt == IO_MONITOR )
     {
-        if ( file < 0 || file > 3 )
-            printf("Unexpected monitor close\n");
+        (void)file;
+        
+        if ( len <= 0 )
+            return 0;
+        
+        mipsim_mon_put(mipsim_config(), d, len);
+        return len;
     } else {
-        printf("Unexpected gateway close\n");
+        printf("Unexpected gateway write\n");
     }
     
-    return 0; //close(file);
+    return 0;
 }
 
 /*!
@@ -101,6 +283,8 @@ char mipsim_inbyte (int cxt)
 {
     if ( cxt == IO_MONITOR )
     {
+        mipsim_flush(IO_MONITOR, FLUSH_INPUT);
+        
         return fgetc(mipsim_config()->mon_in);
     } else {
         printf("Unexpected gateway inbyte\n");
@@ -116,7 +300,7 @@ void mipsim_outbyte(int cxt, char c)
 {
     if ( cxt == IO_MONITOR )
     {
-        fputc(c, mipsim_config()->mon_in);
+        mipsim_mon_put(mipsim_config(), &c, 1);
     } else {
         printf("Unexpected gateway outbyte\n");
     }
@@ -138,22 +322,37 @@ int mipsim_printf(int cxt, const char *fmt, ...)
     va_list args;
     va_start(args, fmt);
     
+    // keep monitor output in order with anything else sharing its stream
+    if ( cxt != IO_MONITOR && cfg->mon_buffer_used )
+        mipsim_mon_sync(cfg, 0);
+    
     switch ( cxt )
     {
         case IO_MONITOR :
-            vfprintf(cfg->mon_out, fmt, args);
+            ret = mipsim_io_vprintf(cfg, NULL, fmt, args);
+            break;
             
         case IO_TRACE :
             if ( cfg->io_mask & IO_TRACE )
-                ret = cfg->trace_log != NULL ? vfprintf(cfg->trace_log, fmt, args) : vprintf(fmt, args);
+            {
+                FILE *f = cfg->trace_log != NULL ? cfg->trace_log : stdout;
+                ret = cfg->writer != NULL ? mipsim_io_vprintf(cfg, f, fmt, args) : vfprintf(f, fmt, args);
+            }
             break;
             
         case IO_DEBUG :
             if ( cfg->io_mask & IO_DEBUG )
-                ret = cfg->debug_log != NULL ? vfprintf(cfg->debug_log, fmt, args) : vprintf(fmt, args);
+            {
+                FILE *f = cfg->debug_log != NULL ? cfg->debug_log : stdout;
+                ret = cfg->writer != NULL ? mipsim_io_vprintf(cfg, f, fmt, args) : vfprintf(f, fmt, args);
+            }
             break;
             
         default:
+            // warnings are rare and expected to show up right away
+            if ( cfg->writer != NULL )
+                mipsim_writer_sync(cfg->writer);
+            
             ret = vprintf(fmt, args);
             break;
     }
@@ -17,6 +17,8 @@
     \author Hugues Bruant
 */
 
+#include "config.h"
+
 enum MIPSIM_IO_Context {
     IO_NULL,
     IO_WARNING  = 1,
@@ -25,14 +27,46 @@ enum MIPSIM_IO_Context {
     IO_MONITOR  = 8
 };
 
-int mipsim_open (int cxt, const char *path, int flags);
+/*!
+    \brief Events upon which buffered monitor output is written out
+    
+    Monitor output is always written out when the buffer fills up, FLUSH_FULL
+    alone therefore gives the largest writes.
+*/
+enum MIPSIM_Flush_Policy {
+    FLUSH_FULL      = 0,
+    FLUSH_NEWLINE   = 1,
+    FLUSH_STOP      = 2,
+    FLUSH_INPUT     = 4
+};
+
 int mipsim_read (int cxt, int file, char *d, int len);
+int mipsim_gets (int cxt, char *d, int len);
 int mipsim_write(int cxt, int file, char *d, int len);
-int mipsim_close(int cxt, int file);
 
 char mipsim_inbyte (int cxt);
 void mipsim_outbyte(int cxt, char c);
 
 int mipsim_printf(int cxt, const char *fmt, ...);
 
+void mipsim_flush(int cxt, int event);
+int mipsim_flush_policy(const char *s);
+
+/*!
+    \brief Whether trace output is enabled
+    
+    Building with MIPSIM_NO_TRACE defined compiles tracing out entirely.
+*/
+#ifdef MIPSIM_NO_TRACE
+#define mipsim_tracing() 0
+#else
+#define mipsim_tracing() (mipsim_config()->io_mask & IO_TRACE)
+#endif
+
+/*!
+    \brief Trace output, arguments are only evaluated when tracing is enabled
+*/
+#define mipsim_trace(...) \
+    do { if ( mipsim_tracing() ) mipsim_printf(IO_TRACE, __VA_ARGS__); } while ( 0 )
+
 #endif
@@ -0,0 +1,867 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+// MAP_ANONYMOUS is not part of C99/POSIX
+#define _DEFAULT_SOURCE
+
+#include "decode.h"
+
+/*!
+    \file jit.c
+    \brief x86-64 dynamic binary translator
+    \author Hugues Bruant
+*/
+
+#include "io.h"
+#include "config.h"
+#include "mips_p.h"
+#include "trace.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+int decode_sb      (MIPS *m, uint32_t ir);
+int decode_sh      (MIPS *m, uint32_t ir);
+int decode_sw      (MIPS *m, uint32_t ir);
+
+enum {
+    JIT_CACHE_SIZE = 8 << 20,
+    JIT_HASH_SIZE  = 4096,
+    
+    // executions of a block before it gets translated
+    JIT_HOT        = 16,
+    
+    // instructions per block and upper bound of host code per instruction
+    JIT_BLOCK_MAX  = 64,
+    JIT_INSN_MAX   = 128
+};
+
+/*
+    host registers
+*/
+enum {
+    EAX,
+    ECX
+};
+
+#define P_PC        offsetof(MIPS_Processor_Private, pc)
+#define P_HI        offsetof(MIPS_Processor_Private, hi)
+#define P_LO        offsetof(MIPS_Processor_Private, lo)
+#define P_R(n)      (offsetof(MIPS_Processor_Private, r) + (n) * sizeof(MIPS_Native))
+
+#define M_BUDGET    offsetof(MIPS, budget)
+#define M_STOP      offsetof(MIPS, stop_reason)
+
+/*!
+    \internal
+    \brief Direct exit of a translated block, patched once its target is translated
+*/
+typedef struct _JIT_Exit {
+    MIPS_Addr target;
+    uint8_t *patch;
+} JIT_Exit;
+
+typedef struct _JIT_Block JIT_Block;
+
+struct _JIT_Block {
+    MIPS_Addr pc;
+    
+    uint32_t count;
+    uint32_t units;
+    int nojit;
+    
+    uint8_t *code;
+    
+    int nexits;
+    JIT_Exit exit[2];
+    
+    JIT_Block *next;
+};
+
+typedef JIT_Exit* (*jit_enter)(MIPS_Processor_Private *p, MIPS *m, const uint8_t *code);
+
+/*!
+    \brief Translation cache of a simulated machine
+    
+    Host code lives in a single executable mapping, starting with the
+    trampoline used to enter translated code. Blocks are indexed by guest
+    address and dropped all at once when the cache is full or when guest
+    code is modified.
+*/
+struct _MIPS_JIT {
+    uint8_t *cache;
+    uint8_t *ptr;
+    uint8_t *start;
+    uint8_t *epilogue;
+    
+    jit_enter enter;
+    
+    uint32_t generation;
+    const uint32_t *generation_ptr;
+    
+    JIT_Block *hash[JIT_HASH_SIZE];
+};
+
+static void emit8(MIPS_JIT *j, uint8_t b)
+{
+    *j->ptr++ = b;
+}
+
+static void emit32(MIPS_JIT *j, uint32_t v)
+{
+    memcpy(j->ptr, &v, 4);
+    j->ptr += 4;
+}
+
+static void emit64(MIPS_JIT *j, uint64_t v)
+{
+    memcpy(j->ptr, &v, 8);
+    j->ptr += 8;
+}
+
+/*!
+    \internal
+    \brief Emit the 32bit displacement of a jump to a given host address
+*/
+static void emit_rel32(MIPS_JIT *j, const uint8_t *target)
+{
+    emit32(j, (uint32_t)(int32_t)(target - (j->ptr + 4)));
+}
+
+/*!
+    \internal
+    \brief Resolve a short forward jump emitted earlier
+*/
+static void emit_label(MIPS_JIT *j, uint8_t *jcc)
+{
+    jcc[1] = (uint8_t)(j->ptr - (jcc + 2));
+}
+
+// mov reg, [rbx + off]
+static void emit_load(MIPS_JIT *j, int reg, uint32_t off)
+{
+    emit8(j, 0x8B);
+    emit8(j, 0x83 | (reg << 3));
+    emit32(j, off);
+}
+
+// mov [rbx + off], eax
+static void emit_store(MIPS_JIT *j, uint32_t off)
+{
+    emit8(j, 0x89);
+    emit8(j, 0x83);
+    emit32(j, off);
+}
+
+// mov dword [rbx + off], imm
+static void emit_store_imm(MIPS_JIT *j, uint32_t off, uint32_t imm)
+{
+    emit8(j, 0xC7);
+    emit8(j, 0x83);
+    emit32(j, off);
+    emit32(j, imm);
+}
+
+// add/sub/cmp dword [rbp + off], imm
+static void emit_machine_op(MIPS_JIT *j, int ext, uint32_t off, uint32_t imm)
+{
+    emit8(j, 0x81);
+    emit8(j, 0x85 | (ext << 3));
+    emit32(j, off);
+    emit32(j, imm);
+}
+
+// setcc al ; movzx eax, al
+static void emit_setcc(MIPS_JIT *j, uint8_t cc)
+{
+    emit8(j, 0x0F);
+    emit8(j, cc);
+    emit8(j, 0xC0);
+    emit8(j, 0x0F);
+    emit8(j, 0xB6);
+    emit8(j, 0xC0);
+}
+
+/*!
+    \internal
+    \brief Leave translated code, without chaining
+    \param refund instructions accounted for but not executed
+*/
+static void emit_leave(MIPS_JIT *j, uint32_t refund)
+{
+    if ( refund )
+        emit_machine_op(j, 0, M_BUDGET, refund);
+    
+    // xor eax, eax ; jmp epilogue
+    emit8(j, 0x31);
+    emit8(j, 0xC0);
+    emit8(j, 0xE9);
+    emit_rel32(j, j->epilogue);
+}
+
+/*!
+    \internal
+    \brief Leave translated code to a known guest address
+    \param chain whether the exit may later be chained to the target block
+*/
+static void emit_exit(MIPS_JIT *j, JIT_Block *b, MIPS_Addr target, int chain)
+{
+    emit_store_imm(j, P_PC, target);
+    
+    if ( !chain )
+    {
+        emit_leave(j, 0);
+        return;
+    }
+    
+    JIT_Exit *x = &b->exit[b->nexits++];
+    
+    x->target = target;
+    x->patch = j->ptr;
+    
+    // mov rax, x ; jmp epilogue
+    emit8(j, 0x48);
+    emit8(j, 0xB8);
+    emit64(j, (uint64_t)(uintptr_t)x);
+    emit8(j, 0xE9);
+    emit_rel32(j, j->epilogue);
+}
+
+/*!
+    \internal
+    \brief Translate an instruction executed inline (see mips_decoded_op)
+*/
+static void emit_alu(MIPS_JIT *j, const MIPS_Decoded *d, int op)
+{
+    static const uint8_t shift[] = { 0xE0, 0xE8, 0xF8 };
+    static const uint8_t alu[] = { 0x01, 0x29, 0x21, 0x09, 0x31, 0x09 };
+    static const uint8_t alu_imm[] = { 0x25, 0x0D, 0x35 };
+    
+    // writes to $0 have no effect
+    if ( (op < OP_ADDIU ? d->rd : d->rt) == 0 )
+        return;
+    
+    switch ( op )
+    {
+        case OP_SLL :
+        case OP_SRL :
+        case OP_SRA :
+            emit_load(j, EAX, P_R(d->rt));
+            emit8(j, 0xC1);
+            emit8(j, shift[op - OP_SLL]);
+            emit8(j, d->sh);
+            emit_store(j, P_R(d->rd));
+            break;
+        
+        case OP_SLLV :
+        case OP_SRLV :
+        case OP_SRAV :
+            emit_load(j, EAX, P_R(d->rt));
+            emit_load(j, ECX, P_R(d->rs));
+            emit8(j, 0xD3);
+            emit8(j, shift[op - OP_SLLV]);
+            emit_store(j, P_R(d->rd));
+            break;
+        
+        case OP_ADDU :
+        case OP_SUBU :
+        case OP_AND :
+        case OP_OR :
+        case OP_XOR :
+        case OP_NOR :
+            emit_load(j, EAX, P_R(d->rs));
+            emit_load(j, ECX, P_R(d->rt));
+            emit8(j, alu[op - OP_ADDU]);
+            emit8(j, 0xC8);
+            
+            if ( op == OP_NOR )
+            {
+                // not eax
+                emit8(j, 0xF7);
+                emit8(j, 0xD0);
+            }
+            
+            emit_store(j, P_R(d->rd));
+            break;
+        
+        case OP_SLT :
+        case OP_SLTU :
+            emit_load(j, EAX, P_R(d->rs));
+            emit_load(j, ECX, P_R(d->rt));
+            emit8(j, 0x39);
+            emit8(j, 0xC8);
+            emit_setcc(j, op == OP_SLT ? 0x9C : 0x92);
+            emit_store(j, P_R(d->rd));
+            break;
+        
+        case OP_MFHI :
+        case OP_MFLO :
+            emit_load(j, EAX, op == OP_MFHI ? P_HI : P_LO);
+            emit_store(j, P_R(d->rd));
+            break;
+        
+        case OP_ADDIU :
+            emit_load(j, EAX, P_R(d->rs));
+            emit8(j, 0x05);
+            emit32(j, (uint32_t)d->imm);
+            emit_store(j, P_R(d->rt));
+            break;
+        
+        case OP_SLTI :
+        case OP_SLTIU :
+            emit_load(j, EAX, P_R(d->rs));
+            emit8(j, 0x3D);
+            emit32(j, (uint32_t)d->imm);
+            emit_setcc(j, op == OP_SLTI ? 0x9C : 0x92);
+            emit_store(j, P_R(d->rt));
+            break;
+        
+        case OP_ANDI :
+        case OP_ORI :
+        case OP_XORI :
+            emit_load(j, EAX, P_R(d->rs));
+            emit8(j, alu_imm[op - OP_ANDI]);
+            emit32(j, d->ir & IMM_MASK);
+            emit_store(j, P_R(d->rt));
+            break;
+        
+        case OP_LUI :
+            emit_store_imm(j, P_R(d->rt), (uint32_t)d->imm << 16);
+            break;
+        
+        default:
+            break;
+    }
+}
+
+/*!
+    \internal
+    \brief Translate a call to the handler of an instruction
+    \param next guest address following the instruction
+*/
+static void emit_call(MIPS_JIT *j, const MIPS_Decoded *d, MIPS_Addr next)
+{
+    // handlers may stop the simulation : PC must be up to date
+    emit_store_imm(j, P_PC, next);
+    
+    // mov rdi, rbp ; mov esi, ir ; mov rax, handler ; call rax
+    emit8(j, 0x48);
+    emit8(j, 0x89);
+    emit8(j, 0xEF);
+    emit8(j, 0xBE);
+    emit32(j, d->ir);
+    emit8(j, 0x48);
+    emit8(j, 0xB8);
+    emit64(j, (uint64_t)(uintptr_t)d->decode);
+    emit8(j, 0xFF);
+    emit8(j, 0xD0);
+}
+
+static int is_store(const MIPS_Decoded *d)
+{
+    return d->decode == decode_sb || d->decode == decode_sh || d->decode == decode_sw;
+}
+
+/*!
+    \internal
+    \brief Translate an instruction that is not part of a delay slot
+    \param a guest address of the instruction
+    \param refund instructions of the block following this one
+*/
+static void emit_insn(MIPS_JIT *j, const MIPS_Decoded *d, int op, MIPS_Addr a, uint32_t refund)
+{
+    if ( op != OP_CALL )
+    {
+        emit_alu(j, d, op);
+        return;
+    }
+    
+    emit_call(j, d, a + 4);
+    
+    // test eax, eax ; jz ok
+    emit8(j, 0x85);
+    emit8(j, 0xC0);
+    uint8_t *ok = j->ptr;
+    emit8(j, 0x74);
+    emit8(j, 0);
+    
+    // errors do not necessarily stop the simulation
+    // cmp dword [rbp + stop_reason], 0 ; je ok
+    emit8(j, 0x83);
+    emit8(j, 0xBD);
+    emit32(j, M_STOP);
+    emit8(j, 0);
+    uint8_t *running = j->ptr;
+    emit8(j, 0x74);
+    emit8(j, 0);
+    
+    emit_leave(j, refund);
+    
+    emit_label(j, ok);
+    emit_label(j, running);
+    
+    if ( is_store(d) )
+    {
+        // self-modifying code : leave if predecoded instructions were dropped
+        // mov rax, &generation ; cmp dword [rax], generation ; je ok
+        emit8(j, 0x48);
+        emit8(j, 0xB8);
+        emit64(j, (uint64_t)(uintptr_t)j->generation_ptr);
+        emit8(j, 0x81);
+        emit8(j, 0x38);
+        emit32(j, j->generation);
+        ok = j->ptr;
+        emit8(j, 0x74);
+        emit8(j, 0);
+        
+        emit_leave(j, refund);
+        
+        emit_label(j, ok);
+    }
+}
+
+/*!
+    \internal
+    \brief Translate a branch and its delay slot, ending a block
+    \param a guest address of the branch
+*/
+static void emit_branch(MIPS_JIT *j, JIT_Block *b, const MIPS_Decoded *d, int op, MIPS_Addr a)
+{
+    const MIPS_Decoded *s = d + 1;
+    const int slot = mips_decoded_op(s, 1);
+    
+    // condition and link are evaluated before the delay slot, condition kept in r14d
+    if ( op == OP_BEQ || op == OP_BLEZ || op == OP_BLTZ )
+    {
+        emit_load(j, EAX, P_R(d->rs));
+        
+        if ( op == OP_BEQ )
+        {
+            // cmp eax, ecx
+            emit_load(j, ECX, P_R(d->rt));
+            emit8(j, 0x39);
+            emit8(j, 0xC8);
+            emit_setcc(j, d->ir & 0x04000000 ? 0x95 : 0x94);
+        } else {
+            // cmp eax, 0
+            emit8(j, 0x83);
+            emit8(j, 0xF8);
+            emit8(j, 0x00);
+            
+            if ( op == OP_BLEZ )
+                emit_setcc(j, d->ir & 0x04000000 ? 0x9F : 0x9E);
+            else
+                emit_setcc(j, d->ir & 0x00010000 ? 0x9D : 0x9C);
+        }
+        
+        // mov r14d, eax
+        emit8(j, 0x41);
+        emit8(j, 0x89);
+        emit8(j, 0xC6);
+        
+        if ( op == OP_BLTZ && (d->ir & 0x00100000) )
+        {
+            // link if taken : test r14d, r14d ; jz skip
+            emit8(j, 0x45);
+            emit8(j, 0x85);
+            emit8(j, 0xF6);
+            uint8_t *skip = j->ptr;
+            emit8(j, 0x74);
+            emit8(j, 0);
+            
+            emit_store_imm(j, P_R(31), a + 8);
+            
+            emit_label(j, skip);
+        }
+    } else if ( op == OP_JR ) {
+        // target is read before linking, kept in r14d : and eax, ~3 ; mov r14d, eax
+        emit_load(j, EAX, P_R(d->rs));
+        emit8(j, 0x83);
+        emit8(j, 0xE0);
+        emit8(j, 0xFC);
+        emit8(j, 0x41);
+        emit8(j, 0x89);
+        emit8(j, 0xC6);
+        
+        if ( (d->ir & 1) && d->rd )
+            emit_store_imm(j, P_R(d->rd), a + 8);
+    } else if ( op == OP_J && (d->ir & 0x04000000) ) {
+        emit_store_imm(j, P_R(31), a + 8);
+    }
+    
+    if ( slot == OP_CALL )
+    {
+        emit_call(j, s, a + 8);
+        
+        // a failing delay slot cancels the branch
+        // test eax, eax ; jz ok
+        emit8(j, 0x85);
+        emit8(j, 0xC0);
+        uint8_t *ok = j->ptr;
+        emit8(j, 0x74);
+        emit8(j, 0);
+        
+        emit_leave(j, 0);
+        
+        emit_label(j, ok);
+    } else {
+        emit_alu(j, s, slot);
+    }
+    
+    // stores in delay slots may alter the targets : do not chain
+    const int chain = !(slot == OP_CALL && is_store(s));
+    
+    if ( op == OP_J )
+    {
+        emit_exit(j, b, ((a + 8) & 0xF0000000) | ((d->ir & ADDR_MASK) << 2), chain);
+    } else if ( op == OP_JR ) {
+        // mov [rbx + pc], r14d
+        emit8(j, 0x44);
+        emit8(j, 0x89);
+        emit8(j, 0xB3);
+        emit32(j, P_PC);
+        emit_leave(j, 0);
+    } else {
+        // test r14d, r14d ; jz not_taken
+        emit8(j, 0x45);
+        emit8(j, 0x85);
+        emit8(j, 0xF6);
+        emit8(j, 0x0F);
+        emit8(j, 0x84);
+        uint8_t *not_taken = j->ptr;
+        emit32(j, 0);
+        
+        emit_exit(j, b, a + 4 + ((uint32_t)d->imm << 2), chain);
+        
+        uint32_t rel = (uint32_t)(j->ptr - (not_taken + 4));
+        memcpy(not_taken, &rel, 4);
+        
+        emit_exit(j, b, a + 8, chain);
+    }
+}
+
+/*!
+    \internal
+    \brief Translate a block of guest code
+    \return 1 on success, 0 if the block may be translated later, -1 if it never will
+    
+    A block spans instructions supported by the fast engines, within a
+    single page, up to and including the first branch and its delay slot.
+*/
+static int jit_translate(MIPS *m, MIPS_JIT *j, JIT_Block *b)
+{
+    MIPS_Decoded *base = mips_icache_page(m, b->pc);
+    
+    if ( base == NULL )
+        return 0;
+    
+    const int first = (b->pc >> 2) & (ICACHE_PAGE_WORDS - 1);
+    
+    int op = OP_SLOW;
+    uint32_t n = 0;
+    
+    while ( first + n < ICACHE_PAGE_WORDS && n < JIT_BLOCK_MAX )
+    {
+        op = mips_decoded_op(base + first + n, first + n == ICACHE_PAGE_WORDS - 1);
+        
+        if ( op < 0 || op == OP_SLOW )
+            break;
+        
+        ++n;
+        
+        if ( op >= OP_BRANCH )
+            break;
+    }
+    
+    if ( !n )
+        return op < 0 ? 0 : -1;
+    
+    b->code = j->ptr;
+    b->units = n;
+    b->nexits = 0;
+    
+    // budget check : cmp [rbp + budget], n ; jb nobudget ; sub [rbp + budget], n
+    emit_machine_op(j, 7, M_BUDGET, n);
+    emit8(j, 0x0F);
+    emit8(j, 0x82);
+    uint8_t *nobudget = j->ptr;
+    emit32(j, 0);
+    emit_machine_op(j, 5, M_BUDGET, n);
+    
+    MIPS_Addr a = b->pc;
+    
+    for ( uint32_t i = 0; i < n; ++i, a += 4 )
+    {
+        const MIPS_Decoded *d = base + first + i;
+        
+        op = mips_decoded_op(d, first + i == ICACHE_PAGE_WORDS - 1);
+        
+        if ( op >= OP_BRANCH )
+        {
+            emit_branch(j, b, d, op, a);
+            break;
+        }
+        
+        emit_insn(j, d, op, a, n - i - 1);
+    }
+    
+    if ( op < OP_BRANCH )
+        emit_exit(j, b, a, 1);
+    
+    uint32_t rel = (uint32_t)(j->ptr - (nobudget + 4));
+    memcpy(nobudget, &rel, 4);
+    
+    emit_leave(j, 0);
+    
+    return 1;
+}
+
+/*!
+    \internal
+    \brief Drop all translated code
+*/
+static void jit_flush(MIPS_JIT *j)
+{
+    for ( int i = 0; i < JIT_HASH_SIZE; ++i )
+    {
+        JIT_Block *b = j->hash[i];
+        
+        while ( b != NULL )
+        {
+            JIT_Block *n = b->next;
+            free(b);
+            b = n;
+        }
+        
+        j->hash[i] = NULL;
+    }
+    
+    j->ptr = j->start;
+}
+
+/*!
+    \internal
+    \brief Locate the block starting at a given guest address
+    \param create whether to create missing blocks
+    \return block, NULL if missing and not created or out of memory
+*/
+static JIT_Block* jit_block(MIPS_JIT *j, MIPS_Addr pc, int create)
+{
+    JIT_Block **h = &j->hash[(pc >> 2) & (JIT_HASH_SIZE - 1)];
+    JIT_Block *b = *h;
+    
+    while ( b != NULL && b->pc != pc )
+        b = b->next;
+    
+    if ( b == NULL && create )
+    {
+        b = calloc(1, sizeof(JIT_Block));
+        
+        if ( b == NULL )
+            return NULL;
+        
+        b->pc = pc;
+        b->next = *h;
+        *h = b;
+    }
+    
+    return b;
+}
+
+/*!
+    \internal
+    \brief Create the translation cache of a machine
+    \return translation cache, NULL if no executable memory could be obtained
+*/
+static MIPS_JIT* jit_create(MIPS *m)
+{
+    uint8_t *cache = mmap(NULL, JIT_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    
+    if ( cache == MAP_FAILED )
+    {
+        mipsim_printf(IO_WARNING, "JIT: unable to map code cache\n");
+        return NULL;
+    }
+    
+    MIPS_JIT *j = calloc(1, sizeof(MIPS_JIT));
+    
+    if ( j == NULL )
+    {
+        munmap(cache, JIT_CACHE_SIZE);
+        return NULL;
+    }
+    
+    j->cache = j->ptr = cache;
+    j->generation_ptr = mips_icache_generation(m);
+    j->generation = *j->generation_ptr;
+    
+    /*
+        trampoline : rdi = processor state, rsi = machine, rdx = code
+        
+        push rbx ; push rbp ; push r14 ; mov rbx, rdi ; mov rbp, rsi ; jmp rdx
+    */
+    j->enter = (jit_enter)(uintptr_t)j->ptr;
+    
+    static const uint8_t prologue[] = {
+        0x53, 0x55, 0x41, 0x56, 0x48, 0x89, 0xFB, 0x48, 0x89, 0xF5, 0xFF, 0xE2
+    };
+    
+    memcpy(j->ptr, prologue, sizeof(prologue));
+    j->ptr += sizeof(prologue);
+    
+    // pop r14 ; pop rbp ; pop rbx ; ret
+    j->epilogue = j->ptr;
+    
+    static const uint8_t epilogue[] = {
+        0x41, 0x5E, 0x5D, 0x5B, 0xC3
+    };
+    
+    memcpy(j->ptr, epilogue, sizeof(epilogue));
+    j->ptr += sizeof(epilogue);
+    
+    j->start = j->ptr;
+    
+    return j;
+}
+
+/*!
+    \internal
+    \brief Release all memory used by a translation cache
+*/
+void mips_jit_destroy(MIPS_JIT *j)
+{
+    if ( j == NULL )
+        return;
+    
+    jit_flush(j);
+    munmap(j->cache, JIT_CACHE_SIZE);
+    free(j);
+}
+
+/*!
+    \internal
+    \brief Dynamic binary translation engine
+    \param m simulated machine
+    \return stop reason
+    
+    Blocks are interpreted by the universal engine until they have been
+    executed JIT_HOT times, after which they are translated to host code.
+    Translated blocks jump directly to each other once both are known.
+    
+    Defers to the universal engine when tracing or when breakpoints are
+    set, as well as for any instruction it does not translate (syscall,
+    monitor entry points, coprocessors, ...).
+*/
+int mips_jit_decode(MIPS *m)
+{
+    if ( m->breakpoints != NULL || mipsim_tracing() || mips_trace_on() )
+        return mips_universal_decode(m);
+    
+    if ( m->jit == NULL && (m->jit = jit_create(m)) == NULL )
+    {
+        // no executable memory : stick to the universal engine
+        m->decode = mips_universal_decode;
+        return mips_universal_decode(m);
+    }
+    
+    MIPS_JIT *j = m->jit;
+    MIPS_Processor_Private *p = (MIPS_Processor_Private*)m->hw.d;
+    
+    if ( !m->budget )
+        m->budget = 1;
+    
+    int leader = 1;
+    
+    while ( m->stop_reason == MIPS_OK && m->budget )
+    {
+        if ( *j->generation_ptr != j->generation )
+        {
+            // guest code was modified
+            jit_flush(j);
+            j->generation = *j->generation_ptr;
+        }
+        
+        const MIPS_Addr pc = p->pc;
+        JIT_Block *b = NULL;
+        
+        if ( leader && !(pc & 3) )
+        {
+            // out of memory : the instruction is interpreted
+            b = jit_block(j, pc, 1);
+            
+            if ( b != NULL && b->code == NULL && !b->nojit && ++b->count >= JIT_HOT )
+            {
+                if ( j->ptr + (JIT_BLOCK_MAX + 8) * JIT_INSN_MAX > j->cache + JIT_CACHE_SIZE )
+                {
+                    jit_flush(j);
+                    b = jit_block(j, pc, 1);
+                }
+                
+                int ret = b != NULL ? jit_translate(m, j, b) : 0;
+                
+                if ( ret < 0 )
+                    b->nojit = 1;
+                else if ( ret == 0 && b != NULL )
+                    b->count = 0;
+            }
+            
+            if ( b != NULL && b->code != NULL && m->budget >= b->units )
+            {
+                JIT_Exit *x = j->enter(p, m, b->code);
+                
+                if ( x != NULL && *j->generation_ptr == j->generation )
+                {
+                    JIT_Block *t = jit_block(j, x->target, 0);
+                    
+                    if ( t != NULL && t->code != NULL )
+                    {
+                        // chain : jmp target
+                        uint8_t *c = x->patch;
+                        int32_t rel = (int32_t)(t->code - (c + 5));
+                        
+                        c[0] = 0xE9;
+                        memcpy(c + 1, &rel, 4);
+                    }
+                }
+                
+                continue;
+            }
+        }
+        
+        mips_universal_decode(m);
+        
+        leader = p->pc != pc + 4 || (b != NULL && b->nojit);
+    }
+    
+    return m->stop_reason;
+}
+
+#else
+
+/*
+    no translator for this host : behave as the universal engine
+*/
+
+int mips_jit_decode(MIPS *m)
+{
+    return mips_universal_decode(m);
+}
+
+void mips_jit_destroy(MIPS_JIT *j)
+{
+    (void)j;
+}
+
+#endif
@@ -0,0 +1,23 @@
+TEMPLATE = lib
+
+TARGET = mipsim
+
+CONFIG += debug
+CONFIG -= qt
+
+OBJECTS_DIR = .obj/lib
+
+QMAKE_CFLAGS += -std=c99 -Wextra
+LIBS += -lpthread
+
+notrace {
+    DEFINES += MIPSIM_NO_TRACE
+}
+
+!staticlib {
+    QMAKE_CFLAGS += -fvisibility=hidden
+    DEFINES += MIPSIM_SHARED
+}
+
+HEADERS += mipsim.h version.h util.h config.h io.h elffile.h mipself.h mips.h mips_p.h  decode.h monitor.h files.h writer.h batch.h trace.h
+SOURCES += mipsim.c util.c config.c io.c elffile.c mipself.c mips.c mips_p.c decode.c threaded.c jit.c memory.c memflat.c monitor.c files.c writer.c batch.c trace.c
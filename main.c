@@ -17,7 +17,9 @@
 */
 
 #include "config.h"
+#include "io.h"
 #include "shell.h"
+#include "batch.h"
 
 void version()
 {
@@ -45,15 +47,43 @@ int main(int argc, char **argv)
         return 0;
     }
     
-    /*
-        Launch shell
-    */
-    mipsim_shell(argc, argv);
+    int ret = 0;
+    MIPSIM_Config *cfg = mipsim_config();
+    
+    if ( cfg->batch_file != NULL )
+    {
+        /*
+            Run jobs without any interaction
+        */
+        ret = mipsim_batch(cfg, cfg->batch_file, cfg->batch_threads);
+    } else if ( cfg->headless ) {
+        /*
+            Run the program given by the first leftover cli param
+        */
+        const char *program = NULL;
+        
+        for ( int i = 1; i < argc && program == NULL; ++i )
+            if ( *argv[i] )
+                program = argv[i];
+        
+        if ( program != NULL )
+        {
+            ret = mipsim_headless(cfg, program);
+        } else {
+            mipsim_printf(IO_WARNING, "CLI: no program to run\n");
+            ret = 126;
+        }
+    } else {
+        /*
+            Launch shell
+        */
+        mipsim_shell(argc, argv);
+    }
     
     /*
         Close any open log file
     */
     mipsim_config_fini();
     
-    return 0;
+    return ret;
 }
@@ -0,0 +1,645 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+// MAP_ANONYMOUS and MAP_NORESERVE are not part of C99/POSIX
+#define _DEFAULT_SOURCE
+
+#include "mips.h"
+
+/*!
+    \file memflat.c
+    \brief Flat memory "controller" backed by host virtual memory
+    \author Hugues Bruant
+*/
+
+#include "io.h"
+
+/*
+    The whole 32 bit guest space is reserved as a single inaccessible host
+    region and guest mappings are made accessible windows into it, so that a
+    guest address is a plain offset from the region base. Pages are only
+    committed by the host kernel when first touched.
+    
+    A byte per guest page holds the flags of the only mapping covering that
+    page entirely. Pages shared by several mappings, partially mapped or
+    redirected to another memory controller are marked slow and resolved
+    through the mapping list.
+*/
+
+int mips_flat_init(MIPS_Memory *mem);
+
+#if defined(__unix__) && UINTPTR_MAX > 0xFFFFFFFFu
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+enum {
+    FLAT_WINDOW,
+    FLAT_BLACKBOX
+};
+
+enum {
+    FLAT_PAGE_FLAGS  = 0x1F,
+    FLAT_PAGE_MAPPED = 0x40,
+    FLAT_PAGE_SLOW   = 0x80
+};
+
+#define FLAT_PAGE_SHIFT 12
+#define FLAT_PAGE_SIZE  (1 << FLAT_PAGE_SHIFT)
+#define FLAT_PAGE_MASK  (FLAT_PAGE_SIZE - 1)
+#define FLAT_PAGE_COUNT (1 << (32 - FLAT_PAGE_SHIFT))
+#define FLAT_SPACE_SIZE ((size_t)1 << 32)
+
+typedef struct _FlatMapping FlatMapping;
+
+struct _FlatMapping {
+    short type;
+    short flags;
+    MIPS_Memory *r;
+    MIPS_Addr start, end;
+    
+    FlatMapping *next;
+};
+
+typedef struct _MemFlat {
+    uint8_t *base;
+    FlatMapping *mappings;
+    uint8_t pages[FLAT_PAGE_COUNT];
+} MemFlat;
+
+/*!
+    \internal
+    \brief Host address of n bytes at a, if they lie within a fast page
+    \param stat receives the mapping flags on success
+*/
+static inline uint8_t* mips_flat_host(MIPS_Memory *m, MIPS_Addr a, uint32_t n, int *stat)
+{
+    MemFlat *f = (MemFlat*)m->d;
+    uint8_t p = f->pages[a >> FLAT_PAGE_SHIFT];
+    
+    if ( (p & (FLAT_PAGE_MAPPED | FLAT_PAGE_SLOW)) != FLAT_PAGE_MAPPED || (a & FLAT_PAGE_MASK) > FLAT_PAGE_SIZE - n )
+        return NULL;
+    
+    if ( stat != NULL )
+        *stat = p & FLAT_PAGE_FLAGS;
+    
+    return f->base + a;
+}
+
+/*!
+    \internal
+    \brief Find the mapping holding all n bytes starting at a
+    \return mapping, NULL if the access is unmapped or crosses a mapping boundary
+*/
+static FlatMapping* mips_flat_span(MIPS_Memory *m, MIPS_Addr a, uint32_t n)
+{
+    MemFlat *f = (MemFlat*)m->d;
+    
+    if ( !f->pages[a >> FLAT_PAGE_SHIFT] )
+        return NULL;
+    
+    FlatMapping *mm = f->mappings;
+    
+    while ( mm != NULL && !(mm->start <= a && a < mm->end) )
+        mm = mm->next;
+    
+    return mm != NULL && (a - mm->start) + n <= mm->end - mm->start ? mm : NULL;
+}
+
+void mips_flat_dump_mapping(FILE *f, const char *indent, MIPS_Memory *m)
+{
+    FlatMapping *mm = m && m->d ? ((MemFlat*)m->d)->mappings : NULL;
+    
+    while ( mm != NULL )
+    {
+        fprintf(f, "%s R%c%c %08x %08x%s\n",
+               indent,
+               mm->flags & MEM_READONLY ? ' ' : 'W',
+               mm->flags & MEM_NOEXEC ? ' ' : 'X',
+               mm->start,
+               mm->end - 1,
+               mm->type == FLAT_BLACKBOX ? " [BB]" : (mm->flags & MEM_LAZY ? " [lazy]" : ""));
+        
+        if ( mm->type == FLAT_BLACKBOX )
+        {
+            char sident[strlen(indent) + 2];
+            strcpy(sident, indent);
+            strcat(sident, "  ");
+            mm->r->dump_mapping(f, sident, mm->r);
+        }
+        
+        mm = mm->next;
+    }
+}
+
+void mips_flat_unmap(MIPS_Memory *m)
+{
+    MemFlat *f = m ? m->d : NULL;
+    
+    if ( f == NULL )
+        return;
+    
+    FlatMapping *mm = f->mappings, *tmp;
+    
+    while ( mm != NULL )
+    {
+        if ( mm->type == FLAT_BLACKBOX )
+        {
+            mm->r->unmap(mm->r);
+            free(mm->r);
+        }
+        
+        tmp = mm->next;
+        free(mm);
+        mm = tmp;
+    }
+    
+    munmap(f->base, FLAT_SPACE_SIZE);
+    free(f);
+    
+    m->d = NULL;
+}
+
+/*!
+    \internal
+    \brief Create a mapping, making its pages accessible if it is a window
+    \return mapping, NULL on overlap or failure
+*/
+static FlatMapping* mips_flat_add(MIPS_Memory *m, MIPS_Addr a, uint32_t s, short type, short flags)
+{
+    MemFlat *f = (MemFlat*)m->d;
+    
+    for ( FlatMapping *mm = f->mappings; mm != NULL; mm = mm->next )
+        if ( mm->start <= a + s && a < mm->end )
+            return NULL;
+    
+    if ( s && type == FLAT_WINDOW )
+    {
+        uint64_t first = a & ~FLAT_PAGE_MASK;
+        uint64_t end = ((uint64_t)a + s + FLAT_PAGE_MASK) & ~(uint64_t)FLAT_PAGE_MASK;
+        
+        if ( mprotect(f->base + first, end - first, PROT_READ | PROT_WRITE) )
+        {
+            mipsim_printf(IO_WARNING, "Unable to map [%08x-%08x] in host memory\n", a, a + s - 1);
+            return NULL;
+        }
+    }
+    
+    FlatMapping *mm = (FlatMapping*)malloc(sizeof(FlatMapping));
+    mm->type  = type;
+    mm->flags = flags;
+    mm->r     = NULL;
+    mm->start = a;
+    mm->end   = a + s;
+    
+    mm->next = f->mappings;
+    f->mappings = mm;
+    
+    if ( !s )
+        return mm;
+    
+    MIPS_Addr last = (mm->end - 1) >> FLAT_PAGE_SHIFT;
+    
+    for ( MIPS_Addr p = a >> FLAT_PAGE_SHIFT; ; ++p )
+    {
+        uint64_t pstart = (uint64_t)p << FLAT_PAGE_SHIFT;
+        int whole = pstart >= a && pstart + FLAT_PAGE_SIZE <= (uint64_t)a + s;
+        
+        if ( !f->pages[p] && whole && type == FLAT_WINDOW )
+            f->pages[p] = FLAT_PAGE_MAPPED | (flags & FLAT_PAGE_FLAGS);
+        else
+            f->pages[p] = FLAT_PAGE_SLOW;
+        
+        if ( p == last )
+            break;
+    }
+    
+    return mm;
+}
+
+int mips_flat_map_static(MIPS_Memory *m, MIPS_Addr a, uint32_t s, uint8_t *d, short flags)
+{
+    if ( mips_flat_add(m, a, s, FLAT_WINDOW, flags) == NULL )
+        return 1;
+    
+    memcpy(((MemFlat*)m->d)->base + a, d, s);
+    
+    return 0;
+}
+
+int mips_flat_map_redir(MIPS_Memory *m, MIPS_Addr a, uint32_t s, MIPS_Memory *r, short flags)
+{
+    FlatMapping *mm = mips_flat_add(m, a, s, FLAT_BLACKBOX, flags);
+    
+    if ( mm == NULL )
+        return 1;
+    
+    mm->r = r;
+    
+    return 0;
+}
+
+int mips_flat_map_alloc(MIPS_Memory *m, MIPS_Addr a, uint32_t s, short flags)
+{
+    // demand paging of the host makes every allocation lazy
+    return mips_flat_add(m, a, s, FLAT_WINDOW, flags) == NULL;
+}
+
+uint8_t mips_flat_read_b(MIPS_Memory *m, MIPS_Addr a, int *stat)
+{
+    const uint8_t *d = mips_flat_host(m, a, 1, stat);
+    
+    if ( d != NULL )
+        return d[0];
+    
+    FlatMapping *mm = mips_flat_span(m, a, 1);
+    
+    if ( mm == NULL )
+    {
+        if ( stat != NULL )
+            *stat = MEM_UNMAPPED;
+        
+        return 0;
+    }
+    
+    if ( mm->type == FLAT_BLACKBOX )
+    {
+        int hstat;
+        uint8_t v = mm->r->read_b(mm->r, a, &hstat);
+        if ( stat != NULL )
+            *stat = mm->flags | hstat;
+        return v;
+    }
+    
+    if ( stat != NULL )
+        *stat = mm->flags;
+    
+    return ((MemFlat*)m->d)->base[a];
+}
+
+uint16_t mips_flat_read_h(MIPS_Memory *m, MIPS_Addr a, int *stat)
+{
+    const uint8_t *d = mips_flat_host(m, a, 2, stat);
+    
+    if ( d != NULL )
+        return (uint16_t)(((uint16_t)d[0] << 8) | d[1]);
+    
+    FlatMapping *mm = mips_flat_span(m, a, 2);
+    
+    if ( mm != NULL && mm->type == FLAT_BLACKBOX )
+    {
+        int hstat;
+        uint16_t v = mm->r->read_h(mm->r, a, &hstat);
+        if ( stat != NULL )
+            *stat = mm->flags | hstat;
+        return v;
+    }
+    
+    // unmapped, crossing a mapping boundary or a slow page
+    int hstat;
+    uint8_t b0 = mips_flat_read_b(m, a, &hstat);
+    if ( stat != NULL )
+        *stat = hstat;
+    uint8_t b1 = mips_flat_read_b(m, a + 1, &hstat);
+    if ( stat != NULL )
+        *stat |= hstat;
+    
+    return ((uint16_t)b0 << 8) | b1;
+}
+
+uint32_t mips_flat_read_w(MIPS_Memory *m, MIPS_Addr a, int *stat)
+{
+    const uint8_t *d = mips_flat_host(m, a, 4, stat);
+    
+    if ( d != NULL )
+        return ((uint32_t)d[0] << 24) | ((uint32_t)d[1] << 16) | ((uint32_t)d[2] << 8) | d[3];
+    
+    FlatMapping *mm = mips_flat_span(m, a, 4);
+    
+    if ( mm != NULL && mm->type == FLAT_BLACKBOX )
+    {
+        int hstat;
+        uint32_t v = mm->r->read_w(mm->r, a, &hstat);
+        if ( stat != NULL )
+            *stat = mm->flags | hstat;
+        return v;
+    }
+    
+    // unmapped, crossing a mapping boundary or a slow page
+    int hstat;
+    uint16_t h0 = mips_flat_read_h(m, a, &hstat);
+    if ( stat != NULL )
+        *stat = hstat;
+    uint16_t h1 = mips_flat_read_h(m, a + 2, &hstat);
+    if ( stat != NULL )
+        *stat |= hstat;
+    
+    return ((uint32_t)h0 << 16) | h1;
+}
+
+uint64_t mips_flat_read_d(MIPS_Memory *m, MIPS_Addr a, int *stat)
+{
+    const uint8_t *d = mips_flat_host(m, a, 8, stat);
+    
+    if ( d != NULL )
+        return ((uint64_t)d[0] << 56)
+               | ((uint64_t)d[1] << 48)
+               | ((uint64_t)d[2] << 40)
+               | ((uint64_t)d[3] << 32)
+               | ((uint64_t)d[4] << 24)
+               | ((uint64_t)d[5] << 16)
+               | ((uint64_t)d[6] << 8)
+               | d[7];
+    
+    FlatMapping *mm = mips_flat_span(m, a, 8);
+    
+    if ( mm != NULL && mm->type == FLAT_BLACKBOX )
+    {
+        int hstat;
+        uint64_t v = mm->r->read_d(mm->r, a, &hstat);
+        if ( stat != NULL )
+            *stat = mm->flags | hstat;
+        return v;
+    }
+    
+    // unmapped, crossing a mapping boundary or a slow page
+    int hstat;
+    uint32_t w0 = mips_flat_read_w(m, a, &hstat);
+    if ( stat != NULL )
+        *stat = hstat;
+    uint32_t w1 = mips_flat_read_w(m, a + 4, &hstat);
+    if ( stat != NULL )
+        *stat |= hstat;
+    
+    return ((uint64_t)w0 << 32) | w1;
+}
+
+void mips_flat_write_b(MIPS_Memory *m, MIPS_Addr a, uint8_t b, int *stat)
+{
+    uint8_t *d = mips_flat_host(m, a, 1, stat);
+    
+    if ( d != NULL )
+    {
+        d[0] = b;
+        return;
+    }
+    
+    FlatMapping *mm = mips_flat_span(m, a, 1);
+    
+    if ( mm == NULL )
+    {
+        if ( stat != NULL )
+            *stat = MEM_UNMAPPED;
+        
+        return;
+    }
+    
+    if ( mm->type == FLAT_BLACKBOX )
+    {
+        int hstat;
+        mm->r->write_b(mm->r, a, b, &hstat);
+        if ( stat != NULL )
+            *stat = mm->flags | hstat;
+        return;
+    }
+    
+    if ( stat != NULL )
+        *stat = mm->flags;
+    
+    ((MemFlat*)m->d)->base[a] = b;
+}
+
+void mips_flat_write_h(MIPS_Memory *m, MIPS_Addr a, uint16_t h, int *stat)
+{
+    uint8_t *d = mips_flat_host(m, a, 2, stat);
+    
+    if ( d != NULL )
+    {
+        d[0] = h >> 8;
+        d[1] = h;
+        return;
+    }
+    
+    FlatMapping *mm = mips_flat_span(m, a, 2);
+    
+    if ( mm != NULL && mm->type == FLAT_BLACKBOX )
+    {
+        int hstat;
+        mm->r->write_h(mm->r, a, h, &hstat);
+        if ( stat != NULL )
+            *stat = mm->flags | hstat;
+        return;
+    }
+    
+    // unmapped, crossing a mapping boundary or a slow page
+    int hstat;
+    mips_flat_write_b(m, a,     h >> 8, &hstat);
+    if ( stat != NULL )
+        *stat = hstat;
+    mips_flat_write_b(m, a + 1, h & 0x00ff, &hstat);
+    if ( stat != NULL )
+        *stat |= hstat;
+}
+
+void mips_flat_write_w(MIPS_Memory *m, MIPS_Addr a, uint32_t w, int *stat)
+{
+    uint8_t *d = mips_flat_host(m, a, 4, stat);
+    
+    if ( d != NULL )
+    {
+        d[0] = w >> 24;
+        d[1] = w >> 16;
+        d[2] = w >> 8;
+        d[3] = w;
+        return;
+    }
+    
+    FlatMapping *mm = mips_flat_span(m, a, 4);
+    
+    if ( mm != NULL && mm->type == FLAT_BLACKBOX )
+    {
+        int hstat;
+        mm->r->write_w(mm->r, a, w, &hstat);
+        if ( stat != NULL )
+            *stat = mm->flags | hstat;
+        return;
+    }
+    
+    // unmapped, crossing a mapping boundary or a slow page
+    int hstat;
+    mips_flat_write_h(m, a,     w >> 16, &hstat);
+    if ( stat != NULL )
+        *stat = hstat;
+    mips_flat_write_h(m, a + 2, w & 0X0000FFFF, &hstat);
+    if ( stat != NULL )
+        *stat |= hstat;
+}
+
+void mips_flat_write_d(MIPS_Memory *m, MIPS_Addr a, uint64_t d, int *stat)
+{
+    uint8_t *p = mips_flat_host(m, a, 8, stat);
+    
+    if ( p != NULL )
+    {
+        p[0] = d >> 56;
+        p[1] = d >> 48;
+        p[2] = d >> 40;
+        p[3] = d >> 32;
+        p[4] = d >> 24;
+        p[5] = d >> 16;
+        p[6] = d >> 8;
+        p[7] = d;
+        return;
+    }
+    
+    FlatMapping *mm = mips_flat_span(m, a, 8);
+    
+    if ( mm != NULL && mm->type == FLAT_BLACKBOX )
+    {
+        int hstat;
+        mm->r->write_d(mm->r, a, d, &hstat);
+        if ( stat != NULL )
+            *stat = mm->flags | hstat;
+        return;
+    }
+    
+    // unmapped, crossing a mapping boundary or a slow page
+    int hstat;
+    mips_flat_write_w(m, a,     d >> 32, &hstat);
+    if ( stat != NULL )
+        *stat = hstat;
+    mips_flat_write_w(m, a + 4, d & 0x00000000FFFFFFFFL, &hstat);
+    if ( stat != NULL )
+        *stat |= hstat;
+}
+
+/*!
+    \internal
+    \brief Host memory backing a run of bytes
+    \param n number of bytes wanted, receives the number of contiguous bytes available
+    \return host address, NULL if a is unmapped or not backed by host memory
+*/
+uint8_t* mips_flat_host_span(MIPS_Memory *m, MIPS_Addr a, uint32_t *n, int *stat)
+{
+    MemFlat *f = (MemFlat*)m->d;
+    uint8_t p = f->pages[a >> FLAT_PAGE_SHIFT];
+    
+    if ( (p & (FLAT_PAGE_MAPPED | FLAT_PAGE_SLOW)) == FLAT_PAGE_MAPPED )
+    {
+        // extend over the following pages with the same flags
+        uint64_t avail = FLAT_PAGE_SIZE - (a & FLAT_PAGE_MASK);
+        uint32_t next = (a >> FLAT_PAGE_SHIFT) + 1;
+        
+        while ( avail < *n && next < FLAT_PAGE_COUNT && f->pages[next] == p )
+        {
+            avail += FLAT_PAGE_SIZE;
+            ++next;
+        }
+        
+        if ( *n > avail )
+            *n = avail;
+        
+        if ( stat != NULL )
+            *stat = p & FLAT_PAGE_FLAGS;
+        
+        return f->base + a;
+    }
+    
+    FlatMapping *mm = mips_flat_span(m, a, 1);
+    
+    if ( mm == NULL )
+    {
+        if ( stat != NULL )
+            *stat = MEM_UNMAPPED;
+        
+        return NULL;
+    }
+    
+    if ( *n > mm->end - a )
+        *n = mm->end - a;
+    
+    if ( mm->type == FLAT_BLACKBOX )
+    {
+        int hstat = 0;
+        uint8_t *d = mm->r->span != NULL ? mm->r->span(mm->r, a, n, &hstat) : NULL;
+        if ( stat != NULL )
+            *stat = mm->flags | hstat;
+        return d;
+    }
+    
+    if ( stat != NULL )
+        *stat = mm->flags;
+    
+    return f->base + a;
+}
+
+/*!
+    \brief Initialize a flat memory controller
+    \return 0 on success, non-zero if the host cannot reserve the guest space
+*/
+int mips_flat_init(MIPS_Memory *mem)
+{
+    MemFlat *f = (MemFlat*)calloc(1, sizeof(MemFlat));
+    
+    if ( f == NULL )
+        return 1;
+    
+    f->base = (uint8_t*)mmap(NULL, FLAT_SPACE_SIZE, PROT_NONE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    
+    if ( f->base == MAP_FAILED )
+    {
+        mipsim_printf(IO_WARNING, "Unable to reserve flat guest memory\n");
+        free(f);
+        return 1;
+    }
+    
+    mem->d = f;
+    
+    mem->unmap  = mips_flat_unmap;
+    
+    mem->pagefault = NULL;
+    
+    mem->map_static = mips_flat_map_static;
+    mem->map_redir  = mips_flat_map_redir;
+    mem->map_alloc  = mips_flat_map_alloc;
+    
+    mem->read_b = mips_flat_read_b;
+    mem->read_h = mips_flat_read_h;
+    mem->read_w = mips_flat_read_w;
+    mem->read_d = mips_flat_read_d;
+    
+    mem->fetch_w = mips_flat_read_w;
+    
+    mem->write_b = mips_flat_write_b;
+    mem->write_h = mips_flat_write_h;
+    mem->write_w = mips_flat_write_w;
+    mem->write_d = mips_flat_write_d;
+    
+    mem->span = mips_flat_host_span;
+    
+    mem->dump_mapping = mips_flat_dump_mapping;
+    
+    return 0;
+}
+
+#else
+
+int mips_flat_init(MIPS_Memory *mem)
+{
+    (void)mem;
+    
+    mipsim_printf(IO_WARNING, "Flat guest memory needs a 64 bit POSIX host\n");
+    
+    return 1;
+}
+
+#endif
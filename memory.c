@@ -22,7 +22,8 @@ enum {
     MAP_NONE,
     MAP_STATIC,
     MAP_BLACKBOX,
-    MAP_DYNAMIC
+    MAP_DYNAMIC,
+    MAP_LAZY
 };
 
 typedef struct _MemMapping MemMapping;
@@ -37,6 +38,64 @@ struct _MemMapping {
     MemMapping *next;
 };
 
+/*
+    Mappings are kept in a list (used for overlap checks, dumps and cleanup)
+    and indexed by a two-level page table over the 32 bit address space.
+    
+    Each 4kB page entry points to the only mapping intersecting that page,
+    to MEM_SHARED_PAGE when several mappings share the page (the list is
+    then scanned), or is NULL for unmapped pages.
+    
+    In front of the page table, two small direct-mapped TLBs (one for
+    instruction fetch, one for data accesses) cache the host address of
+    pages entirely backed by host memory, including the pages of nested
+    spaces and lazy regions. They are flushed whenever a mapping is added.
+    
+    Lazy regions keep one host pointer per guest page they intersect. Pages
+    are committed (zero-filled) on first touch, by aligned clusters of
+    fault_around pages to amortize allocations.
+*/
+
+#define MEM_PAGE_SHIFT  12
+#define MEM_DIR_SHIFT   22
+#define MEM_DIR_SIZE    (1 << (32 - MEM_DIR_SHIFT))
+#define MEM_TABLE_SIZE  (1 << (MEM_DIR_SHIFT - MEM_PAGE_SHIFT))
+#define MEM_PAGE_SIZE   (1 << MEM_PAGE_SHIFT)
+#define MEM_PAGE_MASK   (MEM_PAGE_SIZE - 1)
+#define MEM_TLB_SIZE    64
+
+// never matches a page-aligned address
+#define MEM_TLB_INVALID 1
+
+typedef struct _MemTLBEntry {
+    MIPS_Addr tag;
+    int flags;
+    uint8_t *host;
+} MemTLBEntry;
+
+typedef struct _MemSpace {
+    MemMapping *mappings;
+    MemMapping **dir[MEM_DIR_SIZE];
+    
+    MemTLBEntry itlb[MEM_TLB_SIZE];
+    MemTLBEntry dtlb[MEM_TLB_SIZE];
+} MemSpace;
+
+typedef struct _LazyRegion {
+    MIPS_Addr first;
+    uint32_t npages;
+    uint32_t committed;
+    uint8_t **pages;
+    uint32_t fault_around;
+    
+    uint32_t nchunks, chunks_alloc;
+    void **chunks;
+} LazyRegion;
+
+static MemMapping mem_shared_page;
+
+#define MEM_SHARED_PAGE (&mem_shared_page)
+
 /*
 struct _TMemMapping {
     int type;
@@ -105,10 +164,11 @@ int mips_tree_map_ro(MIPS_Memory *m, MIPS_Addr a, uint32_t s, uint8_t *d)
 ////////////////////////////////////////////////////////////////////////////////////
 
 void mips_simple_init(MIPS_Memory *mem);
+int mips_flat_init(MIPS_Memory *mem);
 
 void mips_simple_dump_mapping(FILE *f, const char *indent, MIPS_Memory *m)
 {
-    MemMapping *mm = m ? m->d : NULL;
+    MemMapping *mm = m && m->d ? ((MemSpace*)m->d)->mappings : NULL;
     
     while ( mm != NULL )
     {
@@ -124,6 +184,17 @@ void mips_simple_dump_mapping(FILE *f, const char *indent, MIPS_Memory *m)
             strcpy(sident, indent);
             strcat(sident, "  ");
             mips_simple_dump_mapping(f, sident, (MIPS_Memory*)mm->mapped);
+        } else if ( mm->type == MAP_LAZY ) {
+            LazyRegion *r = (LazyRegion*)mm->mapped;
+            
+            fprintf(f, "%s R%c%c %08x %08x [lazy %u/%u pages]\n",
+                   indent,
+                   mm->flags & MEM_READONLY ? ' ' : 'W',
+                   mm->flags & MEM_NOEXEC ? ' ' : 'X',
+                   mm->start,
+                   mm->end - 1,
+                   r->committed,
+                   r->npages);
         } else {
             fprintf(f, "%s R%c%c %08x %08x\n",
                    indent,
@@ -137,28 +208,147 @@ void mips_simple_dump_mapping(FILE *f, const char *indent, MIPS_Memory *m)
     }
 }
 
-int mips_lazy_alloc_pagefault(MIPS_Memory *m, MIPS_Addr a)
+/*!
+    \internal
+    \brief Commit the cluster of pages of a lazy region holding page p
+*/
+void mips_lazy_fault(LazyRegion *r, uint32_t p)
 {
-    MIPS_Addr base = a & 0xFFFFF000;
+    uint32_t n = r->fault_around;
     
-    mipsim_printf(IO_DEBUG, "Page fault @ %08x => lazy alloc [%08x-%08x]\n", a, base, base + 0xFFF);
+    if ( n == 0 )
+        n = 1;
     
-    return m->map_alloc(m, base, 0x1000, 0);
+    uint32_t first = p - p % n;
+    uint32_t count = r->npages - first < n ? r->npages - first : n;
+    
+    if ( r->nchunks == r->chunks_alloc )
+    {
+        uint32_t alloc = r->chunks_alloc ? 2 * r->chunks_alloc : 16;
+        void **chunks = (void**)realloc(r->chunks, alloc * sizeof(void*));
+        
+        if ( chunks == NULL )
+            return;
+        
+        r->chunks = chunks;
+        r->chunks_alloc = alloc;
+    }
+    
+    uint8_t *chunk = (uint8_t*)calloc(count, MEM_PAGE_SIZE);
+    
+    if ( chunk == NULL )
+    {
+        mipsim_printf(IO_WARNING, "Failed committing %u lazily allocated pages\n", count);
+        return;
+    }
+    
+    r->chunks[r->nchunks++] = chunk;
+    r->committed += count;
+    
+    for ( uint32_t i = 0; i < count; ++i )
+        r->pages[first + i] = chunk + i * MEM_PAGE_SIZE;
+}
+
+/*!
+    \internal
+    \brief Host address of a byte of a lazy region, committing its page if needed
+    \return host address, NULL if the page could not be committed
+*/
+static inline uint8_t* mips_lazy_host(LazyRegion *r, MIPS_Addr a)
+{
+    uint32_t p = (a >> MEM_PAGE_SHIFT) - r->first;
+    
+    if ( r->pages[p] == NULL )
+        mips_lazy_fault(r, p);
+    
+    return r->pages[p] != NULL ? r->pages[p] + (a & MEM_PAGE_MASK) : NULL;
+}
+
+/*!
+    \internal
+    \brief Host address of n bytes starting at a within a non-blackbox mapping
+    \return host address, NULL if the bytes are not contiguous in host memory
+*/
+static inline uint8_t* mips_mapping_host(MemMapping *mm, MIPS_Addr a, uint32_t n)
+{
+    if ( mm->type == MAP_LAZY )
+        return (a & MEM_PAGE_MASK) + n <= MEM_PAGE_SIZE ? mips_lazy_host((LazyRegion*)mm->mapped, a) : NULL;
+    
+    return (uint8_t*)mm->mapped + (a - mm->start);
+}
+
+/*!
+    \internal
+    \brief Invalidate all TLB entries of an address space
+*/
+void mips_tlb_flush(MemSpace *s)
+{
+    for ( int i = 0; i < MEM_TLB_SIZE; ++i )
+    {
+        s->itlb[i].tag = MEM_TLB_INVALID;
+        s->dtlb[i].tag = MEM_TLB_INVALID;
+    }
+}
+
+/*!
+    \internal
+    \brief Record a new mapping in the page table
+    \return 0 on success, 1 if out of memory, the page table being left unchanged
+*/
+int mips_page_insert(MemSpace *s, MemMapping *mm)
+{
+    if ( mm->end == mm->start )
+        return 0;
+    
+    MIPS_Addr last = (mm->end - 1) >> MEM_PAGE_SHIFT;
+    
+    // allocate missing tables first so that a failure leaves no partial mapping
+    for ( MIPS_Addr i = mm->start >> MEM_DIR_SHIFT; i <= (mm->end - 1) >> MEM_DIR_SHIFT; ++i )
+    {
+        if ( s->dir[i] == NULL
+            && (s->dir[i] = (MemMapping**)calloc(MEM_TABLE_SIZE, sizeof(MemMapping*))) == NULL )
+            return 1;
+    }
+    
+    for ( MIPS_Addr p = mm->start >> MEM_PAGE_SHIFT; ; ++p )
+    {
+        MemMapping **e = &s->dir[p >> (MEM_DIR_SHIFT - MEM_PAGE_SHIFT)][p & (MEM_TABLE_SIZE - 1)];
+        
+        *e = *e == NULL ? mm : MEM_SHARED_PAGE;
+        
+        if ( p == last )
+            break;
+    }
+    
+    return 0;
 }
 
 MemMapping* mips_simple_mapping(MIPS_Memory *m, MIPS_Addr a)
 {
-    MemMapping *mm = m ? m->d : NULL;
+    MemSpace *s = m ? m->d : NULL;
+    MemMapping *mm = NULL;
     
-    while ( mm != NULL )
+    if ( s != NULL )
     {
-        if ( mm->start <= a && a < mm->end )
-            return mm;
+        MemMapping **t = s->dir[a >> MEM_DIR_SHIFT];
         
-        mm = mm->next;
+        mm = t != NULL ? t[(a >> MEM_PAGE_SHIFT) & (MEM_TABLE_SIZE - 1)] : NULL;
+        
+        if ( mm == MEM_SHARED_PAGE )
+        {
+            mm = s->mappings;
+            
+            while ( mm != NULL && !(mm->start <= a && a < mm->end) )
+                mm = mm->next;
+        } else if ( mm != NULL && !(mm->start <= a && a < mm->end) ) {
+            mm = NULL;
+        }
+        
+        if ( mm != NULL )
+            return mm;
     }
     
-    if ( m->pagefault != NULL )
+    if ( m != NULL && m->pagefault != NULL )
     {
         if ( !m->pagefault(m, a) )
         {
@@ -175,7 +365,7 @@ MemMapping* mips_simple_mapping(MIPS_Memory *m, MIPS_Addr a)
 
 int mips_mapping_overlap(MIPS_Memory *m, MIPS_Addr start, MIPS_Addr end)
 {
-    MemMapping *mm = m ? m->d : NULL;
+    MemMapping *mm = m && m->d ? ((MemSpace*)m->d)->mappings : NULL;
     
     while ( mm != NULL )
     {
@@ -190,7 +380,8 @@ int mips_mapping_overlap(MIPS_Memory *m, MIPS_Addr start, MIPS_Addr end)
 
 void mips_simple_unmap(MIPS_Memory *m)
 {
-    MemMapping *mm = m ? m->d : NULL, *tmp;
+    MemSpace *s = m ? m->d : NULL;
+    MemMapping *mm = s ? s->mappings : NULL, *tmp;
     
     while ( mm != NULL )
     {
@@ -200,6 +391,15 @@ void mips_simple_unmap(MIPS_Memory *m)
             free(mm->mapped);
         } else if ( mm->type == MAP_DYNAMIC ) {
             free(mm->mapped);
+        } else if ( mm->type == MAP_LAZY ) {
+            LazyRegion *r = (LazyRegion*)mm->mapped;
+            
+            for ( uint32_t i = 0; i < r->nchunks; ++i )
+                free(r->chunks[i]);
+            
+            free(r->chunks);
+            free(r->pages);
+            free(r);
         }
         
         tmp = mm->next;
@@ -207,23 +407,112 @@ void mips_simple_unmap(MIPS_Memory *m)
         mm = tmp;
     }
     
+    if ( s != NULL )
+    {
+        for ( int i = 0; i < MEM_DIR_SIZE; ++i )
+            free(s->dir[i]);
+        
+        free(s);
+    }
+    
     if ( m != NULL )
         m->d = NULL;
 }
 
+/*!
+    \internal
+    \brief Translate the page holding a to host memory
+    \param flags receives the combined mapping flags
+    \return host address of the page start, NULL if the page is not entirely
+    backed by host memory
+*/
+uint8_t* mips_simple_translate(MIPS_Memory *m, MIPS_Addr a, int *flags)
+{
+    MIPS_Addr base = a & ~MEM_PAGE_MASK;
+    MemMapping *mm = mips_simple_mapping(m, a);
+    
+    if ( mm == NULL || base < mm->start || (base - mm->start) + MEM_PAGE_SIZE > mm->end - mm->start )
+        return NULL;
+    
+    *flags |= mm->flags;
+    
+    if ( mm->type == MAP_BLACKBOX )
+    {
+        MIPS_Memory *r = (MIPS_Memory*)mm->mapped;
+        
+        // only nested spaces of this implementation can be looked through
+        return r->unmap == mips_simple_unmap ? mips_simple_translate(r, a, flags) : NULL;
+    }
+    
+    return mips_mapping_host(mm, base, MEM_PAGE_SIZE);
+}
+
+/*!
+    \internal
+    \brief TLB lookup, filling the entry on miss
+    \return TLB entry, NULL if the page cannot be cached
+*/
+static inline const MemTLBEntry* mips_tlb_lookup(MIPS_Memory *m, MemTLBEntry *tlb, MIPS_Addr a)
+{
+    MemTLBEntry *e = &tlb[(a >> MEM_PAGE_SHIFT) & (MEM_TLB_SIZE - 1)];
+    
+    if ( e->tag != (a & ~MEM_PAGE_MASK) )
+    {
+        int flags = 0;
+        uint8_t *host = mips_simple_translate(m, a, &flags);
+        
+        if ( host == NULL )
+            return NULL;
+        
+        e->tag = a & ~MEM_PAGE_MASK;
+        e->flags = flags;
+        e->host = host;
+    }
+    
+    return e;
+}
+
+/*!
+    \internal
+    \brief Link a new mapping into the address space
+    \return 0 on success, 1 if out of memory, the mapping being left out
+*/
+int mips_mapping_add(MIPS_Memory *m, MemMapping *mm)
+{
+    MemSpace *s = (MemSpace*)m->d;
+    
+    if ( mips_page_insert(s, mm) )
+        return 1;
+    
+    mm->next = s->mappings;
+    s->mappings = mm;
+    
+    mips_tlb_flush(s);
+    
+    return 0;
+}
+
 int mips_simple_map_static(MIPS_Memory *m, MIPS_Addr a, uint32_t s, uint8_t *d, short flags)
 {
     if ( mips_mapping_overlap(m, a, a + s) )
         return 1;
     
     MemMapping *mm = (MemMapping*)malloc(sizeof(MemMapping));
+    
+    if ( mm == NULL )
+        return 1;
+    
     mm->type   = MAP_STATIC;
     mm->flags  = flags;
     mm->start  = a;
     mm->end    = a + s;
     mm->mapped = d;
-    mm->next = (MemMapping*)m->d;
-    m->d = mm;
+    
+    if ( mips_mapping_add(m, mm) )
+    {
+        free(mm);
+        return 1;
+    }
     
     return 0;
 }
@@ -234,13 +523,21 @@ int mips_simple_map_redir(MIPS_Memory *m, MIPS_Addr a, uint32_t s, MIPS_Memory *
         return 1;
     
     MemMapping *mm = (MemMapping*)malloc(sizeof(MemMapping));
+    
+    if ( mm == NULL )
+        return 1;
+    
     mm->type   = MAP_BLACKBOX;
     mm->flags  = flags;
     mm->start  = a;
     mm->end    = a + s;
     mm->mapped = r;
-    mm->next = (MemMapping*)m->d;
-    m->d = mm;
+    
+    if ( mips_mapping_add(m, mm) )
+    {
+        free(mm);
+        return 1;
+    }
     
     return 0;
 }
@@ -252,39 +549,96 @@ int mips_simple_map_alloc(MIPS_Memory *m, MIPS_Addr a, uint32_t s, short flags)
     
     if ( flags & MEM_LAZY )
     {
-        MIPS_Memory *r = (MIPS_Memory*)malloc(sizeof(MIPS_Memory));
-        
-        // init block
-        mips_simple_init(r);
-        
-        r->pagefault = mips_lazy_alloc_pagefault;
+        LazyRegion *r = (LazyRegion*)calloc(1, sizeof(LazyRegion));
         
-        int ret = mips_simple_map_redir(m, a, s, r, flags);
+        if ( r != NULL && s )
+        {
+            r->first  = a >> MEM_PAGE_SHIFT;
+            r->npages = ((a + s - 1) >> MEM_PAGE_SHIFT) - r->first + 1;
+            r->pages  = (uint8_t**)calloc(r->npages, sizeof(uint8_t*));
+            r->fault_around = mipsim_config()->lazy_fault_around;
+        }
         
-        if ( ret )
+        if ( r == NULL || (s && r->pages == NULL) )
         {
             mipsim_printf(IO_WARNING,
                           "Failed creating lazily allocated chunk [%08x-%08x]\n",
                           a, a + s);
             free(r);
-            return ret;
+            return 1;
+        }
+        
+        MemMapping *mm = (MemMapping*)malloc(sizeof(MemMapping));
+        
+        if ( mm == NULL )
+        {
+            free(r->pages);
+            free(r);
+            return 1;
+        }
+        
+        mm->type   = MAP_LAZY;
+        mm->flags  = flags;
+        mm->start  = a;
+        mm->end    = a + s;
+        mm->mapped = r;
+        
+        if ( mips_mapping_add(m, mm) )
+        {
+            free(r->pages);
+            free(r);
+            free(mm);
+            return 1;
         }
     } else {
         MemMapping *mm = (MemMapping*)malloc(sizeof(MemMapping));
+        
+        if ( mm == NULL )
+            return 1;
+        
         mm->type   = MAP_DYNAMIC;
         mm->flags  = flags;
         mm->start  = a;
         mm->end    = a + s;
         mm->mapped = malloc(s);
-        mm->next   = m->d;
-        m->d = mm;
+        
+        if ( (s && mm->mapped == NULL) || mips_mapping_add(m, mm) )
+        {
+            free(mm->mapped);
+            free(mm);
+            return 1;
+        }
     }
     
     return 0;
 }
 
+/*!
+    \internal
+    \brief Find the mapping holding all n bytes starting at a
+    \return mapping, NULL if the access is unmapped or crosses a mapping boundary
+*/
+static inline MemMapping* mips_simple_span(MIPS_Memory *m, MIPS_Addr a, uint32_t n)
+{
+    MemMapping *mm = mips_simple_mapping(m, a);
+    
+    return mm != NULL && (a - mm->start) + n <= mm->end - mm->start ? mm : NULL;
+}
+
 uint8_t mips_simple_read_b(MIPS_Memory *m, MIPS_Addr a, int *stat)
 {
+    const MemTLBEntry *e = mips_tlb_lookup(m, ((MemSpace*)m->d)->dtlb, a);
+    
+    if ( e != NULL )
+    {
+        const uint8_t *d = e->host + (a & MEM_PAGE_MASK);
+        
+        if ( stat != NULL )
+            *stat = e->flags;
+        
+        return d[0];
+    }
+    
     MemMapping *mm = mips_simple_mapping(m, a);
     
     if ( mm == NULL )
@@ -307,11 +661,59 @@ uint8_t mips_simple_read_b(MIPS_Memory *m, MIPS_Addr a, int *stat)
         return r;
     }
     
-    return ((uint8_t*)mm->mapped)[a - mm->start];
+    const uint8_t *d = mips_mapping_host(mm, a, 1);
+    
+    if ( d == NULL )
+    {
+        if ( stat != NULL )
+            *stat = MEM_UNMAPPED;
+        
+        return 0;
+    }
+    
+    return d[0];
 }
 
 uint16_t mips_simple_read_h(MIPS_Memory *m, MIPS_Addr a, int *stat)
 {
+    const MemTLBEntry *e = (a & MEM_PAGE_MASK) <= MEM_PAGE_SIZE - 2 ? mips_tlb_lookup(m, ((MemSpace*)m->d)->dtlb, a) : NULL;
+    
+    if ( e != NULL )
+    {
+        const uint8_t *d = e->host + (a & MEM_PAGE_MASK);
+        
+        if ( stat != NULL )
+            *stat = e->flags;
+        
+        return (uint16_t)(((uint16_t)d[0] << 8) | d[1]);
+    }
+    
+    MemMapping *mm = mips_simple_span(m, a, 2);
+    
+    if ( mm != NULL )
+    {
+        if ( mm->type == MAP_BLACKBOX )
+        {
+            int hstat;
+            MIPS_Memory *r = (MIPS_Memory*)mm->mapped;
+            uint16_t v = r->read_h(r, a, &hstat);
+            if ( stat != NULL )
+                *stat = mm->flags | hstat;
+            return v;
+        }
+        
+        const uint8_t *d = mips_mapping_host(mm, a, 2);
+        
+        if ( d != NULL )
+        {
+            if ( stat != NULL )
+                *stat = mm->flags;
+            
+            return (uint16_t)(((uint16_t)d[0] << 8) | d[1]);
+        }
+    }
+    
+    // unmapped, crossing a mapping boundary or a lazy page boundary
     int hstat;
     uint8_t b0 = mips_simple_read_b(m, a, &hstat);
     if ( stat != NULL )
@@ -325,6 +727,44 @@ uint16_t mips_simple_read_h(MIPS_Memory *m, MIPS_Addr a, int *stat)
 
 uint32_t mips_simple_read_w(MIPS_Memory *m, MIPS_Addr a, int *stat)
 {
+    const MemTLBEntry *e = (a & MEM_PAGE_MASK) <= MEM_PAGE_SIZE - 4 ? mips_tlb_lookup(m, ((MemSpace*)m->d)->dtlb, a) : NULL;
+    
+    if ( e != NULL )
+    {
+        const uint8_t *d = e->host + (a & MEM_PAGE_MASK);
+        
+        if ( stat != NULL )
+            *stat = e->flags;
+        
+        return ((uint32_t)d[0] << 24) | ((uint32_t)d[1] << 16) | ((uint32_t)d[2] << 8) | d[3];
+    }
+    
+    MemMapping *mm = mips_simple_span(m, a, 4);
+    
+    if ( mm != NULL )
+    {
+        if ( mm->type == MAP_BLACKBOX )
+        {
+            int hstat;
+            MIPS_Memory *r = (MIPS_Memory*)mm->mapped;
+            uint32_t v = r->read_w(r, a, &hstat);
+            if ( stat != NULL )
+                *stat = mm->flags | hstat;
+            return v;
+        }
+        
+        const uint8_t *d = mips_mapping_host(mm, a, 4);
+        
+        if ( d != NULL )
+        {
+            if ( stat != NULL )
+                *stat = mm->flags;
+            
+            return ((uint32_t)d[0] << 24) | ((uint32_t)d[1] << 16) | ((uint32_t)d[2] << 8) | d[3];
+        }
+    }
+    
+    // unmapped, crossing a mapping boundary or a lazy page boundary
     int hstat;
     uint16_t h0 = mips_simple_read_h(m, a, &hstat);
     if ( stat != NULL )
@@ -338,6 +778,58 @@ uint32_t mips_simple_read_w(MIPS_Memory *m, MIPS_Addr a, int *stat)
 
 uint64_t mips_simple_read_d(MIPS_Memory *m, MIPS_Addr a, int *stat)
 {
+    const MemTLBEntry *e = (a & MEM_PAGE_MASK) <= MEM_PAGE_SIZE - 8 ? mips_tlb_lookup(m, ((MemSpace*)m->d)->dtlb, a) : NULL;
+    
+    if ( e != NULL )
+    {
+        const uint8_t *d = e->host + (a & MEM_PAGE_MASK);
+        
+        if ( stat != NULL )
+            *stat = e->flags;
+        
+        return ((uint64_t)d[0] << 56)
+                   | ((uint64_t)d[1] << 48)
+                   | ((uint64_t)d[2] << 40)
+                   | ((uint64_t)d[3] << 32)
+                   | ((uint64_t)d[4] << 24)
+                   | ((uint64_t)d[5] << 16)
+                   | ((uint64_t)d[6] << 8)
+                   | d[7];
+    }
+    
+    MemMapping *mm = mips_simple_span(m, a, 8);
+    
+    if ( mm != NULL )
+    {
+        if ( mm->type == MAP_BLACKBOX )
+        {
+            int hstat;
+            MIPS_Memory *r = (MIPS_Memory*)mm->mapped;
+            uint64_t v = r->read_d(r, a, &hstat);
+            if ( stat != NULL )
+                *stat = mm->flags | hstat;
+            return v;
+        }
+        
+        const uint8_t *d = mips_mapping_host(mm, a, 8);
+        
+        if ( d != NULL )
+        {
+            if ( stat != NULL )
+                *stat = mm->flags;
+            
+            return ((uint64_t)d[0] << 56)
+                   | ((uint64_t)d[1] << 48)
+                   | ((uint64_t)d[2] << 40)
+                   | ((uint64_t)d[3] << 32)
+                   | ((uint64_t)d[4] << 24)
+                   | ((uint64_t)d[5] << 16)
+                   | ((uint64_t)d[6] << 8)
+                   | d[7];
+        }
+    }
+    
+    // unmapped, crossing a mapping boundary or a lazy page boundary
     int hstat;
     uint32_t w0 = mips_simple_read_w(m, a, &hstat);
     if ( stat != NULL )
@@ -350,8 +842,38 @@ uint64_t mips_simple_read_d(MIPS_Memory *m, MIPS_Addr a, int *stat)
 }
 
 
+uint32_t mips_simple_fetch_w(MIPS_Memory *m, MIPS_Addr a, int *stat)
+{
+    const MemTLBEntry *e = (a & MEM_PAGE_MASK) <= MEM_PAGE_SIZE - 4 ? mips_tlb_lookup(m, ((MemSpace*)m->d)->itlb, a) : NULL;
+    
+    if ( e != NULL )
+    {
+        const uint8_t *d = e->host + (a & MEM_PAGE_MASK);
+        
+        if ( stat != NULL )
+            *stat = e->flags;
+        
+        return ((uint32_t)d[0] << 24) | ((uint32_t)d[1] << 16) | ((uint32_t)d[2] << 8) | d[3];
+    }
+    
+    return mips_simple_read_w(m, a, stat);
+}
+
 void mips_simple_write_b(MIPS_Memory *m, MIPS_Addr a, uint8_t b, int *stat)
 {
+    const MemTLBEntry *e = mips_tlb_lookup(m, ((MemSpace*)m->d)->dtlb, a);
+    
+    if ( e != NULL )
+    {
+        uint8_t *d = e->host + (a & MEM_PAGE_MASK);
+        
+        if ( stat != NULL )
+            *stat = e->flags;
+        
+        d[0] = b;
+        return;
+    }
+    
     MemMapping *mm = mips_simple_mapping(m, a);
     
     if ( mm == NULL )
@@ -373,12 +895,59 @@ void mips_simple_write_b(MIPS_Memory *m, MIPS_Addr a, uint8_t b, int *stat)
             *stat |= hstat;
         
     } else {
-        ((uint8_t*)mm->mapped)[a - mm->start] = b;
+        uint8_t *d = mips_mapping_host(mm, a, 1);
+        
+        if ( d != NULL )
+            d[0] = b;
+        else if ( stat != NULL )
+            *stat = MEM_UNMAPPED;
     }
 }
 
 void mips_simple_write_h(MIPS_Memory *m, MIPS_Addr a, uint16_t h, int *stat)
 {
+    const MemTLBEntry *e = (a & MEM_PAGE_MASK) <= MEM_PAGE_SIZE - 2 ? mips_tlb_lookup(m, ((MemSpace*)m->d)->dtlb, a) : NULL;
+    
+    if ( e != NULL )
+    {
+        uint8_t *d = e->host + (a & MEM_PAGE_MASK);
+        
+        if ( stat != NULL )
+            *stat = e->flags;
+        
+        d[0] = h >> 8;
+        d[1] = h;
+        return;
+    }
+    
+    MemMapping *mm = mips_simple_span(m, a, 2);
+    
+    if ( mm != NULL )
+    {
+        if ( mm->type == MAP_BLACKBOX )
+        {
+            int hstat;
+            MIPS_Memory *r = (MIPS_Memory*)mm->mapped;
+            r->write_h(r, a, h, &hstat);
+            if ( stat != NULL )
+                *stat = mm->flags | hstat;
+            return;
+        }
+        
+        uint8_t *d = mips_mapping_host(mm, a, 2);
+        
+        if ( d != NULL )
+        {
+            if ( stat != NULL )
+                *stat = mm->flags;
+            
+            d[0] = h >> 8;
+            d[1] = h;
+            return;
+        }
+    }
+    
+    // unmapped, crossing a mapping boundary or a lazy page boundary
     int hstat;
     mips_simple_write_b(m, a,     h >> 8, &hstat);
     if ( stat != NULL )
@@ -390,6 +959,52 @@ void mips_simple_write_h(MIPS_Memory *m, MIPS_Addr a, uint16_t h, int *stat)
 
 void mips_simple_write_w(MIPS_Memory *m, MIPS_Addr a, uint32_t w, int *stat)
 {
+    const MemTLBEntry *e = (a & MEM_PAGE_MASK) <= MEM_PAGE_SIZE - 4 ? mips_tlb_lookup(m, ((MemSpace*)m->d)->dtlb, a) : NULL;
+    
+    if ( e != NULL )
+    {
+        uint8_t *d = e->host + (a & MEM_PAGE_MASK);
+        
+        if ( stat != NULL )
+            *stat = e->flags;
+        
+        d[0] = w >> 24;
+        d[1] = w >> 16;
+        d[2] = w >> 8;
+        d[3] = w;
+        return;
+    }
+    
+    MemMapping *mm = mips_simple_span(m, a, 4);
+    
+    if ( mm != NULL )
+    {
+        if ( mm->type == MAP_BLACKBOX )
+        {
+            int hstat;
+            MIPS_Memory *r = (MIPS_Memory*)mm->mapped;
+            r->write_w(r, a, w, &hstat);
+            if ( stat != NULL )
+                *stat = mm->flags | hstat;
+            return;
+        }
+        
+        uint8_t *d = mips_mapping_host(mm, a, 4);
+        
+        if ( d != NULL )
+        {
+            if ( stat != NULL )
+                *stat = mm->flags;
+            
+            d[0] = w >> 24;
+            d[1] = w >> 16;
+            d[2] = w >> 8;
+            d[3] = w;
+            return;
+        }
+    }
+    
+    // unmapped, crossing a mapping boundary or a lazy page boundary
     int hstat;
     mips_simple_write_h(m, a,     w >> 16, &hstat);
     if ( stat != NULL )
@@ -401,6 +1016,60 @@ void mips_simple_write_w(MIPS_Memory *m, MIPS_Addr a, uint32_t w, int *stat)
 
 void mips_simple_write_d(MIPS_Memory *m, MIPS_Addr a, uint64_t d, int *stat)
 {
+    const MemTLBEntry *e = (a & MEM_PAGE_MASK) <= MEM_PAGE_SIZE - 8 ? mips_tlb_lookup(m, ((MemSpace*)m->d)->dtlb, a) : NULL;
+    
+    if ( e != NULL )
+    {
+        uint8_t *p = e->host + (a & MEM_PAGE_MASK);
+        
+        if ( stat != NULL )
+            *stat = e->flags;
+        
+        p[0] = d >> 56;
+        p[1] = d >> 48;
+        p[2] = d >> 40;
+        p[3] = d >> 32;
+        p[4] = d >> 24;
+        p[5] = d >> 16;
+        p[6] = d >> 8;
+        p[7] = d;
+        return;
+    }
+    
+    MemMapping *mm = mips_simple_span(m, a, 8);
+    
+    if ( mm != NULL )
+    {
+        if ( mm->type == MAP_BLACKBOX )
+        {
+            int hstat;
+            MIPS_Memory *r = (MIPS_Memory*)mm->mapped;
+            r->write_d(r, a, d, &hstat);
+            if ( stat != NULL )
+                *stat = mm->flags | hstat;
+            return;
+        }
+        
+        uint8_t *p = mips_mapping_host(mm, a, 8);
+        
+        if ( p != NULL )
+        {
+            if ( stat != NULL )
+                *stat = mm->flags;
+            
+            p[0] = d >> 56;
+            p[1] = d >> 48;
+            p[2] = d >> 40;
+            p[3] = d >> 32;
+            p[4] = d >> 24;
+            p[5] = d >> 16;
+            p[6] = d >> 8;
+            p[7] = d;
+            return;
+        }
+    }
+    
+    // unmapped, crossing a mapping boundary or a lazy page boundary
     int hstat;
     mips_simple_write_w(m, a,     d >> 32, &hstat);
     if ( stat != NULL )
@@ -410,14 +1079,63 @@ void mips_simple_write_d(MIPS_Memory *m, MIPS_Addr a, uint64_t d, int *stat)
         *stat |= hstat;
 }
 
+/*!
+    \internal
+    \brief Host memory backing a run of bytes
+    \param n number of bytes wanted, receives the number of contiguous bytes available
+    \return host address, NULL if a is unmapped or not backed by host memory
+*/
+uint8_t* mips_simple_host_span(MIPS_Memory *m, MIPS_Addr a, uint32_t *n, int *stat)
+{
+    MemMapping *mm = mips_simple_mapping(m, a);
+    
+    if ( mm == NULL )
+    {
+        if ( stat != NULL )
+            *stat = MEM_UNMAPPED;
+        
+        return NULL;
+    }
+    
+    uint32_t avail = mm->end - a;
+    
+    if ( mm->type == MAP_LAZY && MEM_PAGE_SIZE - (a & MEM_PAGE_MASK) < avail )
+        avail = MEM_PAGE_SIZE - (a & MEM_PAGE_MASK);
+    
+    if ( *n > avail )
+        *n = avail;
+    
+    if ( mm->type == MAP_BLACKBOX )
+    {
+        int hstat = 0;
+        MIPS_Memory *r = (MIPS_Memory*)mm->mapped;
+        uint8_t *d = r->span != NULL ? r->span(r, a, n, &hstat) : NULL;
+        if ( stat != NULL )
+            *stat = mm->flags | hstat;
+        return d;
+    }
+    
+    uint8_t *d = mips_mapping_host(mm, a, 1);
+    
+    if ( stat != NULL )
+        *stat = d != NULL ? mm->flags : MEM_UNMAPPED;
+    
+    return d;
+}
+
 void mips_init_memory(MIPS *m)
 {
+    if ( m->config->flat_memory && !mips_flat_init(&m->mem) )
+        return;
+    
     mips_simple_init(&m->mem);
 }
 
 void mips_simple_init(MIPS_Memory *mem)
 {
-    mem->d = NULL;
+    mem->d = calloc(1, sizeof(MemSpace));
+    
+    mips_tlb_flush((MemSpace*)mem->d);
     
     mem->unmap  = mips_simple_unmap;
     
@@ -432,10 +1150,14 @@ void mips_simple_init(MIPS_Memory *mem)
     mem->read_w = mips_simple_read_w;
     mem->read_d = mips_simple_read_d;
     
+    mem->fetch_w = mips_simple_fetch_w;
+    
     mem->write_b = mips_simple_write_b;
     mem->write_h = mips_simple_write_h;
     mem->write_w = mips_simple_write_w;
     mem->write_d = mips_simple_write_d;
     
+    mem->span = mips_simple_host_span;
+    
     mem->dump_mapping = mips_simple_dump_mapping;
 }
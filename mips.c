@@ -19,7 +19,9 @@
 #include "io.h"
 #include "util.h"
 #include "decode.h"
+#include "files.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 extern void mips_init_memory(MIPS *m);
@@ -30,6 +32,14 @@ extern void mips_cleanup_processor(MIPS_Processor *hw);
 extern void mips_cleanup_coprocessor(MIPS_Coprocessor *hw);
 
 extern int mips_universal_decode(MIPS *m);
+extern int mips_threaded_decode(MIPS *m);
+extern int mips_jit_decode(MIPS *m);
+extern void mips_jit_destroy(MIPS_JIT *j);
+
+extern MIPS_ICache* mips_icache_create();
+extern void mips_icache_flush(MIPS_ICache *c);
+extern void mips_icache_destroy(MIPS_ICache *c);
+extern void mips_icache_invalidate(MIPS_ICache *c, MIPS_Addr a, uint32_t n);
 
 static const char *mips_isa_names[] = {
     NULL,
@@ -75,6 +85,63 @@ const char* mips_isa_name(int isa)
     return isa >= MIPS_ARCH_FIRST && isa < MIPS_ARCH_LAST ? mips_isa_names[isa - MIPS_ARCH_FIRST] : NULL;
 }
 
+static const char *mips_engine_names[MIPS_ENGINE_COUNT] = {
+    "universal",
+    "threaded",
+    "jit"
+};
+
+static const mips_decode mips_engines[MIPS_ENGINE_COUNT] = {
+    mips_universal_decode,
+    mips_threaded_decode,
+    mips_jit_decode
+};
+
+/*!
+    \brief Name<->id conversion for execution engines
+    \return engine id, -1 if the name does not match any engine
+*/
+int mips_engine_id(const char *name)
+{
+    if ( name == NULL )
+        return -1;
+    
+    for ( int i = 0; i < MIPS_ENGINE_COUNT; ++i )
+        if ( !strcmp(mips_engine_names[i], name) )
+            return i;
+    
+    return -1;
+}
+
+/*!
+    \brief Give the name of an execution engine
+*/
+const char* mips_engine_name(int engine)
+{
+    return engine >= 0 && engine < MIPS_ENGINE_COUNT ? mips_engine_names[engine] : NULL;
+}
+
+/*!
+    \brief Select the execution engine of a simulated machine
+    \return 0 on success
+    
+    All engines are semantically equivalent. Engines other than the
+    universal one fall back to it whenever they cannot honor tracing
+    or breakpoints.
+*/
+int mips_set_engine(MIPS *m, int engine)
+{
+    if ( m == NULL || engine < 0 || engine >= MIPS_ENGINE_COUNT )
+    {
+        mipsim_printf(IO_WARNING, "MIPS: Unknown execution engine\n");
+        return 1;
+    }
+    
+    m->decode = mips_engines[engine];
+    
+    return 0;
+}
+
 static const char *mips_default_reg_names[32] = {
     "$0",  "$1",  "$2",  "$3",  "$4",  "$5",  "$6",  "$7",
     "$8",  "$9",  "$10", "$11", "$12", "$13", "$14", "$15",
@@ -191,8 +258,13 @@ const char* mips_reg_name(int reg)
 /*!
     \brief Creates a simulated machine
     \param arch Architecture to simulate
+    \param cfg config of the machine, NULL for the config bound to the calling thread
+    
+    The config must outlive the machine. Guest I/O, logs and traces of the
+    machine go through its config, which is bound to the calling thread
+    while the machine runs.
 */
-MIPS* mips_create(int arch)
+MIPS* mips_create(int arch, MIPSIM_Config *cfg)
 {
     if ( arch <= MIPS_ARCH_NONE || arch >= MIPS_ARCH_LAST )
     {
@@ -202,10 +274,20 @@ MIPS* mips_create(int arch)
     
     MIPS *m = (MIPS*)malloc(sizeof(MIPS));
     
+    m->config = cfg != NULL ? cfg : mipsim_config();
     m->architecture = arch;
     m->decode = mips_universal_decode;
+    m->budget = 0;
+    m->exit_code = 0;
     
     m->breakpoints = NULL;
+    m->breakpoint_index = NULL;
+    m->breakpoint_types = 0;
+    m->breakpoint_pages = NULL;
+    m->breakpoint_opcodes = 0;
+    m->icache = mips_icache_create();
+    m->jit = NULL;
+    m->files = mips_files_create(m->config->sandbox_root);
     
     mips_init_memory(m);
     mips_init_processor(m);
@@ -233,6 +315,11 @@ void mips_reset(MIPS *m)
     
     m->mem.unmap(&m->mem);
     
+    mips_icache_flush(m->icache);
+    mips_files_close_all(m->files);
+    
+    m->exit_code = 0;
+    
     mips_init_memory(m);
 }
 
@@ -252,6 +339,11 @@ void mips_destroy(MIPS *m)
     
     m->mem.unmap(&m->mem);
     
+    mips_icache_destroy(m->icache);
+    mips_jit_destroy(m->jit);
+    mips_files_destroy(m->files);
+    mips_breakpoint_clear(m);
+    
     free(m);
 }
 
@@ -277,26 +369,100 @@ int mips_exec(MIPS *m, uint32_t n, int skip_proc)
     int nest = 0;
     m->stop_reason = MIPS_OK;
     
-    while ( (m->stop_reason == MIPS_OK) && n )
+    MIPSIM_Config *prev = mipsim_config_bind(m->config);
+    
+    if ( !skip_proc )
     {
-        MIPS_Native pc_pre = m->hw.get_pc(&m->hw);
-        MIPS_Native ra_pre = m->hw.get_reg(&m->hw, RA);
-        m->decode(m);
-        MIPS_Native pc_post = m->hw.get_pc(&m->hw);
-        MIPS_Native ra_post = m->hw.get_reg(&m->hw, RA);
-        
-        if ( skip_proc )
+        /*
+            engines execute at least one instruction per call and consume
+            the budget as they go (branch and delay slot counting as one)
+        */
+        while ( (m->stop_reason == MIPS_OK) && n )
         {
+            m->budget = n;
+            m->decode(m);
+            n = m->budget;
+        }
+    } else {
+        while ( (m->stop_reason == MIPS_OK) && n )
+        {
+            MIPS_Native pc_pre = m->hw.get_pc(&m->hw);
+            MIPS_Native ra_pre = m->hw.get_reg(&m->hw, RA);
+            m->budget = 1;
+            m->decode(m);
+            MIPS_Native pc_post = m->hw.get_pc(&m->hw);
+            MIPS_Native ra_post = m->hw.get_reg(&m->hw, RA);
+            
             if ( ra_post != ra_pre && ra_post == pc_pre + 8 )
                 ++nest;
             else if ( ra_post == ra_pre && pc_post == ra_pre )
                 --nest;
+            
+            if ( !nest )
+                --n;
+        }
+    }
+    
+    mipsim_flush(IO_MONITOR, FLUSH_STOP);
+    mipsim_config_bind(prev);
+    
+    return m->stop_reason;
+}
+
+/*!
+    \brief Run a simulated machine until it stops
+    \param m machine
+    \param limit maximum number of instructions to execute, 0 for no limit
+    \param count if not NULL, receives the number of instructions executed
+    \return stop reason, MIPS_LIMIT if \a limit was reached first
+    
+    Unlike mips_exec, no bookkeeping is done between instructions : the
+    execution engine runs uninterrupted until the machine stops or the
+    budget is exhausted.
+*/
+int mips_run(MIPS *m, uint64_t limit, uint64_t *count)
+{
+    if ( m == NULL || m->decode == NULL )
+    {
+        mipsim_printf(IO_WARNING, "MIPS: Cannot run NULL machine");
+        return MIPS_ERROR;
+    }
+    
+    uint64_t done = 0;
+    m->stop_reason = MIPS_OK;
+    
+    MIPSIM_Config *prev = mipsim_config_bind(m->config);
+    
+    while ( m->stop_reason == MIPS_OK )
+    {
+        uint32_t chunk = 0xFFFFFFFF;
+        
+        if ( limit )
+        {
+            if ( done >= limit )
+            {
+                m->stop_reason = MIPS_LIMIT;
+                break;
+            }
+            
+            if ( limit - done < chunk )
+                chunk = limit - done;
         }
         
-        if ( !nest )
-            --n;
+        m->budget = chunk;
+        
+        while ( m->stop_reason == MIPS_OK && m->budget )
+            m->decode(m);
+        
+        done += chunk - m->budget;
     }
     
+    if ( count != NULL )
+        *count = done;
+    
+    mipsim_flush(IO_MONITOR, FLUSH_STOP);
+    mipsim_config_bind(prev);
+    
     return m->stop_reason;
 }
 
@@ -314,6 +480,28 @@ void mips_stop(MIPS *m, int reason)
     }
 }
 
+static const char *mips_stop_reason_names[] = {
+    "Running",
+    "Quit",
+    "Invalid instruction",
+    "Unsupported instruction",
+    "Trap",
+    "Break",
+    "Exception",
+    "Internal error",
+    "Unpredictable behavior",
+    "Breakpoint",
+    "Instruction limit reached"
+};
+
+/*!
+    \brief Give a human-readable description of a stop reason
+*/
+const char* mips_stop_reason_name(int reason)
+{
+    return reason >= MIPS_OK && reason <= MIPS_LIMIT ? mips_stop_reason_names[reason] : "Unknown status";
+}
+
 /*!
     \brief Getter to simulated machine registers
 */
@@ -404,6 +592,7 @@ uint64_t mips_read_d(MIPS *m, MIPS_Addr a, int *stat)
 void mips_write_b(MIPS *m, MIPS_Addr a, uint8_t b,  int *stat)
 {
     m->mem.write_b(&m->mem, a, b, stat);
+    mips_icache_invalidate(m->icache, a, 1);
 }
 
 /*!
@@ -412,6 +601,7 @@ void mips_write_b(MIPS *m, MIPS_Addr a, uint8_t b,  int *stat)
 void mips_write_h(MIPS *m, MIPS_Addr a, uint16_t h, int *stat)
 {
     m->mem.write_h(&m->mem, a, h, stat);
+    mips_icache_invalidate(m->icache, a, 2);
 }
 
 /*!
@@ -420,6 +610,7 @@ void mips_write_h(MIPS *m, MIPS_Addr a, uint16_t h, int *stat)
 void mips_write_w(MIPS *m, MIPS_Addr a, uint32_t w, int *stat)
 {
     m->mem.write_w(&m->mem, a, w, stat);
+    mips_icache_invalidate(m->icache, a, 4);
 }
 
 /*!
@@ -428,6 +619,560 @@ void mips_write_w(MIPS *m, MIPS_Addr a, uint32_t w, int *stat)
 void mips_write_d(MIPS *m, MIPS_Addr a, uint64_t d, int *stat)
 {
     m->mem.write_d(&m->mem, a, d, stat);
+    mips_icache_invalidate(m->icache, a, 8);
+}
+
+/*
+    Block accessors work on the longest runs of host memory the memory
+    controller can hand out (see mem_span) and only fall back to byte
+    accesses for memory that is not backed by host memory.
+*/
+
+/*!
+    \internal
+    \brief Locate the next run of host memory of a block access
+    \param n number of bytes left, receives the length of the run
+    \return host address of the run, NULL if the byte at a must be accessed alone
+*/
+static uint8_t* mips_block_span(MIPS *m, MIPS_Addr a, uint32_t *n, int *stat)
+{
+    uint8_t *d = m->mem.span != NULL ? m->mem.span(&m->mem, a, n, stat) : NULL;
+    
+    if ( d == NULL )
+        *n = 1;
+    
+    return d;
+}
+
+/*!
+    \brief Direct host access to a run of simulated memory
+    \param n number of bytes wanted, receives the length of the run
+    \param write whether the run is about to be written
+    \return host address of the run, NULL if a cannot be accessed directly
+    
+    When write is set the run is writable and the decoded instructions it
+    covers are discarded, so the caller must be done writing before the
+    machine resumes. A NULL return does not imply a fault : block accessors
+    should be used to find out.
+*/
+uint8_t* mips_host_span(MIPS *m, MIPS_Addr a, uint32_t *n, int write)
+{
+    int stat = MEM_OK;
+    uint8_t *d = m->mem.span != NULL ? m->mem.span(&m->mem, a, n, &stat) : NULL;
+    
+    if ( d == NULL || (stat & MEM_UNMAPPED) || (write && (stat & MEM_READONLY)) )
+        return NULL;
+    
+    if ( write )
+        mips_icache_invalidate(m->icache, a, *n);
+    
+    return d;
+}
+
+/*!
+    \brief Copy a range of simulated memory to host memory
+    \param a address of the first byte to read
+    \param d destination buffer
+    \param n number of bytes to read
+    \param fault receives the address of the first unmapped byte, if any
+    \return 0 on success, the status of the faulting access otherwise
+*/
+int mips_read_block(MIPS *m, MIPS_Addr a, void *d, uint32_t n, MIPS_Addr *fault)
+{
+    uint8_t *p = (uint8_t*)d;
+    
+    while ( n )
+    {
+        int stat = MEM_OK;
+        uint32_t run = n;
+        const uint8_t *h = mips_block_span(m, a, &run, &stat);
+        
+        if ( h == NULL && !(stat & MEM_UNMAPPED) )
+            *p = m->mem.read_b(&m->mem, a, &stat);
+        
+        if ( stat & MEM_UNMAPPED )
+        {
+            if ( fault != NULL )
+                *fault = a;
+            
+            return stat;
+        }
+        
+        if ( h != NULL )
+            memcpy(p, h, run);
+        
+        p += run;
+        a += run;
+        n -= run;
+    }
+    
+    return MEM_OK;
+}
+
+/*!
+    \brief Copy host memory to a range of simulated memory
+    \param a address of the first byte to write
+    \param d source buffer
+    \param n number of bytes to write
+    \param fault receives the address of the first unmapped or read-only byte, if any
+    \return 0 on success, the status of the faulting access otherwise
+    
+    Bytes preceding the faulting one are written.
+*/
+int mips_write_block(MIPS *m, MIPS_Addr a, const void *d, uint32_t n, MIPS_Addr *fault)
+{
+    const uint8_t *p = (const uint8_t*)d;
+    
+    while ( n )
+    {
+        int stat = MEM_OK;
+        uint32_t run = n;
+        uint8_t *h = mips_block_span(m, a, &run, &stat);
+        
+        if ( h == NULL && !(stat & (MEM_UNMAPPED | MEM_READONLY)) )
+            m->mem.write_b(&m->mem, a, *p, &stat);
+        
+        if ( stat & (MEM_UNMAPPED | MEM_READONLY) )
+        {
+            if ( fault != NULL )
+                *fault = a;
+            
+            return stat;
+        }
+        
+        if ( h != NULL )
+            memcpy(h, p, run);
+        
+        mips_icache_invalidate(m->icache, a, run);
+        
+        p += run;
+        a += run;
+        n -= run;
+    }
+    
+    return MEM_OK;
+}
+
+/*!
+    \brief Copy a range of simulated memory to another
+    \param dst address of the first byte to write
+    \param src address of the first byte to read
+    \param n number of bytes to copy
+    \param fault receives the address of the first faulting byte (source or destination)
+    \return 0 on success, the status of the faulting access otherwise
+    
+    Overlapping ranges are handled like memmove.
+*/
+int mips_copy(MIPS *m, MIPS_Addr dst, MIPS_Addr src, uint32_t n, MIPS_Addr *fault)
+{
+    uint8_t buffer[4096];
+    
+    // copy from the end when the destination overlaps the end of the source
+    int backward = dst > src && dst - src < n;
+    
+    while ( n )
+    {
+        uint32_t c = n < sizeof(buffer) ? n : sizeof(buffer);
+        uint32_t off = backward ? n - c : 0;
+        
+        int ret = mips_read_block(m, src + off, buffer, c, fault);
+        
+        if ( !ret )
+            ret = mips_write_block(m, dst + off, buffer, c, fault);
+        
+        if ( ret )
+            return ret;
+        
+        if ( !backward )
+        {
+            src += c;
+            dst += c;
+        }
+        
+        n -= c;
+    }
+    
+    return MEM_OK;
+}
+
+/*!
+    \brief Set a range of simulated memory to a given value
+    \param fault receives the address of the first unmapped or read-only byte, if any
+    \return 0 on success, the status of the faulting access otherwise
+*/
+int mips_fill(MIPS *m, MIPS_Addr a, uint8_t v, uint32_t n, MIPS_Addr *fault)
+{
+    while ( n )
+    {
+        int stat = MEM_OK;
+        uint32_t run = n;
+        uint8_t *h = mips_block_span(m, a, &run, &stat);
+        
+        if ( h == NULL && !(stat & (MEM_UNMAPPED | MEM_READONLY)) )
+            m->mem.write_b(&m->mem, a, v, &stat);
+        
+        if ( stat & (MEM_UNMAPPED | MEM_READONLY) )
+        {
+            if ( fault != NULL )
+                *fault = a;
+            
+            return stat;
+        }
+        
+        if ( h != NULL )
+            memset(h, v, run);
+        
+        mips_icache_invalidate(m->icache, a, run);
+        
+        a += run;
+        n -= run;
+    }
+    
+    return MEM_OK;
+}
+
+/*!
+    \brief Fetch a NUL-terminated string from simulated memory
+    \param fault receives the address of the first unmapped byte, if any
+    \return string (to be free'd by caller), NULL if an unmapped byte precedes
+    the terminator
+*/
+char* mips_read_str(MIPS *m, MIPS_Addr a, MIPS_Addr *fault)
+{
+    size_t len = 0, alloc = 64;
+    char *s = (char*)malloc(alloc);
+    
+    while ( s != NULL )
+    {
+        int stat = MEM_OK;
+        uint8_t b;
+        
+        // stop at page boundaries : the terminator is usually close
+        uint32_t run = 0x1000 - (a & 0xFFF);
+        const uint8_t *h = mips_block_span(m, a, &run, &stat);
+        
+        if ( h == NULL && !(stat & MEM_UNMAPPED) )
+        {
+            b = m->mem.read_b(&m->mem, a, &stat);
+            h = &b;
+        }
+        
+        if ( stat & MEM_UNMAPPED )
+        {
+            if ( fault != NULL )
+                *fault = a;
+            
+            free(s);
+            return NULL;
+        }
+        
+        const uint8_t *z = (const uint8_t*)memchr(h, 0, run);
+        uint32_t c = z != NULL ? (uint32_t)(z - h) : run;
+        
+        if ( len + c + 1 > alloc )
+        {
+            while ( len + c + 1 > alloc )
+                alloc *= 2;
+            
+            char *tmp = (char*)realloc(s, alloc);
+            
+            if ( tmp == NULL )
+                free(s);
+            
+            s = tmp;
+            
+            if ( s == NULL )
+                break;
+        }
+        
+        memcpy(s + len, h, c);
+        len += c;
+        
+        if ( z != NULL )
+        {
+            s[len] = 0;
+            break;
+        }
+        
+        a += run;
+    }
+    
+    return s;
+}
+
+/*
+    Breakpoints are compiled into one index per type, built lazily on the
+    first test following a change. Within a type, breakpoints sharing the
+    same mask form a group of ranges sorted by start address, with the
+    running maximum of range ends allowing binary search over overlapping
+    ranges.
+    
+    The index also provides prefilters for the per-instruction tests : a
+    bitmap of 4kB pages holding memx breakpoints and a set of primary
+    opcodes that opcode breakpoints may match.
+*/
+
+#define BKPT_INDEX_TYPES 4
+
+typedef struct _BreakpointRange {
+    MIPS_Addr start, end, max_end;
+    int id;
+} BreakpointRange;
+
+typedef struct _BreakpointGroup {
+    MIPS_Addr mask;
+    int count, alloc;
+    BreakpointRange *ranges;
+} BreakpointGroup;
+
+#define BKPT_PAGE_WORDS (1 << (32 - BKPT_PAGE_SHIFT - 5))
+
+struct _BreakpointIndex {
+    int ngroup[BKPT_INDEX_TYPES];
+    BreakpointGroup *groups[BKPT_INDEX_TYPES];
+    
+    uint32_t *pages;
+};
+
+/*!
+    \internal
+    \brief Free the breakpoint index and mark it for rebuild
+    
+    Until the next rebuild every breakpoint type is assumed present so that
+    tests reach mips_breakpoint_find.
+*/
+void mips_breakpoint_invalidate(MIPS *m)
+{
+    BreakpointIndex *idx = m->breakpoint_index;
+    
+    if ( idx != NULL )
+    {
+        for ( int t = 0; t < BKPT_INDEX_TYPES; ++t )
+        {
+            for ( int g = 0; g < idx->ngroup[t]; ++g )
+                free(idx->groups[t][g].ranges);
+            
+            free(idx->groups[t]);
+        }
+        
+        free(idx->pages);
+        free(idx);
+        m->breakpoint_index = NULL;
+    }
+    
+    m->breakpoint_types = m->breakpoints != NULL ? BKPT_TYPE_MASK : 0;
+    m->breakpoint_pages = NULL;
+    m->breakpoint_opcodes = ~(uint64_t)0;
+}
+
+static int bkpt_range_cmp(const void *a, const void *b)
+{
+    const BreakpointRange *ra = (const BreakpointRange*)a;
+    const BreakpointRange *rb = (const BreakpointRange*)b;
+    
+    return ra->start < rb->start ? -1 : (ra->start > rb->start ? 1 : 0);
+}
+
+/*!
+    \internal
+    \brief Build the per-type breakpoint index
+    \return 0 on success, 1 if out of memory, the index being left unbuilt
+*/
+static int mips_breakpoint_build(MIPS *m)
+{
+    BreakpointIndex *idx = calloc(1, sizeof(BreakpointIndex));
+    
+    if ( idx == NULL )
+        return 1;
+    
+    m->breakpoint_index = idx;
+    m->breakpoint_types = 0;
+    m->breakpoint_opcodes = 0;
+    
+    for ( BreakpointList *l = m->breakpoints; l != NULL; l = l->next )
+    {
+        Breakpoint *b = &l->d;
+        
+        if ( (b->type & BKPT_DISABLED) || b->start > b->end )
+            continue;
+        
+        for ( int t = 0; t < BKPT_INDEX_TYPES; ++t )
+        {
+            if ( !(b->type & (1 << t)) )
+                continue;
+            
+            BreakpointGroup *g = NULL;
+            
+            for ( int i = 0; i < idx->ngroup[t]; ++i )
+                if ( idx->groups[t][i].mask == b->mask )
+                    g = &idx->groups[t][i];
+            
+            if ( g == NULL )
+            {
+                BreakpointGroup *groups = realloc(idx->groups[t], (idx->ngroup[t] + 1) * sizeof(BreakpointGroup));
+                
+                if ( groups == NULL )
+                    goto oom;
+                
+                idx->groups[t] = groups;
+                g = &groups[idx->ngroup[t]++];
+                g->mask = b->mask;
+                g->count = g->alloc = 0;
+                g->ranges = NULL;
+            }
+            
+            if ( g->count == g->alloc )
+            {
+                int alloc = g->alloc ? 2 * g->alloc : 4;
+                BreakpointRange *ranges = realloc(g->ranges, alloc * sizeof(BreakpointRange));
+                
+                if ( ranges == NULL )
+                    goto oom;
+                
+                g->ranges = ranges;
+                g->alloc = alloc;
+            }
+            
+            BreakpointRange *r = &g->ranges[g->count++];
+            r->start = b->start;
+            r->end   = b->end;
+            r->id    = b->id;
+            
+            m->breakpoint_types |= 1 << t;
+        }
+        
+        if ( b->type & BKPT_MEM_X )
+        {
+            // V & mask can only fall in [start, end] on pages spanned by the
+            // range when the mask keeps every page bit
+            const MIPS_Addr pmask = ~(MIPS_Addr)0 << BKPT_PAGE_SHIFT;
+            uint32_t first = 0, last = ~(MIPS_Addr)0 >> BKPT_PAGE_SHIFT;
+            
+            if ( (b->mask & pmask) == pmask )
+            {
+                first = b->start >> BKPT_PAGE_SHIFT;
+                last  = b->end   >> BKPT_PAGE_SHIFT;
+            }
+            
+            if ( idx->pages == NULL && (idx->pages = calloc(BKPT_PAGE_WORDS, sizeof(uint32_t))) == NULL )
+                goto oom;
+            
+            for ( uint32_t p = first; p <= last; ++p )
+                idx->pages[p >> 5] |= 1u << (p & 31);
+        }
+        
+        if ( b->type & BKPT_OPCODE )
+        {
+            // same reasoning for the 6 bits of the primary opcode field
+            const MIPS_Addr omask = ~(MIPS_Addr)0 << 26;
+            
+            if ( (b->mask & omask) == omask )
+            {
+                for ( uint32_t op = b->start >> 26; op <= (b->end >> 26); ++op )
+                    m->breakpoint_opcodes |= (uint64_t)1 << op;
+            } else {
+                m->breakpoint_opcodes = ~(uint64_t)0;
+            }
+        }
+    }
+    
+    m->breakpoint_pages = idx->pages;
+    
+    for ( int t = 0; t < BKPT_INDEX_TYPES; ++t )
+    {
+        for ( int i = 0; i < idx->ngroup[t]; ++i )
+        {
+            BreakpointGroup *g = &idx->groups[t][i];
+            
+            qsort(g->ranges, g->count, sizeof(BreakpointRange), bkpt_range_cmp);
+            
+            MIPS_Addr max_end = 0;
+            
+            for ( int j = 0; j < g->count; ++j )
+            {
+                if ( g->ranges[j].end > max_end )
+                    max_end = g->ranges[j].end;
+                
+                g->ranges[j].max_end = max_end;
+            }
+        }
+    }
+    
+    return 0;
+    
+oom:
+    // back to conservative prefilters and list scans
+    mips_breakpoint_invalidate(m);
+    return 1;
+}
+
+/*!
+    \internal
+    \brief Find the breakpoint hit by a value by scanning the whole list
+    \see mips_breakpoint_find
+*/
+static int mips_breakpoint_scan(MIPS *m, MIPS_Addr val, int type)
+{
+    for ( BreakpointList *l = m->breakpoints; l != NULL; l = l->next )
+    {
+        // most recent first
+        if ( !(l->d.type & BKPT_DISABLED)
+            && ((l->d.type & BKPT_TYPE_MASK) & type)
+            && (l->d.start <= (val & l->d.mask))
+            && (l->d.end   >= (val & l->d.mask)) )
+            return l->d.id;
+    }
+    
+    return -1;
+}
+
+/*!
+    \brief Find the breakpoint hit by a value
+    \param m simulated machine
+    \param val tested value (address or opcode)
+    \param type breakpoint type(s) to consider
+    \return id of the most recent matching breakpoint, -1 if none
+*/
+int mips_breakpoint_find(MIPS *m, MIPS_Addr val, int type)
+{
+    if ( m->breakpoint_index == NULL && mips_breakpoint_build(m) )
+        return mips_breakpoint_scan(m, val, type);
+    
+    int hit = -1;
+    BreakpointIndex *idx = m->breakpoint_index;
+    
+    for ( int t = 0; t < BKPT_INDEX_TYPES; ++t )
+    {
+        if ( !(type & (1 << t)) )
+            continue;
+        
+        for ( int i = 0; i < idx->ngroup[t]; ++i )
+        {
+            const BreakpointGroup *g = &idx->groups[t][i];
+            const MIPS_Addr v = val & g->mask;
+            
+            // last range starting at or before v
+            int lo = 0, hi = g->count;
+            
+            while ( lo < hi )
+            {
+                int mid = (lo + hi) / 2;
+                
+                if ( g->ranges[mid].start <= v )
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            
+            for ( int j = lo - 1; j >= 0 && g->ranges[j].max_end >= v; --j )
+            {
+                if ( g->ranges[j].end >= v && g->ranges[j].id > hit )
+                    hit = g->ranges[j].id;
+            }
+        }
+    }
+    
+    return hit;
 }
 
 /*!
@@ -456,6 +1201,8 @@ int mips_breakpoint_add(MIPS *m, int type, MIPS_Addr start, MIPS_Addr end, MIPS_
     l->next    = m->breakpoints;
     m->breakpoints = l;
     
+    mips_breakpoint_invalidate(m);
+    
     return l->d.id;
 }
 
@@ -478,6 +1225,7 @@ void mips_breakpoint_remove(MIPS *m, int id)
                 m->breakpoints = bkpt->next;
             
             free(bkpt);
+            mips_breakpoint_invalidate(m);
             break;
         }
         
@@ -507,6 +1255,8 @@ void mips_breakpoint_clear(MIPS *m)
 {
     mips_breakpoint_list_delete(m->breakpoints);
     m->breakpoints = NULL;
+    
+    mips_breakpoint_invalidate(m);
 }
 
 /*!
@@ -547,7 +1297,11 @@ Breakpoint* mips_breakpoint(MIPS *m, int id)
     while ( bkpt != NULL )
     {
         if ( bkpt->d.id == id )
+        {
+            // the caller may alter the breakpoint
+            mips_breakpoint_invalidate(m);
             return &bkpt->d;
+        }
         
         bkpt = bkpt->next;
     }
@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <memory.h>
 
+#include "config.h"
+
 typedef uint32_t MIPS_Addr;
 typedef int32_t MIPS_Native;
 typedef int32_t MIPS_NativeU;
@@ -62,6 +64,8 @@ typedef void (*mem_write_half) (MIPS_Memory *m, MIPS_Addr a, uint16_t h, int *st
 typedef void (*mem_write_word) (MIPS_Memory *m, MIPS_Addr a, uint32_t w, int *stat);
 typedef void (*mem_write_dword)(MIPS_Memory *m, MIPS_Addr a, uint64_t d, int *stat);
 
+typedef uint8_t* (*mem_span)(MIPS_Memory *m, MIPS_Addr a, uint32_t *n, int *stat);
+
 struct _MIPS_Memory {
     mem_unmap     unmap;
     
@@ -74,11 +78,15 @@ struct _MIPS_Memory {
     mem_read_word  read_w;
     mem_read_dword read_d;
     
+    mem_read_word  fetch_w;
+    
     mem_write_byte  write_b;
     mem_write_half  write_h;
     mem_write_word  write_w;
     mem_write_dword write_d;
     
+    mem_span span;
+    
     mem_pagefault pagefault;
     
     mem_dump_mapping dump_mapping;
@@ -205,7 +213,8 @@ enum {
     MIPS_EXCEPTION,
     MIPS_ERROR,
     MIPS_UNPREDICTABLE,
-    MIPS_BKPT
+    MIPS_BKPT,
+    MIPS_LIMIT
 };
 
 typedef struct _MIPS MIPS;
@@ -223,12 +232,19 @@ enum {
     BKPT_DISABLED = 0x10000
 };
 
+#define BKPT_PAGE_SHIFT 12
+
 typedef struct _Breakpoint {
     int id, type;
     MIPS_Addr start, end, mask;
 } Breakpoint;
 
 typedef struct _BreakpointList BreakpointList;
+typedef struct _BreakpointIndex BreakpointIndex;
+
+typedef struct _MIPS_ICache MIPS_ICache;
+typedef struct _MIPS_JIT MIPS_JIT;
+typedef struct _MIPS_Files MIPS_Files;
 
 struct _BreakpointList {
     Breakpoint d;
@@ -241,13 +257,25 @@ struct _MIPS {
     MIPS_Coprocessor cp[4];
     
     mips_decode decode;
+    uint32_t budget;
     
     int architecture;
     
     int stop_reason;
     int breakpoint_hit;
+    MIPS_Native exit_code;
     
     BreakpointList *breakpoints;
+    BreakpointIndex *breakpoint_index;
+    int breakpoint_types;
+    const uint32_t *breakpoint_pages;
+    uint64_t breakpoint_opcodes;
+    
+    MIPS_ICache *icache;
+    MIPS_JIT *jit;
+    MIPS_Files *files;
+    
+    MIPSIM_Config *config;
 };
 
 enum MIPS_Architecture {
@@ -278,15 +306,29 @@ enum MIPS_Architecture {
 int mips_isa_id(const char* name);
 const char* mips_isa_name(int isa);
 
+enum MIPS_Engine {
+    MIPS_ENGINE_UNIVERSAL,
+    MIPS_ENGINE_THREADED,
+    MIPS_ENGINE_JIT,
+    
+    MIPS_ENGINE_COUNT
+};
+
+int mips_engine_id(const char *name);
+const char* mips_engine_name(int engine);
+int mips_set_engine(MIPS *m, int engine);
+
 int mips_reg_id(const char *name);
 const char* mips_reg_name(int reg);
 
-MIPS* mips_create(int arch);
+MIPS* mips_create(int arch, MIPSIM_Config *cfg);
 void mips_destroy(MIPS *m);
 void mips_reset(MIPS *m);
 
 int mips_exec(MIPS *m, uint32_t n, int skip_proc);
+int mips_run(MIPS *m, uint64_t limit, uint64_t *count);
 void mips_stop(MIPS *m, int reason);
+const char* mips_stop_reason_name(int reason);
 
 /*
     helpers to abstract away some of the not so nice implementation details
@@ -305,6 +347,13 @@ void mips_write_h(MIPS *m, MIPS_Addr a, uint16_t h, int *stat);
 void mips_write_w(MIPS *m, MIPS_Addr a, uint32_t w, int *stat);
 void mips_write_d(MIPS *m, MIPS_Addr a, uint64_t d, int *stat);
 
+uint8_t* mips_host_span(MIPS *m, MIPS_Addr a, uint32_t *n, int write);
+int mips_read_block(MIPS *m, MIPS_Addr a, void *d, uint32_t n, MIPS_Addr *fault);
+int mips_write_block(MIPS *m, MIPS_Addr a, const void *d, uint32_t n, MIPS_Addr *fault);
+int mips_copy(MIPS *m, MIPS_Addr dst, MIPS_Addr src, uint32_t n, MIPS_Addr *fault);
+int mips_fill(MIPS *m, MIPS_Addr a, uint8_t v, uint32_t n, MIPS_Addr *fault);
+char* mips_read_str(MIPS *m, MIPS_Addr a, MIPS_Addr *fault);
+
 /*
     Breakpoint management
 */
@@ -315,11 +364,15 @@ void mips_breakpoint_clear(MIPS *m);
 
 int mips_breakpoint_count(MIPS *m, int type);
 Breakpoint* mips_breakpoint(MIPS *m, int id);
+int mips_breakpoint_find(MIPS *m, MIPS_Addr val, int type);
 
 /*
     Disassembly
 */
 typedef const char* (symbol_name)(MIPS_Addr org, MIPS_Addr val, void *d);
 char* mips_disassemble(MIPS *m, MIPS_Addr a, symbol_name sym_name, void *sym_data);
+char* mips_disassemble_word(MIPS_Addr a, uint32_t w, symbol_name sym_name, void *sym_data);
+
+void mips_trace_instr(int arch, MIPS_Addr pc, uint32_t ir);
 
 #endif
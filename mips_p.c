@@ -18,19 +18,7 @@
 
 #include "io.h"
 #include "monitor.h"
-
-typedef struct _MIPS_Processor_Private {
-    MIPS *m;
-    
-    MIPS_Addr pc;
-    
-    MIPS_Native r[32];
-    
-    MIPS_Native hi, lo;
-    int hi_lo_status;
-    
-    uint32_t ir;
-} MIPS_Processor_Private;
+#include "trace.h"
 
 void _mips_reset_p(MIPS_Processor *p)
 {
@@ -41,6 +29,8 @@ void _mips_reset_p(MIPS_Processor *p)
     d->hi = d->lo = 0;
     d->hi_lo_status = 0;
     d->ir = 0;
+    d->branch_pending = 0;
+    d->branch_target = 0;
 }
 
 MIPS_Native _mips_get_pc(MIPS_Processor *p)
@@ -89,7 +79,7 @@ uint32_t _mips_fetch(MIPS_Processor *p, int *stat)
         return 0;
     }
     
-    d->ir = m->read_w(m, d->pc, stat);
+    d->ir = m->fetch_w(m, d->pc, stat);
     
     return d->ir;
 }
@@ -161,7 +151,10 @@ void _mips_set_gpr_p(MIPS_Processor *p, int gpr, MIPS_Native value)
     {
         if ( gpr > 0 && gpr < 32 )
         {
-            mipsim_printf(IO_TRACE, "\t%s = 0x%08x\n", mips_reg_name(gpr), value);
+            mipsim_trace("\t%s = 0x%08x\n", mips_reg_name(gpr), value);
+            
+            if ( mips_trace_on() )
+                mips_trace_set(gpr, value);
             
             ((MIPS_Processor_Private*)p->d)->r[gpr] = value;
         } else if ( gpr ) {
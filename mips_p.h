@@ -19,4 +19,30 @@
     \author Hugues Bruant
 */
 
+/*!
+    \brief Processor state
+    
+    Execution engines access it directly instead of going through the
+    MIPS_Processor accessors. r[0] is always zero.
+*/
+typedef struct _MIPS_Processor_Private {
+    MIPS *m;
+    
+    MIPS_Addr pc;
+    
+    MIPS_Native r[32];
+    
+    MIPS_Native hi, lo;
+    int hi_lo_status;
+    
+    uint32_t ir;
+    
+    /*
+        set by branch handlers, the branch is taken once the delay slot
+        has been executed
+    */
+    int branch_pending;
+    MIPS_Addr branch_target;
+} MIPS_Processor_Private;
+
 #endif
@@ -19,20 +19,16 @@
 #include "io.h"
 #include "config.h"
 
-static ELF32_Addr section_addr_end[] = {
-    0, 0
-};
-
 /*!
     \brief Auxiliary function for section placement
+    \param end end of the text and data areas, updated
     \param name section name
     \param size section size
     \return address at which the section should be placed
     
-    This function uses *ugly* static variables. It is neither thread-safe
-    nor reentrant.
+    A data area end of 0xFFFFFFFF means that data follows text.
 */
-ELF32_Addr section_addr(const char *name, ELF32_Word size)
+ELF32_Addr section_addr(ELF32_Addr end[2], const char *name, ELF32_Word size)
 {
     if ( name == NULL )
         return 0;
@@ -46,17 +42,17 @@ ELF32_Addr section_addr(const char *name, ELF32_Word size)
     } else if ( !strcmp(name, ".data")
                 || !strcmp(name, ".rodata")
                 || !strcmp(name, ".bss") ) {
-        n = section_addr_end[1] == 0xFFFFFFFF ? 0 : 1;
+        n = end[1] == 0xFFFFFFFF ? 0 : 1;
     }
     
     if ( n != -1 )
     {
-        a = section_addr_end[n];
+        a = end[n];
         
         if ( a & 0xFFF )
-            section_addr_end[n] = a = (a & ~0xFFF) + 0x1000;
+            end[n] = a = (a & ~0xFFF) + 0x1000;
         
-        section_addr_end[n] += size;
+        end[n] += size;
     } else {
         mipsim_printf(IO_WARNING, "Asked to place section %s. No idea what to do...\n", name);
     }
@@ -67,18 +63,17 @@ ELF32_Addr section_addr(const char *name, ELF32_Word size)
 /*!
     \brief "Place" all relocatable sections of an ELF file
     \param elf file to place
+    \param cfg placement constraints
+    \param end receives the end of the text and data areas
     \return 0 on success
     
     Placement follows config constraints (text/data positions and size) but no overlap
     chekc is performed
-    
-    \note This function uses \ref section_addr and suffers from the same limitations
 */
-int place_sections(ELF_File *elf)
+int place_sections(ELF_File *elf, const MIPSIM_Config *cfg, ELF32_Addr end[2])
 {
-    MIPSIM_Config *cfg = mipsim_config();
-    section_addr_end[0] = cfg->reloc_text;
-    section_addr_end[1] = cfg->reloc_data;
+    end[0] = cfg->reloc_text;
+    end[1] = cfg->reloc_data;
     
     if ( cfg->reloc_data < cfg->reloc_text )
     {
@@ -100,7 +95,7 @@ int place_sections(ELF_File *elf)
         {
             ELF32_Word size;
             const char *name = elf_section_name(elf, i, &size);
-            s->s_addr = section_addr(name, size);
+            s->s_addr = section_addr(end, name, size);
             /*
             if ( s->s_addr + s->s_size > cfg->address_max )
             {
@@ -116,18 +111,15 @@ int place_sections(ELF_File *elf)
 }
 
 /*!
-    \brief Load an executable from a ELF file into a simulated machine
-    \param m target machine
-    \param f ELF file
-    
-    Both executable and relocatable ELF files can be loaded, provided they
-    don't have any external dependencies.
+    \internal
+    \brief Load an ELF file, with the config of the target machine bound
 */
-int mips_load_elf(MIPS *m, ELF_File *f)
+static int load_elf(MIPS *m, ELF_File *f)
 {
     ELF32_Word sz = 0;
     ELF32_Addr last = 0;
-    MIPSIM_Config *cfg = mipsim_config();
+    ELF32_Addr end[2];
+    MIPSIM_Config *cfg = m->config;
     
     if ( f->header->e_type == ET_EXEC )
     {
@@ -211,7 +203,7 @@ int mips_load_elf(MIPS *m, ELF_File *f)
         //  - map code on a section basis, check for overlap
         //  - honor WX attributes
         
-        if ( place_sections(f) )
+        if ( place_sections(f, cfg, end) )
         {
             mipsim_printf(IO_WARNING, "Section placement failed\n");
             return 1;
@@ -259,7 +251,7 @@ int mips_load_elf(MIPS *m, ELF_File *f)
         
         // allocate remaining space between static data and first invalid address (used for both
         // stack and dynamic data)
-        ELF32_Addr dla = section_addr_end[1] == 0xFFFFFFFF ? section_addr_end[0] : section_addr_end[1];
+        ELF32_Addr dla = end[1] == 0xFFFFFFFF ? end[0] : end[1];
         ELF32_Addr la = (dla + (cfg->phys_memory_size - sz)) & 0xFFFFF000;
         
         if ( la <= dla + 0x400 )
@@ -286,3 +278,20 @@ int mips_load_elf(MIPS *m, ELF_File *f)
     return 0;
 }
 
+/*!
+    \brief Load an executable from a ELF file into a simulated machine
+    \param m target machine
+    \param f ELF file
+    
+    Both executable and relocatable ELF files can be loaded, provided they
+    don't have any external dependencies. Placement and memory layout follow
+    the config of the target machine.
+*/
+int mips_load_elf(MIPS *m, ELF_File *f)
+{
+    MIPSIM_Config *prev = mipsim_config_bind(m->config);
+    int ret = load_elf(m, f);
+    mipsim_config_bind(prev);
+    
+    return ret;
+}
@@ -0,0 +1,361 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+// strdup is not part of C99
+#define _DEFAULT_SOURCE
+
+#include "mipsim.h"
+
+/*!
+    \file mipsim.c
+    \brief Embedding API of libmipsim
+    \author Hugues Bruant
+    
+    Thin layer over the simulator internals : public values are checked at
+    compile time against internal ones so that they can be passed through.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "io.h"
+#include "mips.h"
+#include "mipself.h"
+#include "files.h"
+
+typedef char mipsim_check_stop[(int)MIPSIM_STOP_NONE == MIPS_OK
+                               && (int)MIPSIM_STOP_QUIT == MIPS_QUIT
+                               && (int)MIPSIM_STOP_INVALID == MIPS_INVALID
+                               && (int)MIPSIM_STOP_UNSUPPORTED == MIPS_UNSUPPORTED
+                               && (int)MIPSIM_STOP_TRAP == MIPS_TRAP
+                               && (int)MIPSIM_STOP_BREAK == MIPS_BREAK
+                               && (int)MIPSIM_STOP_EXCEPTION == MIPS_EXCEPTION
+                               && (int)MIPSIM_STOP_ERROR == MIPS_ERROR
+                               && (int)MIPSIM_STOP_UNPREDICTABLE == MIPS_UNPREDICTABLE
+                               && (int)MIPSIM_STOP_BREAKPOINT == MIPS_BKPT
+                               && (int)MIPSIM_STOP_LIMIT == MIPS_LIMIT ? 1 : -1];
+
+typedef char mipsim_check_bkpt[(int)MIPSIM_BKPT_EXEC == BKPT_MEM_X
+                               && (int)MIPSIM_BKPT_READ == BKPT_MEM_R
+                               && (int)MIPSIM_BKPT_WRITE == BKPT_MEM_W
+                               && (int)MIPSIM_BKPT_OPCODE == BKPT_OPCODE
+                               && !((MIPSIM_BKPT_EXEC | MIPSIM_BKPT_READ | MIPSIM_BKPT_WRITE
+                                     | MIPSIM_BKPT_OPCODE) & ~BKPT_TYPE_MASK) ? 1 : -1];
+
+struct _MIPSIM_Machine {
+    MIPS *m;
+    ELF_File *elf;
+    MIPSIM_Config *cfg;
+};
+
+/*!
+    \brief Version of the API implemented by the library
+    \see MIPSIM_API_VERSION
+*/
+int mipsim_api_version()
+{
+    return MIPSIM_API_VERSION;
+}
+
+/*!
+    \brief Create a machine
+    \param arch architecture name (e.g "mips1" or "32"), NULL for MIPS I
+    \return machine, NULL on failure
+    
+    The machine uses the universal engine and the standard streams for its
+    console until told otherwise.
+*/
+MIPSIM_Machine* mipsim_machine_create(const char *arch)
+{
+    int isa = arch != NULL ? mips_isa_id(arch) : MIPS_I;
+    
+    if ( isa == MIPS_ARCH_NONE )
+        return NULL;
+    
+    MIPSIM_Machine *mm = (MIPSIM_Machine*)malloc(sizeof(MIPSIM_Machine));
+    
+    if ( mm == NULL )
+        return NULL;
+    
+    mm->elf = NULL;
+    mm->cfg = mipsim_config_create(NULL);
+    mm->m = mm->cfg != NULL ? mips_create(isa, mm->cfg) : NULL;
+    
+    if ( mm->m == NULL )
+    {
+        mipsim_config_destroy(mm->cfg);
+        free(mm);
+        return NULL;
+    }
+    
+    mm->cfg->arch = isa;
+    
+    return mm;
+}
+
+/*!
+    \internal
+    \brief Write out buffered console output and give up console streams
+    
+    Streams given by the embedder are not owned by the machine config.
+*/
+static void mipsim_machine_release_console(MIPSIM_Machine *mm)
+{
+    MIPSIM_Config *prev = mipsim_config_bind(mm->cfg);
+    mipsim_flush(IO_MONITOR, 0);
+    mipsim_config_bind(prev);
+    
+    mm->cfg->mon_in = stdin;
+    mm->cfg->mon_out = stdout;
+}
+
+/*!
+    \brief Destroy a machine
+*/
+void mipsim_machine_destroy(MIPSIM_Machine *mm)
+{
+    if ( mm == NULL )
+        return;
+    
+    mips_destroy(mm->m);
+    elf_file_destroy(mm->elf);
+    
+    mipsim_machine_release_console(mm);
+    mipsim_config_destroy(mm->cfg);
+    
+    free(mm);
+}
+
+/*!
+    \brief Select the execution engine of a machine
+    \param engine engine name : "universal", "threaded" or "jit"
+*/
+int mipsim_machine_set_engine(MIPSIM_Machine *mm, const char *engine)
+{
+    MIPSIM_Config *prev = mipsim_config_bind(mm->cfg);
+    
+    int id = mips_engine_id(engine);
+    int ret = id < 0 || mips_set_engine(mm->m, id);
+    
+    if ( !ret )
+        mm->cfg->engine = id;
+    
+    mipsim_config_bind(prev);
+    
+    return ret;
+}
+
+/*!
+    \brief Set the console streams of a machine
+    \param in guest console input, NULL for stdin
+    \param out guest console output, NULL for stdout
+    
+    Streams remain owned by the caller and must stay open until they are
+    replaced or the machine is destroyed.
+*/
+void mipsim_machine_set_console(MIPSIM_Machine *mm, FILE *in, FILE *out)
+{
+    mipsim_machine_release_console(mm);
+    
+    if ( in != NULL )
+        mm->cfg->mon_in = in;
+    
+    if ( out != NULL )
+        mm->cfg->mon_out = out;
+}
+
+/*!
+    \brief Let the guest open host files below a directory
+    \param dir sandbox directory, NULL to forbid guest files
+    \return 0 on success, 1 if dir cannot be used as a sandbox
+    
+    Files opened by the guest are closed, unless dir cannot be used in which
+    case the previous sandbox is kept.
+*/
+int mipsim_machine_set_sandbox(MIPSIM_Machine *mm, const char *dir)
+{
+    MIPSIM_Config *prev = mipsim_config_bind(mm->cfg);
+    
+    char *root = dir != NULL ? strdup(dir) : NULL;
+    MIPS_Files *files = dir == NULL || root != NULL ? mips_files_create(root) : NULL;
+    
+    int ret = files == NULL || (dir != NULL && !mips_files_sandboxed(files));
+    
+    if ( ret )
+    {
+        mips_files_destroy(files);
+        free(root);
+    } else {
+        free(mm->cfg->sandbox_root);
+        mm->cfg->sandbox_root = root;
+        
+        mips_files_destroy(mm->m->files);
+        mm->m->files = files;
+    }
+    
+    mipsim_config_bind(prev);
+    
+    return ret;
+}
+
+/*!
+    \brief Load an ELF file into a machine
+    \param path executable or relocatable ELF file
+    
+    Any previously loaded program is discarded and the machine is reset.
+*/
+int mipsim_machine_load(MIPSIM_Machine *mm, const char *path)
+{
+    MIPSIM_Config *prev = mipsim_config_bind(mm->cfg);
+    
+    if ( mm->elf != NULL )
+    {
+        mips_reset(mm->m);
+        elf_file_destroy(mm->elf);
+    }
+    
+    mm->elf = elf_file_create();
+    
+    int ret = mm->elf == NULL || elf_file_load(mm->elf, path) || mips_load_elf(mm->m, mm->elf);
+    
+    mipsim_config_bind(prev);
+    
+    return ret;
+}
+
+/*!
+    \brief Run a machine until it stops
+    \param limit maximum number of instructions to execute, 0 for no limit
+    \param count if not NULL, receives the number of instructions executed
+    \return stop reason
+*/
+int mipsim_machine_run(MIPSIM_Machine *mm, uint64_t limit, uint64_t *count)
+{
+    return mips_run(mm->m, limit, count);
+}
+
+/*!
+    \brief Execute a given number of instructions
+    \return stop reason, MIPSIM_STOP_NONE if the machine did not stop
+*/
+int mipsim_machine_step(MIPSIM_Machine *mm, uint32_t n)
+{
+    return mips_exec(mm->m, n, 0);
+}
+
+/*!
+    \brief Status given to _exit by the guest
+*/
+int mipsim_machine_exit_code(MIPSIM_Machine *mm)
+{
+    return mm->m->exit_code;
+}
+
+/*!
+    \brief Give a human-readable description of a stop reason
+*/
+const char* mipsim_stop_reason_name(int reason)
+{
+    return mips_stop_reason_name(reason);
+}
+
+/*!
+    \brief Convert a register name into a register id
+    \param name register name (e.g "sp", "$29", "pc", "hi")
+    \return register id, -1 for invalid names
+    
+    General purpose registers have ids 0 to 31.
+*/
+int mipsim_reg_id(const char *name)
+{
+    return mips_reg_id(name);
+}
+
+/*!
+    \brief Read a register
+    \param reg register id
+*/
+uint32_t mipsim_machine_get_reg(MIPSIM_Machine *mm, int reg)
+{
+    MIPSIM_Config *prev = mipsim_config_bind(mm->cfg);
+    uint32_t value = mips_get_reg(mm->m, reg);
+    mipsim_config_bind(prev);
+    
+    return value;
+}
+
+/*!
+    \brief Write a register
+    \param reg register id
+*/
+void mipsim_machine_set_reg(MIPSIM_Machine *mm, int reg, uint32_t value)
+{
+    MIPSIM_Config *prev = mipsim_config_bind(mm->cfg);
+    mips_set_reg(mm->m, reg, value);
+    mipsim_config_bind(prev);
+}
+
+/*!
+    \brief Copy guest memory to a host buffer
+    \param fault if not NULL, receives the address of the first unmapped byte, if any
+*/
+int mipsim_machine_read(MIPSIM_Machine *mm, uint32_t addr, void *d, uint32_t n, uint32_t *fault)
+{
+    return mips_read_block(mm->m, addr, d, n, fault);
+}
+
+/*!
+    \brief Copy a host buffer to guest memory
+    \param fault if not NULL, receives the address of the first unmapped or read-only byte, if any
+*/
+int mipsim_machine_write(MIPSIM_Machine *mm, uint32_t addr, const void *d, uint32_t n, uint32_t *fault)
+{
+    return mips_write_block(mm->m, addr, d, n, fault);
+}
+
+/*!
+    \brief Add a breakpoint
+    \param type combination of MIPSIM_Breakpoint_Type values
+    \param start start of break range
+    \param end end of break range
+    \param mask break range mask
+    \return breakpoint id
+*/
+int mipsim_machine_breakpoint_add(MIPSIM_Machine *mm, int type, uint32_t start, uint32_t end, uint32_t mask)
+{
+    return mips_breakpoint_add(mm->m, type, start, end, mask);
+}
+
+/*!
+    \brief Remove a breakpoint
+    \param id breakpoint id, as returned by mipsim_machine_breakpoint_add
+*/
+void mipsim_machine_breakpoint_remove(MIPSIM_Machine *mm, int id)
+{
+    mips_breakpoint_remove(mm->m, id);
+}
+
+/*!
+    \brief Remove all breakpoints
+*/
+void mipsim_machine_breakpoint_clear(MIPSIM_Machine *mm)
+{
+    mips_breakpoint_clear(mm->m);
+}
+
+/*!
+    \brief Id of the breakpoint that stopped the machine
+    \return breakpoint id, meaningful only after a MIPSIM_STOP_BREAKPOINT stop
+*/
+int mipsim_machine_breakpoint_hit(MIPSIM_Machine *mm)
+{
+    return mm->m->breakpoint_hit;
+}
@@ -0,0 +1,106 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+#ifndef _MIPSIM_H_
+#define _MIPSIM_H_
+
+/*!
+    \file mipsim.h
+    \brief Embedding API of libmipsim
+    \author Hugues Bruant
+    
+    This is the only header needed to use libmipsim. Machines are opaque
+    handles, each one with its own configuration, console streams and guest
+    files, so that independent machines can run concurrently on different
+    threads. A given machine must not be used by two threads at once.
+    
+    Functions returning int return 0 on success unless stated otherwise.
+*/
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#if defined(__GNUC__) && defined(MIPSIM_SHARED)
+#define MIPSIM_API __attribute__((visibility("default")))
+#else
+#define MIPSIM_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+    \brief Version of this API, bumped on incompatible changes
+*/
+#define MIPSIM_API_VERSION 1
+
+typedef struct _MIPSIM_Machine MIPSIM_Machine;
+
+/*!
+    \brief Reasons for a machine to stop
+*/
+enum MIPSIM_Stop_Reason {
+    MIPSIM_STOP_NONE,
+    MIPSIM_STOP_QUIT,
+    MIPSIM_STOP_INVALID,
+    MIPSIM_STOP_UNSUPPORTED,
+    MIPSIM_STOP_TRAP,
+    MIPSIM_STOP_BREAK,
+    MIPSIM_STOP_EXCEPTION,
+    MIPSIM_STOP_ERROR,
+    MIPSIM_STOP_UNPREDICTABLE,
+    MIPSIM_STOP_BREAKPOINT,
+    MIPSIM_STOP_LIMIT
+};
+
+/*!
+    \brief Breakpoint types, may be combined
+*/
+enum MIPSIM_Breakpoint_Type {
+    MIPSIM_BKPT_EXEC    = 1,
+    MIPSIM_BKPT_READ    = 2,
+    MIPSIM_BKPT_WRITE   = 4,
+    MIPSIM_BKPT_OPCODE  = 8
+};
+
+MIPSIM_API int mipsim_api_version();
+
+MIPSIM_API MIPSIM_Machine* mipsim_machine_create(const char *arch);
+MIPSIM_API void mipsim_machine_destroy(MIPSIM_Machine *m);
+
+MIPSIM_API int mipsim_machine_set_engine(MIPSIM_Machine *m, const char *engine);
+MIPSIM_API void mipsim_machine_set_console(MIPSIM_Machine *m, FILE *in, FILE *out);
+MIPSIM_API int mipsim_machine_set_sandbox(MIPSIM_Machine *m, const char *dir);
+
+MIPSIM_API int mipsim_machine_load(MIPSIM_Machine *m, const char *path);
+
+MIPSIM_API int mipsim_machine_run(MIPSIM_Machine *m, uint64_t limit, uint64_t *count);
+MIPSIM_API int mipsim_machine_step(MIPSIM_Machine *m, uint32_t n);
+MIPSIM_API int mipsim_machine_exit_code(MIPSIM_Machine *m);
+MIPSIM_API const char* mipsim_stop_reason_name(int reason);
+
+MIPSIM_API int mipsim_reg_id(const char *name);
+MIPSIM_API uint32_t mipsim_machine_get_reg(MIPSIM_Machine *m, int reg);
+MIPSIM_API void mipsim_machine_set_reg(MIPSIM_Machine *m, int reg, uint32_t value);
+
+MIPSIM_API int mipsim_machine_read(MIPSIM_Machine *m, uint32_t addr, void *d, uint32_t n, uint32_t *fault);
+MIPSIM_API int mipsim_machine_write(MIPSIM_Machine *m, uint32_t addr, const void *d, uint32_t n, uint32_t *fault);
+
+MIPSIM_API int mipsim_machine_breakpoint_add(MIPSIM_Machine *m, int type, uint32_t start, uint32_t end, uint32_t mask);
+MIPSIM_API void mipsim_machine_breakpoint_remove(MIPSIM_Machine *m, int id);
+MIPSIM_API void mipsim_machine_breakpoint_clear(MIPSIM_Machine *m);
+MIPSIM_API int mipsim_machine_breakpoint_hit(MIPSIM_Machine *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
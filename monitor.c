@@ -19,29 +19,247 @@
 #include "io.h"
 #include "util.h"
 #include "config.h"
+#include "files.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    SYSCALL_BUF_SZ = 128,
+    MONITOR_BUF_SZ = 4096
+};
 
 /*!
     \internal
-    \brief Fetch a NULL-terminated string from the memory of a simulated machine
+    \brief Fetch a NUL-terminated string from the memory of a simulated machine
+    \return string (to be free'd by caller), NULL if it runs into unmapped memory
 */
-char* fetch_str(MIPS *m, MIPS_Addr a)
+static char* monitor_str(MIPS *m, MIPS_Addr a)
 {
-    MIPS_Native len = 0;
+    MIPS_Addr fault;
+    char *s = mips_read_str(m, a, &fault);
     
-    while ( mips_read_b(m, a + len, NULL) )
-        ++len;
+    if ( s == NULL )
+        mipsim_printf(IO_WARNING, "No memory mapped @ %08x\n", fault);
     
-    char *s = (char*)malloc(len * sizeof(char));
+    return s;
+}
+
+/*!
+    \internal
+    \brief Read a line from the console into simulated memory (fgets semantics)
+    
+    The console is read straight into guest memory when the buffer is
+    backed by contiguous host memory. Other buffers go through a bounce
+    buffer, only allocated when they are too large for the stack.
+*/
+static int monitor_gets(MIPS *m, MIPS_Addr a, uint32_t len)
+{
+    if ( !len )
+        return 0;
     
-    for ( MIPS_Native i = 0; i <= len; ++i )
-        s[i] = mips_read_b(m, a + i, NULL);
+    uint32_t run = len;
+    char *h = (char*)mips_host_span(m, a, &run, 1);
     
-    return s;
+    if ( h != NULL && run == len )
+        return mipsim_gets(IO_MONITOR, h, len);
+    
+    char stack[MONITOR_BUF_SZ];
+    char *buffer = len <= MONITOR_BUF_SZ ? stack : (char*)malloc(len);
+    
+    if ( buffer == NULL )
+        return 0;
+    
+    int ret = mipsim_gets(IO_MONITOR, buffer, len);
+    
+    if ( ret > 0 )
+    {
+        // only copy back what the read produced, including the terminator
+        char *z = (char*)memchr(buffer, 0, len);
+        uint32_t n = z != NULL ? (uint32_t)(z - buffer) + 1 : len;
+        MIPS_Addr fault;
+        
+        if ( mips_write_block(m, a, buffer, n, &fault) )
+            mipsim_printf(IO_WARNING, "No memory mapped @ %08x\n", fault);
+    }
+    
+    if ( buffer != stack )
+        free(buffer);
+    
+    return ret;
 }
 
-enum {
-    SYSCALL_BUF_SZ = 128
-};
+/*!
+    \internal
+    \brief Read from a guest file descriptor into host memory
+*/
+static int monitor_in(MIPS *m, int file, char *d, uint32_t n, int *err)
+{
+    if ( file >= MIPS_FILES_CONSOLE )
+        return mips_files_read(m->files, file, d, n, err);
+    
+    if ( file )
+    {
+        *err = MIPS_EBADF;
+        return -1;
+    }
+    
+    return mipsim_read(IO_MONITOR, file, d, n > 0x7FFFFFFF ? 0x7FFFFFFF : n);
+}
+
+/*!
+    \internal
+    \brief Write host memory to a guest file descriptor
+*/
+static int monitor_out(MIPS *m, int file, char *d, uint32_t n, int *err)
+{
+    if ( file >= MIPS_FILES_CONSOLE )
+        return mips_files_write(m->files, file, d, n, err);
+    
+    return mipsim_write(IO_MONITOR, file, d, n > 0x7FFFFFFF ? 0x7FFFFFFF : n);
+}
+
+/*!
+    \internal
+    \brief Read from a guest file descriptor into simulated memory
+    \return number of bytes read, -1 on failure
+    
+    Runs of contiguous host memory are handed to the host I/O layer as is,
+    the rest goes through a bounce buffer. Reading stops at the first short
+    read so that consoles and pipes do not block once data was received.
+*/
+static int monitor_read(MIPS *m, int file, MIPS_Addr a, uint32_t len, int *err)
+{
+    if ( !mips_files_valid(m->files, file) )
+    {
+        *err = MIPS_EBADF;
+        return -1;
+    }
+    
+    int ret = 0;
+    
+    while ( len )
+    {
+        char buffer[MONITOR_BUF_SZ];
+        uint32_t run = len;
+        char *h = (char*)mips_host_span(m, a, &run, 1);
+        
+        if ( h == NULL )
+        {
+            h = buffer;
+            run = len < MONITOR_BUF_SZ ? len : MONITOR_BUF_SZ;
+        }
+        
+        int r = monitor_in(m, file, h, run, err);
+        
+        if ( r < 0 )
+            return ret ? ret : -1;
+        
+        if ( h == buffer && r > 0 )
+        {
+            MIPS_Addr fault;
+            
+            if ( mips_write_block(m, a, buffer, r, &fault) )
+            {
+                mipsim_printf(IO_WARNING, "No memory mapped @ %08x\n", fault);
+                
+                *err = MIPS_EFAULT;
+                return ret ? ret : -1;
+            }
+        }
+        
+        ret += r;
+        
+        if ( (uint32_t)r < run )
+            break;
+        
+        a += run;
+        len -= run;
+    }
+    
+    return ret;
+}
+
+/*!
+    \internal
+    \brief Write simulated memory to a guest file descriptor
+    \return number of bytes written, -1 on failure
+    
+    Runs of contiguous host memory are handed to the host I/O layer as is,
+    the rest goes through a small bounce buffer.
+*/
+static int monitor_write(MIPS *m, int file, MIPS_Addr a, uint32_t len, int *err)
+{
+    if ( !mips_files_valid(m->files, file) )
+    {
+        *err = MIPS_EBADF;
+        return -1;
+    }
+    
+    int ret = 0;
+    
+    while ( len )
+    {
+        char buffer[SYSCALL_BUF_SZ];
+        uint32_t run = len;
+        char *h = (char*)mips_host_span(m, a, &run, 0);
+        
+        if ( h == NULL )
+        {
+            MIPS_Addr fault;
+            
+            run = len < SYSCALL_BUF_SZ ? len : SYSCALL_BUF_SZ;
+            
+            if ( mips_read_block(m, a, buffer, run, &fault) )
+            {
+                mipsim_printf(IO_WARNING, "No memory mapped @ %08x\n", fault);
+                
+                // write the readable prefix
+                run = fault - a;
+                
+                int w = run ? monitor_out(m, file, buffer, run, err) : 0;
+                
+                if ( w > 0 )
+                    ret += w;
+                
+                *err = MIPS_EFAULT;
+                return ret ? ret : -1;
+            }
+            
+            h = buffer;
+        }
+        
+        int w = monitor_out(m, file, h, run, err);
+        
+        if ( w < 0 )
+            return ret ? ret : -1;
+        
+        ret += w;
+        
+        if ( (uint32_t)w < run )
+            break;
+        
+        a += run;
+        len -= run;
+    }
+    
+    return ret;
+}
+
+/*!
+    \internal
+    \brief Set the result of a monitor call
+    
+    Failed calls return -1 in v0 and the newlib errno value in v1.
+*/
+static void monitor_return(MIPS *m, int ret, const int *err)
+{
+    mips_set_reg(m, V0, ret);
+    
+    if ( ret == -1 )
+        mips_set_reg(m, V1, *err);
+}
 
 /*!
     \brief Syscall handler
@@ -62,8 +280,11 @@ int mips_syscall(MIPS *m, int code)
         case 4 :
         {
             MIPS_Native a0 = mips_get_reg(m, A0);
-            char *s = fetch_str(m, a0);
-            mipsim_printf(IO_MONITOR, "%s", s);
+            char *s = monitor_str(m, a0);
+            
+            if ( s != NULL )
+                mipsim_printf(IO_MONITOR, "%s", s);
+            
             free(s);
             break;
         }
@@ -71,7 +292,9 @@ int mips_syscall(MIPS *m, int code)
         case 5 :
         {
             char buf[SYSCALL_BUF_SZ];
-            mipsim_read(IO_MONITOR, 0, buf, SYSCALL_BUF_SZ);
+            
+            if ( !mipsim_gets(IO_MONITOR, buf, SYSCALL_BUF_SZ) )
+                buf[0] = 0;
             
             mips_set_reg(m, V0, str_to_num(buf, NULL, NULL));
             break;
@@ -82,12 +305,7 @@ int mips_syscall(MIPS *m, int code)
             MIPS_Native a0 = mips_get_reg(m, A0);
             MIPS_Native a1 = mips_get_reg(m, A1);
             
-            char *buffer = (char*)malloc(a1);
-            mipsim_read(IO_MONITOR, 0, buffer, a1);
-            for ( MIPS_Native i = 0; i < a1; ++i )
-                mips_write_b(m, a0 + i, buffer[i], NULL);
-            free(buffer);
-            
+            monitor_gets(m, a0, a1);
             break;
         }
             
@@ -111,7 +329,7 @@ int mips_syscall(MIPS *m, int code)
 */
 int mips_monitor(MIPS *m, int entry)
 {
-    MIPSIM_Config *cfg = mipsim_config();
+    MIPSIM_Config *cfg = m->config;
     
     switch ( entry )
     {
@@ -121,10 +339,11 @@ int mips_monitor(MIPS *m, int entry)
             MIPS_Native a0 = mips_get_reg(m, A0);
             MIPS_Native a1 = mips_get_reg(m, A1);
             
-            mipsim_printf(IO_TRACE, "open : %08x, %08x\n", a0, a1);
+            mips_trace_note("open : %08x, %08x\n", a0, a1);
             
-            char *s = fetch_str(m, a0);
-            mips_set_reg(m, V0, mipsim_open(IO_MONITOR, s, a1));
+            int err = MIPS_EFAULT;
+            char *s = monitor_str(m, a0);
+            monitor_return(m, s != NULL ? mips_files_open(m->files, s, a1, &err) : -1, &err);
             free(s);
             
             break;
@@ -137,14 +356,10 @@ int mips_monitor(MIPS *m, int entry)
             MIPS_Native a1 = mips_get_reg(m, A1);
             MIPS_Native a2 = mips_get_reg(m, A2);
             
-            mipsim_printf(IO_TRACE, "read : %08x, %08x, %08x\n", a0, a1, a2);
-            
-            char *buffer = (char*)malloc(a2);
-            mips_set_reg(m, V0, mipsim_read(IO_MONITOR, a0, buffer, a2));
-            for ( MIPS_Native i = 0; i < a2; ++i )
-                mips_write_b(m, a1 + i, buffer[i], NULL);
-            free(buffer);
+            mips_trace_note("read : %08x, %08x, %08x\n", a0, a1, a2);
             
+            int err = 0;
+            monitor_return(m, monitor_read(m, a0, a1, a2, &err), &err);
             break;
         }
             
@@ -155,14 +370,24 @@ int mips_monitor(MIPS *m, int entry)
             MIPS_Native a1 = mips_get_reg(m, A1);
             MIPS_Native a2 = mips_get_reg(m, A2);
             
-            mipsim_printf(IO_TRACE, "write : %08x, %08x, %08x\n", a0, a1, a2);
+            mips_trace_note("write : %08x, %08x, %08x\n", a0, a1, a2);
+            
+            int err = 0;
+            monitor_return(m, monitor_write(m, a0, a1, a2, &err), &err);
+            break;
+        }
+            
+        case 18 :
+        {
+            /* int lseek(int file,int offset,int whence) */
+            MIPS_Native a0 = mips_get_reg(m, A0);
+            MIPS_Native a1 = mips_get_reg(m, A1);
+            MIPS_Native a2 = mips_get_reg(m, A2);
             
-            char *buffer = (char*)malloc(a2);
-            for ( MIPS_Native i = 0; i < a2; ++i )
-                buffer[i] = mips_read_b(m, a1 + i, NULL);
-            mips_set_reg(m, V0, mipsim_write(IO_MONITOR, a0, buffer, a2));
-            free(buffer);
+            mips_trace_note("lseek : %08x, %08x, %08x\n", a0, a1, a2);
             
+            int err = 0;
+            monitor_return(m, mips_files_lseek(m->files, a0, a1, a2, &err), &err);
             break;
         }
             
@@ -171,16 +396,23 @@ int mips_monitor(MIPS *m, int entry)
             /* int close(int file) */
             MIPS_Native a0 = mips_get_reg(m, A0);
             
-            mipsim_printf(IO_TRACE, "close : %08x\n", a0);
+            mips_trace_note("close : %08x\n", a0);
+            
+            int err = 0;
+            
+            // console descriptors stay open
+            if ( a0 >= 0 && a0 < MIPS_FILES_CONSOLE )
+                mips_set_reg(m, V0, 0);
+            else
+                monitor_return(m, mips_files_close(m->files, a0, &err), &err);
             
-            mips_set_reg(m, V0, mipsim_close(IO_MONITOR, a0));
             break;
         }
             
         case 22 :
             /* char inbyte(void) */
             
-            mipsim_printf(IO_TRACE, "inbyte\n");
+            mips_trace_note("inbyte\n");
             
             mips_set_reg(m, V0, mipsim_inbyte(IO_MONITOR));
             break;
@@ -190,16 +422,18 @@ int mips_monitor(MIPS *m, int entry)
             /* void outbyte(char chr) : write a byte to "stdout" */
             MIPS_Native a0 = mips_get_reg(m, A0);
             
-            mipsim_printf(IO_TRACE, "outbyte : %08x\n", a0);
+            mips_trace_note("outbyte : %08x\n", a0);
             
             mipsim_outbyte(IO_MONITOR, a0);
             break;
         }
             
         case 34 :
-            /* void _exit() */
+            /* void _exit(int status) */
+            
+            m->exit_code = mips_get_reg(m, A0);
             
-            mipsim_printf(IO_TRACE, "_exit");
+            mips_trace_note("_exit");
             mips_stop(m, MIPS_QUIT);
             return MIPS_QUIT;
             
@@ -213,7 +447,7 @@ int mips_monitor(MIPS *m, int entry)
             
             MIPS_Native a = mips_get_reg(m, A0);
             
-            mipsim_printf(IO_TRACE, "get_mem_info : 0x%08x", a);
+            mips_trace_note("get_mem_info : 0x%08x", a);
             
             mips_write_w(m, a + 0, cfg->newlib_stack_size, NULL);
             mips_write_w(m, a + 4, 0, NULL);
@@ -232,7 +466,7 @@ int mips_monitor(MIPS *m, int entry)
             /* out: void */
             MIPS_Addr a0 = mips_get_reg(m, A0);
             
-            mipsim_printf(IO_TRACE, "printf : %08x\n", a0);
+            mips_trace_note("printf : %08x\n", a0);
             break;
         }
             
@@ -186,7 +186,7 @@ int shell_load(int argc, char **argv, Shell_Env *e)
         /*
             Create simulator structures
         */
-        e->m = mips_create(arch);
+        e->m = mips_create(arch, mipsim_config());
         
         if ( e->m == NULL )
         {
@@ -195,6 +195,8 @@ int shell_load(int argc, char **argv, Shell_Env *e)
         }
     }
     
+    mips_set_engine(e->m, mipsim_config()->engine);
+    
     /*
         discard any previously loaded program
     */
@@ -278,44 +280,12 @@ void print_status(MIPS *m)
         case MIPS_OK :
             break;
             
-        case MIPS_INVALID :
-            printf("Invalid instruction\n");
-            break;
-            
-        case MIPS_UNSUPPORTED :
-            printf("Unsupported instruction\n");
-            break;
-            
-        case MIPS_TRAP :
-            printf("Trap\n");
-            break;
-            
-        case MIPS_BREAK :
-            printf("Break\n");
-            break;
-            
-        case MIPS_QUIT :
-            printf("Quit\n");
-            break;
-            
         case MIPS_BKPT :
             printf("Hit breakpoint %d\n", m->breakpoint_hit);
             break;
             
-        case MIPS_EXCEPTION :
-            printf("Exception\n");
-            break;
-            
-        case MIPS_ERROR :
-            printf("Internal error\n");
-            break;
-            
-        case MIPS_UNPREDICTABLE :
-            printf("Unpredictable behavior\n");
-            break;
-            
         default:
-            printf("Unknown status\n");
+            printf("%s\n", mips_stop_reason_name(m->stop_reason));
             break;
     }
 }
@@ -343,11 +313,7 @@ int shell_run(int argc, char **argv, Shell_Env *e)
         return COMMAND_PARAM_COUNT;
     }
     
-    int ret;
-    
-    do {
-        ret = mips_exec(m, 1, 0);
-    } while ( ret == MIPS_OK );
+    int ret = mips_run(m, 0, NULL);
     
     print_status(m);
     
@@ -424,6 +390,14 @@ int shell_trace(int argc, char **argv, Shell_Env *e)
         return COMMAND_PARAM_COUNT;
     }
     
+#ifdef MIPSIM_NO_TRACE
+    if ( n )
+    {
+        printf("Tracing was compiled out\n");
+        return COMMAND_FAIL;
+    }
+#endif
+    
     if ( n )
         mipsim_config()->io_mask |= IO_TRACE;
     else
@@ -610,6 +584,19 @@ int shell_sreg(int argc, char **argv, Shell_Env *e)
     return COMMAND_OK;
 }
 
+/*!
+    \internal
+    \brief Read a row of memory for display, unmapped bytes reading as zero
+*/
+static void shell_read_row(MIPS *m, MIPS_Addr a, uint8_t *d, uint32_t n)
+{
+    if ( mips_read_block(m, a, d, n, NULL) )
+    {
+        for ( uint32_t i = 0; i < n; ++i )
+            d[i] = mips_read_b(m, a + i, NULL);
+    }
+}
+
 int shell_dmem(int argc, char **argv, Shell_Env *e)
 {
     MIPS *m = e->m;
@@ -638,21 +625,24 @@ int shell_dmem(int argc, char **argv, Shell_Env *e)
             return COMMAND_PARAM_TYPE;
         }
         
-        int stat;
+        uint8_t row[17];
         MIPS_Addr a = start;
-        for ( MIPS_Addr i = 0; i < ((end - start) >> 4); ++i )
+        for ( MIPS_Addr i = 0; i < ((end - start) >> 4); ++i, a += 16 )
         {
             printf("%08x : ", a);
+            shell_read_row(m, a, row, 16);
             for ( int j = 0; j < 16; ++j )
-                printf(" %02x", mips_read_b(m, a++, &stat));
+                printf(" %02x", row[j]);
             printf("\n");
         }
         
         if ( ((end - start) & 15) || !((end - start) & ~15) )
         {
+            uint32_t n = ((end - start) & 15) + 1;
             printf("%08x : ", a);
-            for ( MIPS_Addr i = 0; i <= ((end - start) & 15); ++i )
-                printf(" %02x", mips_read_b(m, a++, &stat));
+            shell_read_row(m, a, row, n);
+            for ( MIPS_Addr i = 0; i < n; ++i )
+                printf(" %02x", row[i]);
             printf("\n");
         }
     } else {
@@ -0,0 +1,169 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**   
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+#include "check.h"
+
+/*!
+    \file api.c
+    \brief Embedding API, through libmipsim only
+    \author Hugues Bruant
+*/
+
+#include "mipsim.h"
+
+#include <string.h>
+
+#define HELLO_ENTRY     0x00400174
+#define HELLO_STR       0x00401220
+
+static void check_run(MIPSIM_Machine *mm, FILE *out)
+{
+    uint64_t count = 0;
+    char buf[64];
+    
+    CHECK_EQ(mipsim_machine_load(mm, "demos/hellos"), 0);
+    CHECK_EQ(mipsim_machine_get_reg(mm, mipsim_reg_id("pc")), HELLO_ENTRY);
+    
+    CHECK_EQ(mipsim_machine_run(mm, 0, &count), MIPSIM_STOP_BREAK);
+    CHECK_EQ(count, 5);
+    CHECK_EQ(mipsim_machine_get_reg(mm, mipsim_reg_id("v0")), 4);
+    CHECK_EQ(mipsim_machine_get_reg(mm, mipsim_reg_id("a0")), HELLO_STR);
+    
+    fflush(out);
+    rewind(out);
+    
+    CHECK(fgets(buf, sizeof(buf), out) != NULL && !strcmp(buf, "Hello world!\n"));
+    
+    CHECK_EQ(mipsim_machine_load(mm, "demos/missing"), 1);
+}
+
+static void check_registers(MIPSIM_Machine *mm)
+{
+    CHECK_EQ(mipsim_reg_id("zero"), 0);
+    CHECK_EQ(mipsim_reg_id("$29"), 29);
+    CHECK_EQ(mipsim_reg_id("sp"), 29);
+    CHECK_EQ(mipsim_reg_id("bogus"), -1);
+    
+    mipsim_machine_set_reg(mm, mipsim_reg_id("t0"), 0xdeadbeef);
+    CHECK_EQ(mipsim_machine_get_reg(mm, mipsim_reg_id("t0")), 0xdeadbeef);
+    
+    // writes to $zero are ignored
+    mipsim_machine_set_reg(mm, 0, 1);
+    CHECK_EQ(mipsim_machine_get_reg(mm, 0), 0);
+    
+    mipsim_machine_set_reg(mm, mipsim_reg_id("hi"), 0x12345678);
+    CHECK_EQ(mipsim_machine_get_reg(mm, mipsim_reg_id("hi")), 0x12345678);
+}
+
+static void check_memory(MIPSIM_Machine *mm)
+{
+    char buf[16];
+    uint32_t fault = 0;
+    
+    CHECK_EQ(mipsim_machine_load(mm, "demos/hellos"), 0);
+    
+    CHECK_EQ(mipsim_machine_read(mm, HELLO_STR, buf, 13, &fault), 0);
+    CHECK(!memcmp(buf, "Hello world!\n", 13));
+    
+    CHECK_EQ(mipsim_machine_write(mm, HELLO_STR, "Howdy", 5, &fault), 0);
+    CHECK_EQ(mipsim_machine_read(mm, HELLO_STR, buf, 13, NULL), 0);
+    CHECK(!memcmp(buf, "Howdy world!\n", 13));
+    
+    // nothing is mapped at the bottom of the address space
+    CHECK(mipsim_machine_read(mm, 0x100, buf, 4, &fault) != 0);
+    CHECK_EQ(fault, 0x100);
+    CHECK(mipsim_machine_write(mm, 0x100, buf, 4, &fault) != 0);
+    CHECK_EQ(fault, 0x100);
+}
+
+static void check_exit(MIPSIM_Machine *mm)
+{
+    // call the _exit monitor entry with status 42
+    static const unsigned char code[] = {
+        0x3c, 0x08, 0xbf, 0xc0,     // lui   t0, 0xbfc0
+        0x35, 0x08, 0x00, 0x88,     // ori   t0, t0, 0x88
+        0x01, 0x00, 0x00, 0x08,     // jr    t0
+        0x24, 0x04, 0x00, 0x2a      // addiu a0, zero, 42
+    };
+    
+    CHECK_EQ(mipsim_machine_load(mm, "demos/hellos"), 0);
+    CHECK_EQ(mipsim_machine_write(mm, HELLO_ENTRY, code, sizeof(code), NULL), 0);
+    
+    CHECK_EQ(mipsim_machine_step(mm, 1), MIPSIM_STOP_NONE);
+    CHECK_EQ(mipsim_machine_get_reg(mm, mipsim_reg_id("t0")), 0xbfc00000);
+    
+    CHECK_EQ(mipsim_machine_run(mm, 0, NULL), MIPSIM_STOP_QUIT);
+    CHECK_EQ(mipsim_machine_exit_code(mm), 42);
+    CHECK(!strcmp(mipsim_stop_reason_name(MIPSIM_STOP_QUIT), "Quit"));
+}
+
+static void check_breakpoints(MIPSIM_Machine *mm)
+{
+    uint64_t count = 0;
+    
+    CHECK_EQ(mipsim_machine_load(mm, "demos/hellos"), 0);
+    
+    int x = mipsim_machine_breakpoint_add(mm, MIPSIM_BKPT_EXEC, HELLO_ENTRY + 8, HELLO_ENTRY + 8, 0xffffffff);
+    
+    CHECK_EQ(mipsim_machine_run(mm, 0, &count), MIPSIM_STOP_BREAKPOINT);
+    CHECK_EQ(mipsim_machine_breakpoint_hit(mm), x);
+    CHECK_EQ(mipsim_machine_get_reg(mm, mipsim_reg_id("pc")), HELLO_ENTRY + 8);
+    CHECK_EQ(count, 2);
+    
+    mipsim_machine_breakpoint_remove(mm, x);
+    
+    CHECK_EQ(mipsim_machine_run(mm, 0, NULL), MIPSIM_STOP_BREAK);
+    
+    // instruction limit
+    CHECK_EQ(mipsim_machine_load(mm, "demos/arith"), 0);
+    CHECK_EQ(mipsim_machine_run(mm, 10, &count), MIPSIM_STOP_LIMIT);
+    CHECK_EQ(count, 10);
+    
+    mipsim_machine_breakpoint_clear(mm);
+}
+
+static void check_settings(MIPSIM_Machine *mm)
+{
+    CHECK_EQ(mipsim_machine_set_engine(mm, "threaded"), 0);
+    CHECK_EQ(mipsim_machine_set_engine(mm, "bogus"), 1);
+    
+    CHECK_EQ(mipsim_machine_set_sandbox(mm, "demos"), 0);
+    CHECK_EQ(mipsim_machine_set_sandbox(mm, "demos/missing"), 1);
+    CHECK_EQ(mipsim_machine_set_sandbox(mm, NULL), 0);
+    
+    CHECK(mipsim_machine_create("bogus") == NULL);
+}
+
+int main()
+{
+    CHECK_EQ(mipsim_api_version(), MIPSIM_API_VERSION);
+    
+    FILE *out = tmpfile();
+    MIPSIM_Machine *mm = mipsim_machine_create("mips1");
+    
+    CHECK(out != NULL && mm != NULL);
+    
+    if ( out == NULL || mm == NULL )
+        return check_status();
+    
+    mipsim_machine_set_console(mm, NULL, out);
+    
+    check_run(mm, out);
+    check_registers(mm);
+    check_memory(mm);
+    check_exit(mm);
+    check_breakpoints(mm);
+    check_settings(mm);
+    
+    mipsim_machine_destroy(mm);
+    fclose(out);
+    
+    return check_status();
+}
@@ -0,0 +1,62 @@
+# Batch mode : batch file format, job summary and exit status, as documented
+# in the README
+
+. test/common.sh
+
+# hellos with its code replaced by a call to the _exit monitor entry :
+#   lui t0, 0xbfc0 ; ori t0, t0, 0x88 ; jr t0 ; addiu a0, zero, 42
+cp demos/hellos "$tmp/exit42"
+printf '\074\010\277\300\065\010\000\210\001\000\000\010\044\004\000\052' \
+    | dd of="$tmp/exit42" bs=1 seek=$((0x1174)) conv=notrunc 2> /dev/null
+
+printf '12+3\nq\n' > "$tmp/in"
+
+# "-" defaults, comments and blank lines, more jobs than threads
+cat > "$tmp/jobs" <<JOBS
+# comment
+
+demos/hellos
+demos/arith - - - 10
+demos/calculator mips1 $tmp/in $tmp/calc.out 200000
+$tmp/exit42 - - $tmp/exit.out
+demos/x-integer -
+$tmp/missing
+demos/hellos - - $tmp/hello.out -
+JOBS
+
+./simips --jobs 2 --max-insns 1000000 --batch "$tmp/jobs" > "$tmp/summary" 2> /dev/null
+[ $? -eq 1 ] || fail "batch : a job failing to load must give exit status 1"
+
+# job number, status, exit status and instruction count of each job
+awk '/^ +[0-9]+  / { sub(/  +[0-9]+\.[0-9]+  .*$/, ""); print }' "$tmp/summary" \
+    | sed 's/  */ /g' > "$tmp/columns"
+
+cat > "$tmp/expected" <<SUMMARY
+ 1 Break - 5
+ 2 Instruction limit reached - 10
+ 3 Break - 5588
+ 4 Quit 42 4
+ 5 Exception - 5
+ 6 Failed to run - 0
+ 7 Break - 5
+SUMMARY
+
+cmp -s "$tmp/expected" "$tmp/columns" || fail "batch : unexpected summary $(cat "$tmp/summary")"
+grep -q '^7 jobs, 1 failed to run, 2 threads, ' "$tmp/summary" || fail "batch : unexpected totals"
+
+grep -q '= 15' "$tmp/calc.out" || fail "batch : calculator output not written"
+[ "$(cat "$tmp/hello.out")" = "Hello world!" ] || fail "batch : hellos output not written"
+[ -e "$tmp/exit.out" ] || fail "batch : console output file not created"
+
+# malformed lines abort the batch before any job runs
+for line in "demos/hellos mips9" "demos/hellos - - - 10x" "demos/hellos - - - - extra"
+do
+    echo "$line" > "$tmp/bad"
+    expect 1 "batch : '$line'" ./simips --batch "$tmp/bad"
+    grep -q ' jobs, ' "$tmp/expect.out" && fail "batch : '$line' ran jobs"
+    grep -q ":1: " "$tmp/expect.out" || fail "batch : '$line' not reported"
+done
+
+expect 1 "batch : missing file" ./simips --batch "$tmp/none"
+
+exit $status
@@ -0,0 +1,215 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+#include "check.h"
+
+/*!
+    \file breakpoints.c
+    \brief Breakpoint index and prefilters
+    \author Hugues Bruant
+*/
+
+#include "config.h"
+#include "mips.h"
+#include "mipself.h"
+#include "elffile.h"
+
+int mips_breakpoint_test(MIPS *m, MIPS_Addr val, int type);
+
+static int page_flagged(MIPS *m, MIPS_Addr a)
+{
+    const uint32_t *pages = m->breakpoint_pages;
+    
+    // no prefilter : every page is considered
+    return pages == NULL || ((pages[a >> (BKPT_PAGE_SHIFT + 5)] >> ((a >> BKPT_PAGE_SHIFT) & 31)) & 1);
+}
+
+static void check_ranges(MIPS *m)
+{
+    int outer = mips_breakpoint_add(m, BKPT_MEM_R, 0x1000, 0x1fff, 0xffffffff);
+    int inner = mips_breakpoint_add(m, BKPT_MEM_R, 0x1800, 0x1900, 0xffffffff);
+    int far   = mips_breakpoint_add(m, BKPT_MEM_R, 0x1400, 0x1410, 0xffffffff);
+    
+    CHECK_EQ(mips_breakpoint_find(m, 0x0fff, BKPT_MEM_R), -1);
+    CHECK_EQ(mips_breakpoint_find(m, 0x1000, BKPT_MEM_R), outer);
+    CHECK_EQ(mips_breakpoint_find(m, 0x1408, BKPT_MEM_R), far);
+    CHECK_EQ(mips_breakpoint_find(m, 0x1800, BKPT_MEM_R), inner);
+    CHECK_EQ(mips_breakpoint_find(m, 0x1900, BKPT_MEM_R), inner);
+    
+    // only reachable through the running maximum of range ends
+    CHECK_EQ(mips_breakpoint_find(m, 0x1901, BKPT_MEM_R), outer);
+    CHECK_EQ(mips_breakpoint_find(m, 0x1fff, BKPT_MEM_R), outer);
+    CHECK_EQ(mips_breakpoint_find(m, 0x2000, BKPT_MEM_R), -1);
+    
+    // other types are not affected
+    CHECK_EQ(mips_breakpoint_find(m, 0x1800, BKPT_MEM_W), -1);
+    CHECK_EQ(mips_breakpoint_find(m, 0x1800, BKPT_MEM_W | BKPT_MEM_R), inner);
+    
+    // newest wins, whatever the group
+    int masked = mips_breakpoint_add(m, BKPT_MEM_R, 0x800, 0x8ff, 0xfff);
+    
+    CHECK_EQ(mips_breakpoint_find(m, 0x1850, BKPT_MEM_R), masked);
+    CHECK_EQ(mips_breakpoint_find(m, 0x12345808, BKPT_MEM_R), masked);
+    CHECK_EQ(mips_breakpoint_find(m, 0x12345908, BKPT_MEM_R), -1);
+    CHECK_EQ(mips_breakpoint_find(m, 0x1908, BKPT_MEM_R), outer);
+    
+    // remove and re-add
+    mips_breakpoint_remove(m, masked);
+    CHECK_EQ(mips_breakpoint_find(m, 0x1850, BKPT_MEM_R), inner);
+    
+    mips_breakpoint_remove(m, inner);
+    CHECK_EQ(mips_breakpoint_find(m, 0x1850, BKPT_MEM_R), outer);
+    CHECK_EQ(mips_breakpoint_find(m, 0x1408, BKPT_MEM_R), far);
+    
+    inner = mips_breakpoint_add(m, BKPT_MEM_R, 0x1800, 0x1900, 0xffffffff);
+    CHECK(inner > far);
+    CHECK_EQ(mips_breakpoint_find(m, 0x1850, BKPT_MEM_R), inner);
+    CHECK_EQ(mips_breakpoint_count(m, BKPT_NONE), 3);
+    
+    // disabled and empty ranges never match
+    Breakpoint *b = mips_breakpoint(m, inner);
+    CHECK(b != NULL);
+    b->type |= BKPT_DISABLED;
+    CHECK_EQ(mips_breakpoint_find(m, 0x1850, BKPT_MEM_R), outer);
+    
+    mips_breakpoint_add(m, BKPT_MEM_R, 0x1900, 0x1800, 0xffffffff);
+    CHECK_EQ(mips_breakpoint_find(m, 0x1850, BKPT_MEM_R), outer);
+    
+    mips_breakpoint_clear(m);
+    CHECK_EQ(mips_breakpoint_count(m, BKPT_NONE), 0);
+    CHECK_EQ(mips_breakpoint_find(m, 0x1850, BKPT_MEM_R), -1);
+}
+
+static void check_prefilters(MIPS *m)
+{
+    // no breakpoint : every test takes the fast path
+    CHECK_EQ(m->breakpoint_types, 0);
+    CHECK_EQ(mips_breakpoint_test(m, 0x1000, BKPT_MEM_R), MIPS_OK);
+    
+    mips_breakpoint_add(m, BKPT_MEM_X, 0x00401ff0, 0x00402010, 0xffffffff);
+    
+    // nothing is known until the index is rebuilt
+    CHECK_EQ(m->breakpoint_types, BKPT_TYPE_MASK);
+    CHECK(m->breakpoint_pages == NULL);
+    
+    CHECK_EQ(mips_breakpoint_find(m, 0, BKPT_MEM_X), -1);
+    CHECK_EQ(m->breakpoint_types, BKPT_MEM_X);
+    CHECK_EQ(m->breakpoint_opcodes, 0);
+    
+    // types without breakpoints are rejected before any lookup
+    CHECK_EQ(mips_breakpoint_test(m, 0x00402000, BKPT_MEM_W), MIPS_OK);
+    
+    CHECK(!page_flagged(m, 0x00400ffc));
+    CHECK(page_flagged(m, 0x00401000));
+    CHECK(page_flagged(m, 0x00402ffc));
+    CHECK(!page_flagged(m, 0x00403000));
+    
+    // masks dropping page bits cover every page
+    mips_breakpoint_add(m, BKPT_MEM_X, 0x10, 0x20, 0xfff);
+    mips_breakpoint_find(m, 0, BKPT_MEM_X);
+    
+    CHECK(page_flagged(m, 0x00000000));
+    CHECK(page_flagged(m, 0x7ffff010));
+    CHECK(page_flagged(m, 0xfffff000));
+    
+    mips_breakpoint_clear(m);
+    CHECK_EQ(m->breakpoint_types, 0);
+    
+    // opcode breakpoints : jal and j, then any special instruction
+    int jal = mips_breakpoint_add(m, BKPT_OPCODE, 0x08000000, 0x0fffffff, 0xffffffff);
+    
+    CHECK_EQ(mips_breakpoint_find(m, 0x0c100000, BKPT_OPCODE), jal);
+    CHECK_EQ(mips_breakpoint_find(m, 0x10000000, BKPT_OPCODE), -1);
+    CHECK_EQ(m->breakpoint_opcodes, (1 << 2) | (1 << 3));
+    CHECK_EQ(m->breakpoint_types, BKPT_OPCODE);
+    
+    int brk = mips_breakpoint_add(m, BKPT_OPCODE, 0x0d, 0x0d, 0xfc00003f);
+    
+    CHECK_EQ(mips_breakpoint_find(m, 0x03ff000d, BKPT_OPCODE), brk);
+    CHECK_EQ(mips_breakpoint_find(m, 0x03ff000c, BKPT_OPCODE), -1);
+    CHECK_EQ(m->breakpoint_opcodes, (1 << 0) | (1 << 2) | (1 << 3));
+    
+    // partial opcode masks disable the opcode prefilter
+    mips_breakpoint_add(m, BKPT_OPCODE, 0x0d, 0x0d, 0x3f);
+    mips_breakpoint_find(m, 0, BKPT_OPCODE);
+    CHECK_EQ(m->breakpoint_opcodes, ~(uint64_t)0);
+    
+    mips_breakpoint_clear(m);
+}
+
+static void check_run(MIPS *m)
+{
+    ELF_File *elf = elf_file_create();
+    
+    if ( elf == NULL || elf_file_load(elf, "demos/arith") || mips_load_elf(m, elf) )
+    {
+        fprintf(stderr, "unable to load demos/arith\n");
+        ++check_failures;
+        elf_file_destroy(elf);
+        return;
+    }
+    
+    MIPS_Addr entry = mips_get_reg(m, PC);
+    
+    // execution : stops before the instruction
+    int x = mips_breakpoint_add(m, BKPT_MEM_X, entry + 8, entry + 8, 0xffffffff);
+    
+    CHECK_EQ(mips_run(m, 0, NULL), MIPS_BKPT);
+    CHECK_EQ(m->breakpoint_hit, x);
+    CHECK_EQ((MIPS_Addr)mips_get_reg(m, PC), entry + 8);
+    
+    // breakpoints are disabled rather than removed to keep ids distinct
+    mips_breakpoint(m, x)->type |= BKPT_DISABLED;
+    
+    // memory writes : any store
+    int w = mips_breakpoint_add(m, BKPT_MEM_W, 0, 0xffffffff, 0xffffffff);
+    
+    CHECK_EQ(mips_run(m, 0, NULL), MIPS_BKPT);
+    CHECK_EQ(m->breakpoint_hit, w);
+    
+    mips_breakpoint(m, w)->type |= BKPT_DISABLED;
+    
+    // opcode : any jal, stops once its delay slot has been executed
+    int o = mips_breakpoint_add(m, BKPT_OPCODE, 0x0c000000, 0x0fffffff, 0xffffffff);
+    
+    CHECK_EQ(mips_run(m, 0, NULL), MIPS_BKPT);
+    CHECK_EQ(m->breakpoint_hit, o);
+    
+    mips_breakpoint(m, o)->type |= BKPT_DISABLED;
+    
+    // nothing left enabled : runs to the final break
+    CHECK_EQ(mips_run(m, 0, NULL), MIPS_BREAK);
+    
+    mips_breakpoint_clear(m);
+    elf_file_destroy(elf);
+}
+
+int main()
+{
+    MIPSIM_Config *cfg = mipsim_config_create(NULL);
+    
+    // keep the console output of the demo out of the test log
+    cfg->mon_out = fopen("/dev/null", "w");
+    
+    mipsim_config_bind(cfg);
+    
+    MIPS *m = mips_create(MIPS_I, NULL);
+    
+    check_ranges(m);
+    check_prefilters(m);
+    check_run(m);
+    
+    mips_destroy(m);
+    
+    mipsim_config_bind(NULL);
+    mipsim_config_destroy(cfg);
+    
+    return check_status();
+}
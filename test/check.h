@@ -0,0 +1,52 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+#ifndef _MIPSIM_CHECK_H_
+#define _MIPSIM_CHECK_H_
+
+/*!
+    \file check.h
+    \brief Minimal helpers for the unit tests run by "make check"
+    \author Hugues Bruant
+    
+    Each test program includes this header once, reports failed checks on
+    stderr and returns check_status() from main.
+*/
+
+#include <stdio.h>
+
+static int check_failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if ( !(cond) ) \
+        { \
+            fprintf(stderr, "%s:%d: check failed : %s\n", __FILE__, __LINE__, #cond); \
+            ++check_failures; \
+        } \
+    } while ( 0 )
+
+#define CHECK_EQ(a, b) \
+    do { \
+        unsigned long long check_a = (unsigned long long)(a), check_b = (unsigned long long)(b); \
+        if ( check_a != check_b ) \
+        { \
+            fprintf(stderr, "%s:%d: check failed : %s == %s (0x%llx != 0x%llx)\n", \
+                    __FILE__, __LINE__, #a, #b, check_a, check_b); \
+            ++check_failures; \
+        } \
+    } while ( 0 )
+
+static inline int check_status()
+{
+    return check_failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+# Test runner used by "make check" : runs every test program given on the
+# command line and every test/*.sh script from the top-level directory
+
+failed=0
+total=0
+
+for t in "$@" test/*.sh
+do
+    case "$t" in
+        test/check.sh|test/common.sh)
+            continue
+            ;;
+        *.sh)
+            sh "$t"
+            ;;
+        *)
+            "./$t"
+            ;;
+    esac
+    
+    if [ $? -eq 0 ]
+    then
+        echo "PASS: $t"
+    else
+        echo "FAIL: $t"
+        failed=$((failed + 1))
+    fi
+    
+    total=$((total + 1))
+done
+
+echo "$((total - failed)) of $total tests passed"
+
+[ $failed -eq 0 ]
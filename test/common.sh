@@ -0,0 +1,25 @@
+# Helpers shared by the test scripts run by "make check"
+#
+# Scripts are run from the top-level directory and report failures with
+# fail, the status of the script being that of the last line : exit $status
+
+status=0
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/mipsim-test.XXXXXX") || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+fail()
+{
+    echo "FAIL: $*" >&2
+    status=1
+}
+
+# expect <expected status> <description> <command...>
+expect()
+{
+    want=$1
+    what=$2
+    shift 2
+    "$@" > "$tmp/expect.out" 2>&1
+    got=$?
+    [ "$got" -eq "$want" ] || fail "$what : exit status $got, expected $want"
+}
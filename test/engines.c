@@ -0,0 +1,140 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+#include "check.h"
+
+/*!
+    \file engines.c
+    \brief Self-modifying code under every execution engine
+    \author Hugues Bruant
+    
+    A loop is written over the entry point of a demo, run long enough for
+    the jit engine to translate it, then patched through mips_write_block :
+    every engine must pick up the new code instead of a stale predecoded or
+    translated copy.
+*/
+
+#include "config.h"
+#include "mips.h"
+#include "mipself.h"
+#include "elffile.h"
+
+enum {
+    LOOPS = 100
+};
+
+static const uint32_t loop[] = {
+    0x24080000 | LOOPS,     // addiu t0, zero, LOOPS
+    0x24420001,             // addiu v0, v0, 1
+    0x2508ffff,             // addiu t0, t0, -1
+    0x1500fffd,             // bne t0, zero, -12
+    0x00000000,             // nop
+    0x0000000d              // break
+};
+
+/*!
+    \brief Write instruction words, guest memory being big-endian
+*/
+static int write_code(MIPS *m, MIPS_Addr a, const uint32_t *w, int n)
+{
+    uint8_t d[sizeof(loop)];
+    MIPS_Addr fault;
+    
+    for ( int i = 0; i < n; ++i )
+    {
+        d[4 * i]     = w[i] >> 24;
+        d[4 * i + 1] = w[i] >> 16;
+        d[4 * i + 2] = w[i] >> 8;
+        d[4 * i + 3] = w[i];
+    }
+    
+    return mips_write_block(m, a, d, 4 * n, &fault);
+}
+
+static uint32_t run_loop(MIPS *m, MIPS_Addr entry, uint64_t *count)
+{
+    mips_set_reg(m, PC, entry);
+    mips_set_reg(m, V0, 0);
+    
+    CHECK_EQ(mips_run(m, 0, count), MIPS_BREAK);
+    
+    return mips_get_reg(m, V0);
+}
+
+static void check_engine(int engine)
+{
+    ELF_File *elf = elf_file_create();
+    MIPS *m = mips_create(MIPS_I, NULL);
+    
+    CHECK(elf != NULL && m != NULL);
+    
+    if ( elf == NULL || m == NULL || elf_file_load(elf, "demos/hellos") || mips_load_elf(m, elf) )
+    {
+        fprintf(stderr, "%s : unable to load demos/hellos\n", mips_engine_name(engine));
+        ++check_failures;
+        return;
+    }
+    
+    CHECK_EQ(mips_set_engine(m, engine), 0);
+    
+    MIPS_Addr entry = mips_get_reg(m, PC);
+    uint64_t count = 0;
+    
+    CHECK_EQ(write_code(m, entry, loop, sizeof(loop) / 4), MEM_OK);
+    
+    CHECK_EQ(run_loop(m, entry, &count), LOOPS);
+    // delay slots are counted with their branch
+    CHECK_EQ(count, 2 + 3 * LOOPS);
+    
+    // patch the loop body : addiu v0, v0, 2
+    uint32_t patch = 0x24420002;
+    CHECK_EQ(write_code(m, entry + 4, &patch, 1), MEM_OK);
+    
+    CHECK_EQ(run_loop(m, entry, &count), 2 * LOOPS);
+    
+    // patch the loop count
+    patch = 0x24080000 | (LOOPS / 2);
+    CHECK_EQ(write_code(m, entry, &patch, 1), MEM_OK);
+    
+    CHECK_EQ(run_loop(m, entry, &count), LOOPS);
+    CHECK_EQ(count, 2 + 3 * (LOOPS / 2));
+    
+    // rewrite the word after the delay slot : the branch must not be left
+    // without its delay slot
+    CHECK_EQ(write_code(m, entry + 20, &loop[5], 1), MEM_OK);
+    
+    CHECK_EQ(run_loop(m, entry, &count), LOOPS);
+    CHECK_EQ(count, 2 + 3 * (LOOPS / 2));
+    
+    // patch the delay slot : addiu v0, v0, 1
+    patch = 0x24420001;
+    CHECK_EQ(write_code(m, entry + 16, &patch, 1), MEM_OK);
+    
+    CHECK_EQ(run_loop(m, entry, &count), 3 * (LOOPS / 2));
+    CHECK_EQ(count, 2 + 3 * (LOOPS / 2));
+    
+    mips_destroy(m);
+    elf_file_destroy(elf);
+}
+
+int main()
+{
+    MIPSIM_Config *cfg = mipsim_config_create(NULL);
+    
+    mipsim_config_bind(cfg);
+    
+    for ( int e = 0; e < MIPS_ENGINE_COUNT; ++e )
+        check_engine(e);
+    
+    mipsim_config_bind(NULL);
+    mipsim_config_destroy(cfg);
+    
+    return check_status();
+}
@@ -0,0 +1,70 @@
+# Engine equivalence : the threaded and jit engines must produce the same
+# console output, stop reason, exit status, instruction count, registers and
+# memory as the universal engine on the demos
+#
+# Tracing sends every engine through the universal decoder : it stays off
+
+. test/common.sh
+
+demos="hellos helloc arith x-integer calculator"
+engines="universal threaded jit"
+
+printf '12+3\n7*6\nq\n' > "$tmp/in"
+
+# registers and stack at instruction count cutoffs, then once stopped
+cat > "$tmp/session" <<SESSION
+si 1
+dump
+si 7
+dump
+si 100
+dump
+si 1000
+dump
+dmem sp-64 sp+64
+run
+dump
+dmem sp-64 sp+64
+status
+quit
+SESSION
+
+for e in $engines
+do
+    for d in $demos
+    do
+        echo "demos/$d - $tmp/in $tmp/$d.$e.out"
+        echo "demos/$d - $tmp/in - 333"
+        
+        ./simips --engine $e --stdin "$tmp/in" demos/$d < "$tmp/session" > "$tmp/$d.$e.state" 2>&1
+    done > "$tmp/jobs.$e"
+    
+    # the time column is the only one allowed to differ
+    ./simips --engine $e --jobs 1 --max-insns 1000000 --batch "$tmp/jobs.$e" 2> /dev/null \
+        | awk '!/ jobs, / { $(NF - 1) = ""; print }' \
+        > "$tmp/summary.$e"
+done
+
+for e in $engines
+do
+    [ $e = universal ] && continue
+    
+    cmp -s "$tmp/summary.universal" "$tmp/summary.$e" \
+        || fail "$e : stop reasons or instruction counts differ from universal"
+    
+    for d in $demos
+    do
+        cmp -s "$tmp/$d.universal.out" "$tmp/$d.$e.out" || fail "$e : $d output differs"
+        cmp -s "$tmp/$d.universal.state" "$tmp/$d.$e.state" || fail "$e : $d registers or memory differ"
+    done
+done
+
+for d in $demos
+do
+    grep -q 'sp = 0x' "$tmp/$d.universal.state" || fail "$d : no register dump"
+done
+
+grep -q Break "$tmp/summary.universal" || fail "summary : missing jobs"
+grep -q 'Instruction limit reached' "$tmp/summary.universal" || fail "summary : missing cutoffs"
+
+exit $status
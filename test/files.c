@@ -0,0 +1,274 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**   
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+// mkdtemp and symlink are not part of C99
+#define _DEFAULT_SOURCE
+
+#include "check.h"
+
+/*!
+    \file files.c
+    \brief Sandbox path resolution and guest file offsets
+    \author Hugues Bruant
+*/
+
+#include "config.h"
+#include "files.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+static char base[64];
+
+static void host_write(const char *name, const char *data)
+{
+    char path[256];
+    
+    snprintf(path, sizeof(path), "%s/%s", base, name);
+    
+    FILE *f = fopen(path, "w");
+    
+    CHECK(f != NULL);
+    
+    if ( f != NULL )
+    {
+        fputs(data, f);
+        fclose(f);
+    }
+}
+
+static void host_path(char *path, size_t n, const char *name)
+{
+    snprintf(path, n, "%s/%s", base, name);
+}
+
+/*
+    open a guest path read-only, return the error code (0 on success)
+*/
+static int try_open(MIPS_Files *f, const char *path)
+{
+    int err = 0;
+    int fd = mips_files_open(f, path, MIPS_O_RDONLY, &err);
+    
+    if ( fd >= 0 )
+    {
+        CHECK(err == 0);
+        mips_files_close(f, fd, &err);
+        return 0;
+    }
+    
+    CHECK(err != 0);
+    return err;
+}
+
+static void check_paths(MIPS_Files *f)
+{
+    // inside the sandbox, relative and absolute paths alike
+    CHECK_EQ(try_open(f, "root.txt"), 0);
+    CHECK_EQ(try_open(f, "/root.txt"), 0);
+    CHECK_EQ(try_open(f, "a/in.txt"), 0);
+    CHECK_EQ(try_open(f, "/a/in.txt"), 0);
+    CHECK_EQ(try_open(f, "./a/./in.txt"), 0);
+    CHECK_EQ(try_open(f, "a/../root.txt"), 0);
+    CHECK_EQ(try_open(f, "//a//in.txt"), 0);
+    
+    // an absolute guest path never reaches the host file system
+    CHECK_EQ(try_open(f, "/out.txt"), MIPS_ENOENT);
+    CHECK_EQ(try_open(f, "/root/out.txt"), MIPS_ENOENT);
+    
+    // ".." cannot climb above the sandbox
+    CHECK_EQ(try_open(f, ".."), MIPS_EACCES);
+    CHECK_EQ(try_open(f, "../out.txt"), MIPS_EACCES);
+    CHECK_EQ(try_open(f, "/../out.txt"), MIPS_EACCES);
+    CHECK_EQ(try_open(f, "a/../../out.txt"), MIPS_EACCES);
+    CHECK_EQ(try_open(f, "a/../../root/root.txt"), MIPS_EACCES);
+    
+    // symlinked directory pointing outside the sandbox
+    CHECK_EQ(try_open(f, "escape/out.txt"), MIPS_EACCES);
+    CHECK_EQ(try_open(f, "a/escape/out.txt"), MIPS_EACCES);
+    
+    // symlinked directory staying inside the sandbox
+    CHECK_EQ(try_open(f, "alias/in.txt"), 0);
+    
+    // symlink as last component, wherever it points
+    CHECK_EQ(try_open(f, "link.txt"), MIPS_ELOOP);
+    CHECK_EQ(try_open(f, "a/link.txt"), MIPS_ELOOP);
+    
+    // nothing was created outside while probing
+    char path[256];
+    struct stat st;
+    
+    host_path(path, sizeof(path), "out.txt");
+    CHECK(stat(path, &st) == 0 && st.st_size == 3);
+}
+
+static void check_offsets(MIPS_Files *f)
+{
+    int err = 0;
+    char buf[16];
+    
+    int fd = mips_files_open(f, "data.txt", MIPS_O_RDWR | MIPS_O_CREAT | MIPS_O_TRUNC, &err);
+    
+    CHECK(fd >= MIPS_FILES_CONSOLE);
+    CHECK(mips_files_valid(f, fd));
+    
+    CHECK_EQ(mips_files_write(f, fd, "0123456789", 10, &err), 10);
+    CHECK_EQ(mips_files_lseek(f, fd, 0, SEEK_CUR, &err), 10);
+    CHECK_EQ(mips_files_lseek(f, fd, 2, SEEK_SET, &err), 2);
+    
+    CHECK_EQ(mips_files_read(f, fd, buf, 3, &err), 3);
+    CHECK(!memcmp(buf, "234", 3));
+    CHECK_EQ(mips_files_lseek(f, fd, 0, SEEK_CUR, &err), 5);
+    
+    // writes happen at the tracked offset
+    CHECK_EQ(mips_files_write(f, fd, "ab", 2, &err), 2);
+    CHECK_EQ(mips_files_lseek(f, fd, -3, SEEK_END, &err), 7);
+    CHECK_EQ(mips_files_read(f, fd, buf, sizeof(buf), &err), 3);
+    CHECK(!memcmp(buf, "789", 3));
+    
+    // end of file
+    CHECK_EQ(mips_files_read(f, fd, buf, sizeof(buf), &err), 0);
+    
+    CHECK_EQ(mips_files_lseek(f, fd, 0, SEEK_SET, &err), 0);
+    CHECK_EQ(mips_files_read(f, fd, buf, sizeof(buf), &err), 10);
+    CHECK(!memcmp(buf, "01234ab789", 10));
+    
+    err = 0;
+    CHECK_EQ(mips_files_lseek(f, fd, -1, SEEK_SET, &err), -1);
+    CHECK_EQ(err, MIPS_EINVAL);
+    
+    CHECK_EQ(mips_files_close(f, fd, &err), 0);
+    CHECK(!mips_files_valid(f, fd));
+    
+    err = 0;
+    CHECK_EQ(mips_files_read(f, fd, buf, 1, &err), -1);
+    CHECK_EQ(err, MIPS_EBADF);
+    
+    // appends always land at the end, whatever the offset
+    fd = mips_files_open(f, "data.txt", MIPS_O_RDWR | MIPS_O_APPEND, &err);
+    
+    CHECK(fd >= MIPS_FILES_CONSOLE);
+    CHECK_EQ(mips_files_lseek(f, fd, 0, SEEK_CUR, &err), 0);
+    CHECK_EQ(mips_files_read(f, fd, buf, 4, &err), 4);
+    CHECK(!memcmp(buf, "0123", 4));
+    
+    CHECK_EQ(mips_files_write(f, fd, "XY", 2, &err), 2);
+    CHECK_EQ(mips_files_lseek(f, fd, 0, SEEK_CUR, &err), 12);
+    
+    CHECK_EQ(mips_files_lseek(f, fd, 1, SEEK_SET, &err), 1);
+    CHECK_EQ(mips_files_write(f, fd, "Z", 1, &err), 1);
+    CHECK_EQ(mips_files_lseek(f, fd, 0, SEEK_CUR, &err), 13);
+    
+    CHECK_EQ(mips_files_lseek(f, fd, 0, SEEK_SET, &err), 0);
+    CHECK_EQ(mips_files_read(f, fd, buf, sizeof(buf), &err), 13);
+    CHECK(!memcmp(buf, "01234ab789XYZ", 13));
+    
+    mips_files_close(f, fd, &err);
+    
+    // writes to a read-only descriptor fail without moving the offset
+    fd = mips_files_open(f, "data.txt", MIPS_O_RDONLY, &err);
+    
+    err = 0;
+    CHECK_EQ(mips_files_write(f, fd, "!", 1, &err), -1);
+    CHECK_EQ(err, MIPS_EBADF);
+    CHECK_EQ(mips_files_lseek(f, fd, 0, SEEK_CUR, &err), 0);
+    
+    mips_files_close(f, fd, &err);
+}
+
+static void check_unsandboxed(void)
+{
+    int err = 0;
+    MIPS_Files *f = mips_files_create(NULL);
+    
+    CHECK(f != NULL);
+    
+    // no sandbox : every access is denied
+    CHECK_EQ(mips_files_open(f, "root.txt", MIPS_O_RDONLY, &err), -1);
+    CHECK_EQ(err, MIPS_EACCES);
+    
+    mips_files_destroy(f);
+}
+
+int main()
+{
+    MIPSIM_Config *cfg = mipsim_config_create(NULL);
+    
+    mipsim_config_bind(cfg);
+    
+    /*
+        layout :
+            out.txt             outside the sandbox
+            root/root.txt
+            root/a/in.txt
+            root/a/escape   ->  ../..   (outside)
+            root/a/link.txt ->  in.txt
+            root/escape     ->  ..      (outside)
+            root/alias      ->  a
+            root/link.txt   ->  ../out.txt
+    */
+    strcpy(base, "/tmp/mipsim-files-XXXXXX");
+    
+    if ( mkdtemp(base) == NULL )
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    
+    char path[256], root[256];
+    
+    host_write("out.txt", "out");
+    host_path(root, sizeof(root), "root");
+    mkdir(root, 0777);
+    host_path(path, sizeof(path), "root/a");
+    mkdir(path, 0777);
+    host_write("root/root.txt", "root");
+    host_write("root/a/in.txt", "in");
+    
+    host_path(path, sizeof(path), "root/a/escape");
+    CHECK(!symlink("../..", path));
+    host_path(path, sizeof(path), "root/a/link.txt");
+    CHECK(!symlink("in.txt", path));
+    host_path(path, sizeof(path), "root/escape");
+    CHECK(!symlink("..", path));
+    host_path(path, sizeof(path), "root/alias");
+    CHECK(!symlink("a", path));
+    host_path(path, sizeof(path), "root/link.txt");
+    CHECK(!symlink("../out.txt", path));
+    
+    MIPS_Files *f = mips_files_create(root);
+    
+    CHECK(f != NULL);
+    
+    if ( f != NULL )
+    {
+        check_paths(f);
+        check_offsets(f);
+        mips_files_destroy(f);
+    }
+    
+    check_unsandboxed();
+    
+    char cmd[128];
+    
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", base);
+    
+    if ( system(cmd) )
+        fprintf(stderr, "could not remove %s\n", base);
+    
+    mipsim_config_bind(NULL);
+    mipsim_config_destroy(cfg);
+    
+    return check_status();
+}
@@ -0,0 +1,24 @@
+# Headless mode : exit statuses of --run, as documented in the README
+
+. test/common.sh
+
+# hellos with its code replaced by a call to the _exit monitor entry :
+#   lui t0, 0xbfc0 ; ori t0, t0, 0x88 ; jr t0 ; addiu a0, zero, 42
+cp demos/hellos "$tmp/exit42"
+printf '\074\010\277\300\065\010\000\210\001\000\000\010\044\004\000\052' \
+    | dd of="$tmp/exit42" bs=1 seek=$((0x1174)) conv=notrunc 2> /dev/null
+
+printf '12+3\nq\n' > "$tmp/in"
+
+expect 42  "_exit status"           ./simips --run "$tmp/exit42"
+expect 0   "break"                  ./simips --run demos/hellos
+expect 124 "instruction limit"      ./simips --run --max-insns 10 demos/arith
+expect 125 "exception"              ./simips --run demos/x-integer
+expect 126 "missing program"        ./simips --run "$tmp/missing"
+expect 126 "invalid program"        ./simips --run "$tmp/in"
+
+expect 0   "console files"          ./simips --run --stdin "$tmp/in" --stdout "$tmp/calc.run" \
+    --max-insns 200000 demos/calculator
+grep -q '= 15' "$tmp/calc.run" || fail "--stdout : calculator output not written"
+
+exit $status
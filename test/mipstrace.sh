@@ -0,0 +1,23 @@
+# Binary traces : mipstrace must turn a trace recorded with --trace-bin
+# into exactly the text produced by --trace during the same run
+
+. test/common.sh
+
+printf '12+3\n' > "$tmp/in"
+
+for d in hellos helloc arith x-integer calculator
+do
+    ./simips --run --max-insns 200000 --stdin "$tmp/in" --trace --trace-log "$tmp/$d.txt" \
+        --trace-bin "$tmp/$d.bin" demos/$d > /dev/null 2>&1
+    
+    ./mipstrace "$tmp/$d.bin" > "$tmp/$d.dec" 2>&1 || fail "$d : mipstrace failed"
+    
+    [ -s "$tmp/$d.txt" ] || fail "$d : empty trace"
+    cmp -s "$tmp/$d.txt" "$tmp/$d.dec" || fail "$d : decoded trace differs from --trace"
+done
+
+# memory accesses are only listed on request
+grep -q '@ 0x' "$tmp/arith.dec" && fail "memory accesses listed without --mem"
+./mipstrace --mem "$tmp/arith.bin" | grep -q '^	store @ 0x' || fail "--mem : no store listed"
+
+exit $status
@@ -0,0 +1,417 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+#include "decode.h"
+
+/*!
+    \file threaded.c
+    \brief Threaded-code execution engine
+    \author Hugues Bruant
+*/
+
+#include "io.h"
+#include "config.h"
+#include "mips_p.h"
+#include "trace.h"
+
+int decode_j       (MIPS *m, uint32_t ir);
+int decode_beq     (MIPS *m, uint32_t ir);
+int decode_blez    (MIPS *m, uint32_t ir);
+int decode_bltz    (MIPS *m, uint32_t ir);
+int decode_jr      (MIPS *m, uint32_t ir);
+
+int decode_shift   (MIPS *m, uint32_t ir);
+int decode_movhilo (MIPS *m, uint32_t ir);
+int decode_add     (MIPS *m, uint32_t ir);
+int decode_sub     (MIPS *m, uint32_t ir);
+int decode_mult    (MIPS *m, uint32_t ir);
+int decode_multu   (MIPS *m, uint32_t ir);
+int decode_div     (MIPS *m, uint32_t ir);
+int decode_divu    (MIPS *m, uint32_t ir);
+int decode_and     (MIPS *m, uint32_t ir);
+int decode_or      (MIPS *m, uint32_t ir);
+int decode_xor     (MIPS *m, uint32_t ir);
+int decode_nor     (MIPS *m, uint32_t ir);
+int decode_slt     (MIPS *m, uint32_t ir);
+int decode_sltu    (MIPS *m, uint32_t ir);
+int decode_movcond (MIPS *m, uint32_t ir);
+
+int decode_addi    (MIPS *m, uint32_t ir);
+int decode_slti    (MIPS *m, uint32_t ir);
+int decode_sltiu   (MIPS *m, uint32_t ir);
+int decode_andi    (MIPS *m, uint32_t ir);
+int decode_ori     (MIPS *m, uint32_t ir);
+int decode_xori    (MIPS *m, uint32_t ir);
+int decode_lui     (MIPS *m, uint32_t ir);
+
+int decode_lb      (MIPS *m, uint32_t ir);
+int decode_lbu     (MIPS *m, uint32_t ir);
+int decode_lh      (MIPS *m, uint32_t ir);
+int decode_lhu     (MIPS *m, uint32_t ir);
+int decode_lw      (MIPS *m, uint32_t ir);
+int decode_lwu     (MIPS *m, uint32_t ir);
+int decode_sb      (MIPS *m, uint32_t ir);
+int decode_sh      (MIPS *m, uint32_t ir);
+int decode_sw      (MIPS *m, uint32_t ir);
+
+int decode_mul     (MIPS *m, uint32_t ir);
+int decode_madd    (MIPS *m, uint32_t ir);
+int decode_maddu   (MIPS *m, uint32_t ir);
+int decode_msub    (MIPS *m, uint32_t ir);
+int decode_msubu   (MIPS *m, uint32_t ir);
+int decode_clz     (MIPS *m, uint32_t ir);
+int decode_clo     (MIPS *m, uint32_t ir);
+
+/*!
+    \internal
+    \brief Classify a predecoded instruction for the fast engines
+    \param d predecoded instruction
+    \param last whether \a d is the last slot of its page
+    \return operation, -1 if the instruction cannot be translated yet
+    
+    Operations are selected by handler identity so that the threaded
+    engine keeps the exact semantics of the universal one. Handlers that
+    cannot alter the PC are called directly (OP_CALL), anything else goes
+    through the universal engine (OP_SLOW).
+    
+    Branches are only translated when their delay slot lies in the same
+    page and is itself neither a control instruction nor a slow one.
+*/
+int mips_decoded_op(const MIPS_Decoded *d, int last)
+{
+    const uint32_t ir = d->ir;
+    const instr_decode f = d->decode;
+    
+    if ( d->verdict == DECODED_EMPTY )
+        return -1;
+    else if ( d->verdict != DECODED_OK )
+        return OP_SLOW;
+    
+    if ( f == decode_j || f == decode_jr
+        || (f == decode_beq  && !(ir & 0x40000000))
+        || (f == decode_blez && !(ir & 0x40000000))
+        || (f == decode_bltz && !(ir & 0x00020000)) )
+    {
+        if ( last )
+            return OP_SLOW;
+        
+        int k = mips_decoded_op(d + 1, 1);
+        
+        if ( k < 0 )
+            return -1;
+        else if ( k == OP_SLOW || k >= OP_BRANCH )
+            return OP_SLOW;
+        
+        if ( f == decode_j )
+            return OP_J;
+        else if ( f == decode_jr )
+            return OP_JR;
+        else if ( f == decode_beq )
+            return OP_BEQ;
+        else if ( f == decode_blez )
+            return OP_BLEZ;
+        
+        return OP_BLTZ;
+    }
+    
+    if ( f == decode_shift )
+        return (ir & 4 ? OP_SLLV - OP_SLL : 0) + (!(ir & 2) ? OP_SLL : (ir & 1 ? OP_SRA : OP_SRL));
+    else if ( f == decode_add && (ir & 1) )
+        return OP_ADDU;
+    else if ( f == decode_sub && (ir & 1) )
+        return OP_SUBU;
+    else if ( f == decode_and )
+        return OP_AND;
+    else if ( f == decode_or )
+        return OP_OR;
+    else if ( f == decode_xor )
+        return OP_XOR;
+    else if ( f == decode_nor )
+        return OP_NOR;
+    else if ( f == decode_slt )
+        return OP_SLT;
+    else if ( f == decode_sltu )
+        return OP_SLTU;
+    else if ( f == decode_movhilo && !(ir & 1) )
+        return ir & 2 ? OP_MFLO : OP_MFHI;
+    else if ( f == decode_addi && (ir & 0x04000000) )
+        return OP_ADDIU;
+    else if ( f == decode_slti )
+        return OP_SLTI;
+    else if ( f == decode_sltiu )
+        return OP_SLTIU;
+    else if ( f == decode_andi )
+        return OP_ANDI;
+    else if ( f == decode_ori )
+        return OP_ORI;
+    else if ( f == decode_xori )
+        return OP_XORI;
+    else if ( f == decode_lui )
+        return OP_LUI;
+    
+    if ( f == decode_add || f == decode_sub || f == decode_addi
+        || f == decode_movhilo || f == decode_movcond
+        || f == decode_mult || f == decode_multu
+        || f == decode_div || f == decode_divu
+        || f == decode_lb || f == decode_lbu || f == decode_lh || f == decode_lhu
+        || f == decode_lw || f == decode_lwu
+        || f == decode_sb || f == decode_sh || f == decode_sw
+        || f == decode_mul || f == decode_madd || f == decode_maddu
+        || f == decode_msub || f == decode_msubu
+        || f == decode_clz || f == decode_clo )
+        return OP_CALL;
+    
+    return OP_SLOW;
+}
+
+/*!
+    \internal
+    \brief Threaded-code execution engine
+    \param m simulated machine
+    \return stop reason
+    
+    Executes predecoded instructions by jumping directly from one
+    operation to the next (computed goto) until the instruction budget
+    of the machine is exhausted or the simulation is stopped.
+    
+    Defers to the universal engine when tracing or when breakpoints are
+    set, as well as for any instruction it does not translate.
+*/
+int mips_threaded_decode(MIPS *m)
+{
+#ifdef __GNUC__
+    static const void * const ops[OP_COUNT] = {
+        [OP_SLOW]  = &&op_slow,
+        [OP_CALL]  = &&op_call,
+        [OP_SLL]   = &&op_sll,
+        [OP_SRL]   = &&op_srl,
+        [OP_SRA]   = &&op_sra,
+        [OP_SLLV]  = &&op_sllv,
+        [OP_SRLV]  = &&op_srlv,
+        [OP_SRAV]  = &&op_srav,
+        [OP_ADDU]  = &&op_addu,
+        [OP_SUBU]  = &&op_subu,
+        [OP_AND]   = &&op_and,
+        [OP_OR]    = &&op_or,
+        [OP_XOR]   = &&op_xor,
+        [OP_NOR]   = &&op_nor,
+        [OP_SLT]   = &&op_slt,
+        [OP_SLTU]  = &&op_sltu,
+        [OP_MFHI]  = &&op_mfhi,
+        [OP_MFLO]  = &&op_mflo,
+        [OP_ADDIU] = &&op_addiu,
+        [OP_SLTI]  = &&op_slti,
+        [OP_SLTIU] = &&op_sltiu,
+        [OP_ANDI]  = &&op_andi,
+        [OP_ORI]   = &&op_ori,
+        [OP_XORI]  = &&op_xori,
+        [OP_LUI]   = &&op_lui,
+        [OP_J]     = &&op_j,
+        [OP_JR]    = &&op_jr,
+        [OP_BEQ]   = &&op_beq,
+        [OP_BLEZ]  = &&op_blez,
+        [OP_BLTZ]  = &&op_bltz
+    };
+    
+    if ( m->breakpoints != NULL || mipsim_tracing() || mips_trace_on() )
+        return mips_universal_decode(m);
+    
+    MIPS_Processor_Private *p = (MIPS_Processor_Private*)m->hw.d;
+    MIPS_Native *r = p->r;
+    
+    uint32_t budget = m->budget ? m->budget : 1;
+    
+    // page tags are page-aligned, 1 never matches
+    MIPS_Addr page = 1;
+    MIPS_Decoded *base = NULL, *d = NULL;
+    
+    // branch target, taken once the delay slot is executed
+    MIPS_Addr target = 0;
+    int pending = 0;
+    
+    #define OP_RD(v) p->pc += 4; r[d->rd] = (v); r[0] = 0; goto next
+    #define OP_RT(v) p->pc += 4; r[d->rt] = (v); r[0] = 0; goto next
+    
+    #define RS ((uint32_t)r[d->rs])
+    #define RT ((uint32_t)r[d->rt])
+    
+lookup:
+    if ( p->pc & 3 )
+        goto op_slow;
+    
+    page = p->pc & ~(MIPS_Addr)(ICACHE_PAGE_SIZE - 1);
+    base = mips_icache_page(m, p->pc);
+    
+    if ( base == NULL )
+    {
+        page = 1;
+        goto op_slow;
+    }
+    
+    d = base + ((p->pc >> 2) & (ICACHE_PAGE_WORDS - 1));
+    
+    if ( d->op == NULL )
+    {
+        int k = mips_decoded_op(d, d == base + ICACHE_PAGE_WORDS - 1);
+        
+        if ( k < 0 )
+            goto op_slow;
+        
+        d->op = ops[k];
+        
+        if ( k >= OP_BRANCH )
+            d[1].op = ops[mips_decoded_op(d + 1, 1)];
+    }
+    
+    goto *d->op;
+    
+next:
+    if ( pending )
+        goto apply;
+    
+step:
+    if ( !--budget )
+        goto done;
+    
+    if ( (p->pc & ~(MIPS_Addr)(ICACHE_PAGE_SIZE - 1)) != page )
+        goto lookup;
+    
+    d = base + ((p->pc >> 2) & (ICACHE_PAGE_WORDS - 1));
+    
+    if ( d->op == NULL )
+        goto lookup;
+    
+    goto *d->op;
+    
+op_slow:
+    m->budget = budget;
+    mips_universal_decode(m);
+    budget = m->budget;
+    
+    if ( m->stop_reason != MIPS_OK || !budget )
+        goto done;
+    
+    goto lookup;
+    
+op_call:
+    p->pc += 4;
+    
+    if ( d->decode(m, d->ir) != MIPS_OK )
+    {
+        if ( m->stop_reason != MIPS_OK )
+        {
+            // the stopping instruction is accounted for
+            --budget;
+            goto done;
+        }
+        
+        // a failing delay slot cancels the branch
+        pending = 0;
+        goto step;
+    }
+    
+    goto next;
+    
+op_sll:   OP_RD(RT << d->sh);
+op_srl:   OP_RD(RT >> d->sh);
+op_sra:   OP_RD(r[d->rt] >> d->sh);
+op_sllv:  OP_RD(RT << (RS & 0x1F));
+op_srlv:  OP_RD(RT >> (RS & 0x1F));
+op_srav:  OP_RD(r[d->rt] >> (RS & 0x1F));
+op_addu:  OP_RD(RS + RT);
+op_subu:  OP_RD(RS - RT);
+op_and:   OP_RD(RS & RT);
+op_or:    OP_RD(RS | RT);
+op_xor:   OP_RD(RS ^ RT);
+op_nor:   OP_RD(~(RS | RT));
+op_slt:   OP_RD(r[d->rs] < r[d->rt]);
+op_sltu:  OP_RD(RS < RT);
+op_mfhi:  OP_RD(p->hi);
+op_mflo:  OP_RD(p->lo);
+op_addiu: OP_RT(RS + (uint32_t)d->imm);
+op_slti:  OP_RT(r[d->rs] < d->imm);
+op_sltiu: OP_RT(RS < (uint32_t)d->imm);
+op_andi:  OP_RT(RS & (d->ir & IMM_MASK));
+op_ori:   OP_RT(RS | (d->ir & IMM_MASK));
+op_xori:  OP_RT(RS ^ (d->ir & IMM_MASK));
+op_lui:   OP_RT((uint32_t)d->imm << 16);
+    
+    /*
+        Branches compute their target and link as the universal engine
+        does, then execute the delay slot before jumping.
+    */
+op_j:
+    if ( d->ir & 0x04000000 )
+        r[31] = p->pc + 8;
+    
+    target = ((p->pc + 8) & 0xF0000000) | ((d->ir & ADDR_MASK) << 2);
+    goto delay;
+    
+op_jr:
+    target = r[d->rs] & ~3;
+    
+    if ( d->ir & 1 )
+    {
+        r[d->rd] = p->pc + 8;
+        r[0] = 0;
+    }
+    
+    goto delay;
+    
+op_beq:
+    if ( (r[d->rs] == r[d->rt]) ^ !!(d->ir & 0x04000000) )
+        goto taken;
+    
+    goto not_taken;
+    
+op_blez:
+    if ( (r[d->rs] <= 0) ^ !!(d->ir & 0x04000000) )
+        goto taken;
+    
+    goto not_taken;
+    
+op_bltz:
+    if ( !((r[d->rs] < 0) ^ !!(d->ir & 0x00010000)) )
+        goto not_taken;
+    
+    if ( d->ir & 0x00100000 )
+        r[31] = p->pc + 8;
+    
+taken:
+    target = p->pc + 4 + ((uint32_t)d->imm << 2);
+    goto delay;
+    
+not_taken:
+    target = p->pc + 8;
+    
+delay:
+    pending = 1;
+    p->pc += 4;
+    ++d;
+    goto *d->op;
+    
+apply:
+    pending = 0;
+    p->pc = target;
+    goto step;
+    
+done:
+    #undef OP_RD
+    #undef OP_RT
+    #undef RS
+    #undef RT
+    
+    m->budget = budget;
+    
+    return m->stop_reason;
+#else
+    return mips_universal_decode(m);
+#endif
+}
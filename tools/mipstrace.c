@@ -0,0 +1,146 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+#include "trace.h"
+
+/*!
+    \file mipstrace.c
+    \brief Binary trace decoder
+    \author Hugues Bruant
+    
+    Turns a trace recorded with --trace-bin back into the text format of
+    --trace. Instructions are rendered by mips_trace_instr, as they are by
+    the universal engine when tracing.
+*/
+
+#include "io.h"
+#include "mips.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*!
+    \brief Print the text of a TRACE_TEXT record
+    \return 0 on success, 1 if the trace is truncated
+*/
+int trace_text(const MIPS_Trace_Record *r, FILE *f)
+{
+    MIPS_Trace_Record d;
+    uint32_t n = r->value;
+    
+    while ( n )
+    {
+        uint32_t len = n < sizeof(MIPS_Trace_Record) ? n : sizeof(MIPS_Trace_Record);
+        
+        if ( fread(&d, sizeof(MIPS_Trace_Record), 1, f) != 1 )
+            return 1;
+        
+        mipsim_printf(IO_TRACE, "%.*s", (int)len, (const char*)&d);
+        n -= len;
+    }
+    
+    return 0;
+}
+
+void trace_record(const MIPS_Trace_Record *r, int arch, int mem)
+{
+    mips_trace_instr(arch, r->pc, r->ir);
+    
+    if ( mem && (r->flags & TRACE_MEM_R) )
+        mipsim_printf(IO_TRACE, "\tload  @ 0x%08x\n", r->addr);
+    else if ( mem && (r->flags & TRACE_MEM_W) )
+        mipsim_printf(IO_TRACE, "\tstore @ 0x%08x\n", r->addr);
+    
+    if ( r->flags & TRACE_REG )
+        mipsim_printf(IO_TRACE, "\t%s = 0x%08x\n", mips_reg_name(r->reg), r->value);
+}
+
+int main(int argc, char **argv)
+{
+    if ( mipsim_config_init(argc, argv) )
+        return 0;
+    
+    MIPSIM_Config *cfg = mipsim_config();
+    const char *trace = NULL;
+    int arch = MIPS_I, mem = 0;
+    
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( !*argv[i] )
+            continue;
+        
+        if ( !strcmp(argv[i], "--mem") )
+        {
+            mem = 1;
+        } else if ( !strcmp(argv[i], "--arch") && i + 1 < argc ) {
+            arch = mips_isa_id(argv[++i]);
+            
+            if ( arch == MIPS_ARCH_NONE )
+            {
+                mipsim_printf(IO_WARNING, "Unknown architecture %s\n", argv[i]);
+                return 1;
+            }
+        } else if ( trace == NULL ) {
+            trace = argv[i];
+        }
+    }
+    
+    if ( trace == NULL )
+    {
+        printf("usage : mipstrace [--arch isa] [--mem] trace\n");
+        return 1;
+    }
+    
+    FILE *f = fopen(trace, "rb");
+    
+    if ( f == NULL )
+    {
+        mipsim_printf(IO_WARNING, "Unable to open %s\n", trace);
+        return 1;
+    }
+    
+    MIPS_Trace_Header h;
+    
+    if ( fread(&h, sizeof(MIPS_Trace_Header), 1, f) != 1
+        || memcmp(h.magic, MIPS_TRACE_MAGIC, sizeof(MIPS_TRACE_MAGIC))
+        || h.version != MIPS_TRACE_VERSION
+        || h.record_size != sizeof(MIPS_Trace_Record) )
+    {
+        mipsim_printf(IO_WARNING, "%s is not a valid trace\n", trace);
+        fclose(f);
+        return 1;
+    }
+    
+    // render through the regular trace output, to stdout
+    cfg->io_mask |= IO_TRACE;
+    
+    MIPS_Trace_Record r;
+    int ret = 0;
+    
+    while ( !ret && fread(&r, sizeof(MIPS_Trace_Record), 1, f) == 1 )
+    {
+        if ( r.flags & TRACE_TEXT )
+            ret = trace_text(&r, f);
+        else if ( r.flags & TRACE_SET )
+            mipsim_printf(IO_TRACE, "\t%s = 0x%08x\n", mips_reg_name(r.reg), r.value);
+        else
+            trace_record(&r, arch, mem);
+    }
+    
+    if ( ret )
+        mipsim_printf(IO_WARNING, "%s is truncated\n", trace);
+    
+    fclose(f);
+    
+    mipsim_config_fini();
+    
+    return ret;
+}
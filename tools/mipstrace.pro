@@ -0,0 +1,15 @@
+
+TEMPLATE = app
+TARGET = mipstrace
+
+CONFIG += debug
+CONFIG -= qt
+
+OBJECTS_DIR = .obj
+INCLUDEPATH += ..
+DEPENDPATH += ..
+
+QMAKE_CFLAGS += -std=c99 -Wextra
+
+HEADERS += trace.h config.h io.h mips.h
+SOURCES += mipstrace.c util.c config.c io.c elffile.c mipself.c mips.c mips_p.c decode.c threaded.c jit.c memory.c memflat.c monitor.c files.c writer.c batch.c trace.c
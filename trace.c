@@ -0,0 +1,215 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+#include "trace.h"
+
+/*!
+    \file trace.c
+    \brief Binary execution trace
+    \author Hugues Bruant
+*/
+
+#include "io.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#define TRACE_BUFFER_RECORDS 65536
+#define TRACE_TEXT_MAX       256
+
+/*!
+    \internal
+    \brief Write buffered records to the trace file
+*/
+static void mips_trace_flush(MIPSIM_Config *cfg)
+{
+    FILE *f = cfg->trace_bin;
+    unsigned int n = cfg->trace_count;
+    
+    if ( f != NULL && n )
+    {
+        if ( cfg->writer != NULL )
+            mipsim_writer_put(cfg->writer, f, cfg->trace_buffer, n * sizeof(MIPS_Trace_Record));
+        else if ( fwrite(cfg->trace_buffer, sizeof(MIPS_Trace_Record), n, f) != n )
+            mipsim_printf(IO_WARNING, "Trace: write failed\n");
+    }
+    
+    cfg->trace_count = 0;
+}
+
+/*!
+    \brief Open a binary trace file
+    \param path path of the trace file
+    \return 0 on success
+*/
+int mips_trace_open(const char *path)
+{
+    MIPSIM_Config *cfg = mipsim_config();
+    
+    mips_trace_close();
+    
+    cfg->trace_buffer = malloc(TRACE_BUFFER_RECORDS * sizeof(MIPS_Trace_Record));
+    
+    if ( cfg->trace_buffer == NULL )
+        return 1;
+    
+    cfg->trace_bin = fopen(path, "wb");
+    
+    if ( cfg->trace_bin == NULL )
+    {
+        free(cfg->trace_buffer);
+        cfg->trace_buffer = NULL;
+        return 1;
+    }
+    
+    MIPS_Trace_Header h;
+    memset(&h, 0, sizeof(MIPS_Trace_Header));
+    memcpy(h.magic, MIPS_TRACE_MAGIC, sizeof(MIPS_TRACE_MAGIC));
+    h.version = MIPS_TRACE_VERSION;
+    h.record_size = sizeof(MIPS_Trace_Record);
+    
+    fwrite(&h, sizeof(MIPS_Trace_Header), 1, cfg->trace_bin);
+    
+    return 0;
+}
+
+/*!
+    \brief Flush and close the binary trace file, if any
+*/
+void mips_trace_close()
+{
+    MIPSIM_Config *cfg = mipsim_config();
+    
+    if ( cfg->trace_bin != NULL )
+    {
+        mips_trace_flush(cfg);
+        
+        if ( cfg->writer != NULL && mipsim_writer_sync(cfg->writer) )
+            mipsim_printf(IO_WARNING, "Trace: write failed\n");
+        
+        fclose(cfg->trace_bin);
+        cfg->trace_bin = NULL;
+    }
+    
+    free(cfg->trace_buffer);
+    cfg->trace_buffer = NULL;
+    cfg->trace_count = 0;
+}
+
+/*!
+    \internal
+    \brief Append a cleared record to the trace buffer
+*/
+static MIPS_Trace_Record* mips_trace_append(MIPSIM_Config *cfg)
+{
+    if ( cfg->trace_count == TRACE_BUFFER_RECORDS )
+        mips_trace_flush(cfg);
+    
+    MIPS_Trace_Record *r = &cfg->trace_buffer[cfg->trace_count++];
+    
+    memset(r, 0, sizeof(MIPS_Trace_Record));
+    
+    return r;
+}
+
+/*!
+    \brief Start the record of a new instruction
+    \param pc address of the instruction
+    \param ir instruction word
+*/
+void mips_trace_insn(uint32_t pc, uint32_t ir)
+{
+    MIPS_Trace_Record *r = mips_trace_append(mipsim_config());
+    
+    r->pc = pc;
+    r->ir = ir;
+}
+
+/*!
+    \brief Record a register write by the current instruction
+*/
+void mips_trace_reg(int reg, uint32_t value)
+{
+    MIPSIM_Config *cfg = mipsim_config();
+    
+    if ( !cfg->trace_count )
+        return;
+    
+    MIPS_Trace_Record *r = &cfg->trace_buffer[cfg->trace_count - 1];
+    
+    r->reg = reg;
+    r->value = value;
+    r->flags |= TRACE_REG;
+}
+
+/*!
+    \brief Record a memory access by the current instruction
+*/
+void mips_trace_mem(uint32_t addr, int flags)
+{
+    MIPSIM_Config *cfg = mipsim_config();
+    
+    if ( !cfg->trace_count )
+        return;
+    
+    MIPS_Trace_Record *r = &cfg->trace_buffer[cfg->trace_count - 1];
+    
+    r->addr = addr;
+    r->flags |= flags;
+}
+
+/*!
+    \brief Record a register write made outside of any instruction
+*/
+void mips_trace_set(int reg, uint32_t value)
+{
+    MIPS_Trace_Record *r = mips_trace_append(mipsim_config());
+    
+    r->reg = reg;
+    r->value = value;
+    r->flags = TRACE_SET;
+}
+
+/*!
+    \brief Record text traced outside of any instruction
+    
+    Text is truncated to TRACE_TEXT_MAX - 1 bytes.
+    
+    \see mips_trace_note
+*/
+void mips_trace_text(const char *fmt, ...)
+{
+    MIPSIM_Config *cfg = mipsim_config();
+    char s[TRACE_TEXT_MAX];
+    
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(s, TRACE_TEXT_MAX, fmt, args);
+    va_end(args);
+    
+    if ( n < 0 )
+        return;
+    
+    if ( n >= TRACE_TEXT_MAX )
+        n = TRACE_TEXT_MAX - 1;
+    
+    MIPS_Trace_Record *r = mips_trace_append(cfg);
+    
+    r->value = n;
+    r->flags = TRACE_TEXT;
+    
+    for ( int i = 0; i < n; i += sizeof(MIPS_Trace_Record) )
+    {
+        int len = n - i < (int)sizeof(MIPS_Trace_Record) ? n - i : (int)sizeof(MIPS_Trace_Record);
+        
+        memcpy(mips_trace_append(cfg), s + i, len);
+    }
+}
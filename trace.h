@@ -0,0 +1,87 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+#ifndef _MIPSIM_TRACE_H_
+#define _MIPSIM_TRACE_H_
+
+/*!
+    \file trace.h
+    \brief Binary execution trace
+    \author Hugues Bruant
+    
+    A binary trace is a MIPS_Trace_Header followed by one MIPS_Trace_Record
+    per executed instruction, all in host byte order.
+    
+    Text traced outside of any instruction (monitor calls, faults) is stored
+    in a TRACE_TEXT record giving its length in value, followed by as many
+    records as needed to hold the text. Register writes outside of any
+    instruction (stack pointer setup, monitor results) are TRACE_SET records.
+*/
+
+#include "io.h"
+#include "config.h"
+
+#include <inttypes.h>
+
+#define MIPS_TRACE_MAGIC    "MIPSTRC"
+#define MIPS_TRACE_VERSION  2
+
+enum MIPS_Trace_Flags {
+    TRACE_REG   = 1,
+    TRACE_MEM_R = 2,
+    TRACE_MEM_W = 4,
+    TRACE_TEXT  = 8,
+    TRACE_SET   = 16
+};
+
+typedef struct _MIPS_Trace_Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+} MIPS_Trace_Header;
+
+typedef struct _MIPS_Trace_Record {
+    uint32_t pc;
+    uint32_t ir;
+    uint32_t value;
+    uint32_t addr;
+    uint8_t reg;
+    uint8_t flags;
+    uint16_t reserved;
+} MIPS_Trace_Record;
+
+/*!
+    \brief Whether binary trace output is enabled
+*/
+#ifdef MIPSIM_NO_TRACE
+#define mips_trace_on() 0
+#else
+#define mips_trace_on() (mipsim_config()->trace_bin != NULL)
+#endif
+
+int mips_trace_open(const char *path);
+void mips_trace_close();
+
+void mips_trace_insn(uint32_t pc, uint32_t ir);
+void mips_trace_reg(int reg, uint32_t value);
+void mips_trace_mem(uint32_t addr, int flags);
+void mips_trace_set(int reg, uint32_t value);
+void mips_trace_text(const char *fmt, ...);
+
+/*!
+    \brief Trace text that is not part of an instruction, to both traces
+*/
+#define mips_trace_note(...) \
+    do { \
+        mipsim_trace(__VA_ARGS__); \
+        if ( mips_trace_on() ) mips_trace_text(__VA_ARGS__); \
+    } while ( 0 )
+
+#endif
@@ -0,0 +1,362 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+// clock_gettime is not part of C99
+#define _DEFAULT_SOURCE
+
+#include "writer.h"
+
+/*!
+    \file writer.c
+    \brief Asynchronous output writer
+    \author Hugues Bruant
+    
+    The ring buffer is a sequence of records made of a 16 bytes header
+    (destination stream and payload length) followed by the payload, padded
+    to a multiple of 16 bytes so that headers never wrap around. Positions
+    are free-running 32 bit counters, the producer only ever moves head and
+    the consumer only ever moves tail.
+    
+    Neither side spins : a side that has to wait raises a flag and sleeps
+    on a condition variable, the other side only takes the lock to wake it
+    up when it sees the flag. To keep context switches rare, the producer
+    only wakes the writer thread once a quarter of the ring is used, or when
+    it needs the ring drained; the writer thread otherwise wakes up on its
+    own every WRITER_LATENCY_MS milliseconds.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) && defined(__GNUC__)
+
+#include <time.h>
+#include <pthread.h>
+
+#define WRITER_HEADER   16
+#define WRITER_STREAMS  8
+
+#define WRITER_LATENCY_MS   10
+
+#define load(x)         __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define store(x, v)     __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+
+typedef struct _Writer_Record {
+    FILE *f;
+    uint32_t len;
+} Writer_Record;
+
+struct _MIPSIM_Writer {
+    uint8_t *ring;
+    uint32_t size;
+    
+    uint32_t head, tail, synced;
+    int producer_waiting, consumer_waiting, stop, errors;
+    
+    pthread_mutex_t lock;
+    pthread_cond_t wake_producer, wake_consumer;
+    pthread_t thread;
+};
+
+/*!
+    \internal
+    \brief Wake up a side of the ring if it is waiting
+*/
+static void mipsim_writer_wake(MIPSIM_Writer *w, int *waiting, pthread_cond_t *c)
+{
+    if ( load(*waiting) )
+    {
+        pthread_mutex_lock(&w->lock);
+        pthread_cond_broadcast(c);
+        pthread_mutex_unlock(&w->lock);
+    }
+}
+
+/*!
+    \internal
+    \brief Contiguous part of a range of ring positions
+    \param n length of the range, receives the length of the contiguous part
+*/
+static const uint8_t* mipsim_writer_span(MIPSIM_Writer *w, uint32_t pos, uint32_t *n)
+{
+    uint32_t off = pos & (w->size - 1);
+    
+    if ( *n > w->size - off )
+        *n = w->size - off;
+    
+    return w->ring + off;
+}
+
+/*!
+    \internal
+    \brief Background thread draining the ring
+    
+    Streams are flushed whenever the ring runs empty, which is also when
+    producers waiting in mipsim_writer_sync are released.
+*/
+static void* mipsim_writer_main(void *p)
+{
+    MIPSIM_Writer *w = (MIPSIM_Writer*)p;
+    FILE *dirty[WRITER_STREAMS];
+    int ndirty = 0;
+    uint32_t t = w->tail;
+    
+    for ( ; ; )
+    {
+        if ( t == load(w->head) )
+        {
+            for ( int i = 0; i < ndirty; ++i )
+                if ( fflush(dirty[i]) )
+                    __atomic_add_fetch(&w->errors, 1, __ATOMIC_SEQ_CST);
+            
+            ndirty = 0;
+            
+            store(w->synced, t);
+            mipsim_writer_wake(w, &w->producer_waiting, &w->wake_producer);
+            
+            pthread_mutex_lock(&w->lock);
+            store(w->consumer_waiting, 1);
+            
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += WRITER_LATENCY_MS * 1000000L;
+            
+            if ( deadline.tv_nsec >= 1000000000L )
+            {
+                deadline.tv_nsec -= 1000000000L;
+                ++deadline.tv_sec;
+            }
+            
+            while ( t == load(w->head) && !w->stop )
+                if ( pthread_cond_timedwait(&w->wake_consumer, &w->lock, &deadline) )
+                    break;
+            
+            store(w->consumer_waiting, 0);
+            int stop = w->stop && t == load(w->head);
+            pthread_mutex_unlock(&w->lock);
+            
+            if ( stop )
+                break;
+            
+            continue;
+        }
+        
+        Writer_Record r;
+        memcpy(&r, w->ring + (t & (w->size - 1)), sizeof(Writer_Record));
+        
+        uint32_t pos = t + WRITER_HEADER, left = r.len;
+        
+        while ( left )
+        {
+            uint32_t n = left;
+            const uint8_t *d = mipsim_writer_span(w, pos, &n);
+            
+            if ( fwrite(d, 1, n, r.f) != n )
+                __atomic_add_fetch(&w->errors, 1, __ATOMIC_SEQ_CST);
+            
+            pos += n;
+            left -= n;
+        }
+        
+        int i = 0;
+        
+        while ( i < ndirty && dirty[i] != r.f )
+            ++i;
+        
+        if ( i == ndirty )
+        {
+            if ( ndirty < WRITER_STREAMS )
+                dirty[ndirty++] = r.f;
+            else
+                fflush(r.f);
+        }
+        
+        t += (WRITER_HEADER + r.len + WRITER_HEADER - 1) & ~(WRITER_HEADER - 1);
+        store(w->tail, t);
+        
+        mipsim_writer_wake(w, &w->producer_waiting, &w->wake_producer);
+    }
+    
+    return NULL;
+}
+
+/*!
+    \brief Create a writer and start its thread
+    \param size ring buffer size, rounded up to a power of two
+    \return writer, NULL if threads are not available
+*/
+MIPSIM_Writer* mipsim_writer_create(uint32_t size)
+{
+    uint32_t s = 4096;
+    
+    while ( s < size && s < 0x40000000 )
+        s <<= 1;
+    
+    MIPSIM_Writer *w = (MIPSIM_Writer*)malloc(sizeof(MIPSIM_Writer));
+    
+    if ( w == NULL )
+        return NULL;
+    
+    w->ring = (uint8_t*)malloc(s);
+    w->size = s;
+    w->head = w->tail = w->synced = 0;
+    w->producer_waiting = w->consumer_waiting = w->stop = w->errors = 0;
+    
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wake_producer, NULL);
+    pthread_cond_init(&w->wake_consumer, NULL);
+    
+    if ( w->ring == NULL || pthread_create(&w->thread, NULL, mipsim_writer_main, w) )
+    {
+        pthread_cond_destroy(&w->wake_consumer);
+        pthread_cond_destroy(&w->wake_producer);
+        pthread_mutex_destroy(&w->lock);
+        free(w->ring);
+        free(w);
+        return NULL;
+    }
+    
+    return w;
+}
+
+/*!
+    \brief Write out everything and stop the writer thread
+*/
+void mipsim_writer_destroy(MIPSIM_Writer *w)
+{
+    if ( w == NULL )
+        return;
+    
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_broadcast(&w->wake_consumer);
+    pthread_mutex_unlock(&w->lock);
+    
+    pthread_join(w->thread, NULL);
+    
+    pthread_cond_destroy(&w->wake_consumer);
+    pthread_cond_destroy(&w->wake_producer);
+    pthread_mutex_destroy(&w->lock);
+    free(w->ring);
+    free(w);
+}
+
+/*!
+    \brief Queue output for a stream
+    \param f destination stream
+    \param d data, copied into the ring
+    \param n number of bytes
+    
+    Blocks while the ring is full. Output larger than the ring is split.
+*/
+void mipsim_writer_put(MIPSIM_Writer *w, FILE *f, const void *d, uint32_t n)
+{
+    const uint8_t *p = (const uint8_t*)d;
+    
+    while ( n )
+    {
+        uint32_t len = n < w->size / 2 ? n : w->size / 2;
+        uint32_t need = (WRITER_HEADER + len + WRITER_HEADER - 1) & ~(WRITER_HEADER - 1);
+        uint32_t h = w->head;
+        
+        if ( w->size - (h - load(w->tail)) < need )
+        {
+            pthread_mutex_lock(&w->lock);
+            store(w->producer_waiting, 1);
+            pthread_cond_broadcast(&w->wake_consumer);
+            
+            while ( w->size - (h - load(w->tail)) < need )
+                pthread_cond_wait(&w->wake_producer, &w->lock);
+            
+            store(w->producer_waiting, 0);
+            pthread_mutex_unlock(&w->lock);
+        }
+        
+        Writer_Record r;
+        r.f = f;
+        r.len = len;
+        memcpy(w->ring + (h & (w->size - 1)), &r, sizeof(Writer_Record));
+        
+        uint32_t pos = h + WRITER_HEADER, left = len;
+        
+        while ( left )
+        {
+            uint32_t c = left;
+            uint8_t *dst = (uint8_t*)mipsim_writer_span(w, pos, &c);
+            
+            memcpy(dst, p, c);
+            
+            p += c;
+            pos += c;
+            left -= c;
+        }
+        
+        store(w->head, h + need);
+        
+        if ( h + need - load(w->tail) >= w->size / 4 )
+            mipsim_writer_wake(w, &w->consumer_waiting, &w->wake_consumer);
+        
+        n -= len;
+    }
+}
+
+/*!
+    \brief Wait until all queued output has been written and flushed
+    \return number of failed writes since the previous call
+*/
+int mipsim_writer_sync(MIPSIM_Writer *w)
+{
+    uint32_t h = w->head;
+    
+    if ( load(w->synced) != h )
+    {
+        pthread_mutex_lock(&w->lock);
+        store(w->producer_waiting, 1);
+        pthread_cond_broadcast(&w->wake_consumer);
+        
+        while ( load(w->synced) != h )
+            pthread_cond_wait(&w->wake_producer, &w->lock);
+        
+        store(w->producer_waiting, 0);
+        pthread_mutex_unlock(&w->lock);
+    }
+    
+    return __atomic_exchange_n(&w->errors, 0, __ATOMIC_SEQ_CST);
+}
+
+#else
+
+MIPSIM_Writer* mipsim_writer_create(uint32_t size)
+{
+    (void)size;
+    
+    return NULL;
+}
+
+void mipsim_writer_destroy(MIPSIM_Writer *w)
+{
+    (void)w;
+}
+
+void mipsim_writer_put(MIPSIM_Writer *w, FILE *f, const void *d, uint32_t n)
+{
+    (void)w;
+    
+    fwrite(d, 1, n, f);
+}
+
+int mipsim_writer_sync(MIPSIM_Writer *w)
+{
+    (void)w;
+    
+    return 0;
+}
+
+#endif
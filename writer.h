@@ -0,0 +1,35 @@
+/****************************************************************************
+**  MIPSim
+**   
+**  Copyright (c) 2010, Hugues Bruant
+**  All rights reserved.
+**  
+**  This file may be used under the terms of the BSD license.
+**  Refer to the accompanying COPYING file for legalese.
+****************************************************************************/
+
+#ifndef _MIPSIM_WRITER_H_
+#define _MIPSIM_WRITER_H_
+
+/*!
+    \file writer.h
+    \brief Asynchronous output writer
+    \author Hugues Bruant
+    
+    Output is copied into a single-producer single-consumer ring buffer by
+    the simulation thread and written to its destination stream by a
+    background thread.
+*/
+
+#include <stdio.h>
+#include <inttypes.h>
+
+typedef struct _MIPSIM_Writer MIPSIM_Writer;
+
+MIPSIM_Writer* mipsim_writer_create(uint32_t size);
+void mipsim_writer_destroy(MIPSIM_Writer *w);
+
+void mipsim_writer_put(MIPSIM_Writer *w, FILE *f, const void *d, uint32_t n);
+int mipsim_writer_sync(MIPSIM_Writer *w);
+
+#endif